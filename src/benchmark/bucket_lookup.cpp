@@ -0,0 +1,199 @@
+// Micro benchmark of the bucket signature probe.
+// Measures the per-lookup cycle count of the original bit-by-bit Bitmap loop
+// against every SignatureScanner kernel supported by the running CPU, on the
+// default LBA bucket geometry (16-bit signature + 20-bit fp hash per slot) and
+// FP bucket geometry (16-bit signature + 4-bit value per slot), and of the
+// matchKeys16 kernels on the same signatures stored in the aligned layout.
+// Then, for every geometry with compile-time specialized kernels, compares the
+// specialized kernels against the generic kernel dispatched for the running CPU.
+//
+// usage: bucket_lookup [nSlotsPerBucket] [nLookups]
+#include <x86intrin.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "metadata/bitmap.h"
+#include "metadata/signature_scan.h"
+
+namespace cache {
+class BucketLookupBenchmark {
+ public:
+  BucketLookupBenchmark(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nSlots, uint32_t nBuckets)
+      : nBitsPerKey_(nBitsPerKey),
+        nBitsPerSlot_(nBitsPerKey + nBitsPerValue),
+        nSlots_(nSlots),
+        nBuckets_(nBuckets),
+        nBytesPerBucket_((nBitsPerSlot_ * nSlots + 7) / 8),
+        nBytesPerBucketForValid_((nSlots + 7) / 8),
+        data_(std::make_unique<uint8_t[]>(nBytesPerBucket_ * nBuckets + SIGNATURE_SCAN_TAIL_PADDING)),
+        valid_(std::make_unique<uint8_t[]>(nBytesPerBucketForValid_ * nBuckets)),
+        keys_(std::make_unique<uint16_t[]>(nSlots * nBuckets)) {
+    std::mt19937_64 rng(7);
+    for (uint32_t bucketId = 0; bucketId < nBuckets_; ++bucketId) {
+      Bitmap::Manipulator data(data_.get() + nBytesPerBucket_ * bucketId);
+      Bitmap::Manipulator valid(valid_.get() + nBytesPerBucketForValid_ * bucketId);
+      for (uint32_t slotId = 0; slotId < nSlots_; ++slotId) {
+        uint32_t b = slotId * nBitsPerSlot_;
+        keys_[nSlots_ * bucketId + slotId] = rng() & ((1u << nBitsPerKey_) - 1);
+        data.storeBits(b, b + nBitsPerKey_, keys_[nSlots_ * bucketId + slotId]);
+        data.storeBits(b + nBitsPerKey_, b + nBitsPerSlot_, rng() & ((1u << (nBitsPerSlot_ - nBitsPerKey_)) - 1));
+        // ~90% occupancy, as in a warmed-up cache
+        if (rng() % 10) valid.set(slotId);
+      }
+    }
+    // Half of the lookups hit a random valid-or-not slot, the other half are random signatures
+    for (uint32_t i = 0; i < kNumQueries; ++i) {
+      uint32_t bucketId = rng() % nBuckets_;
+      uint32_t signature = rng() & ((1u << nBitsPerKey_) - 1);
+      if (rng() & 1) {
+        uint32_t b = (rng() % nSlots_) * nBitsPerSlot_;
+        signature = Bitmap::Manipulator(data_.get() + nBytesPerBucket_ * bucketId).getBits(b, b + nBitsPerKey_);
+      }
+      queries_.emplace_back(bucketId, signature);
+    }
+  }
+
+  // The probe before vectorization: LBABucket::lookup walking every slot through Bitmap::Manipulator
+  uint32_t lookupBitmap(uint32_t bucketId, uint32_t signature) {
+    Bitmap::Manipulator data(data_.get() + nBytesPerBucket_ * bucketId);
+    Bitmap::Manipulator valid(valid_.get() + nBytesPerBucketForValid_ * bucketId);
+    for (uint32_t slotId = 0; slotId < nSlots_; slotId++) {
+      if (!valid.get(slotId)) continue;
+      uint32_t b = slotId * nBitsPerSlot_;
+      if (data.getBits(b, b + nBitsPerKey_) == signature) return slotId;
+    }
+    return ~((uint32_t)0);
+  }
+
+  uint32_t lookupKernel(SignatureScanner::MatchFunc match, uint32_t bucketId, uint32_t signature) {
+    uint64_t mask[MAX_NUM_SLOTS_PER_BUCKET / 64];
+    match(data_.get() + nBytesPerBucket_ * bucketId, valid_.get() + nBytesPerBucketForValid_ * bucketId,
+          nBitsPerSlot_, nBitsPerKey_, nSlots_, signature, mask);
+    return SignatureScanner::findFirst(mask, nSlots_);
+  }
+
+  void runFixed(const SignatureScanner::FixedMatch &fixed, uint32_t nLookups) {
+    uint64_t expected, checksum;
+    auto generic = SignatureScanner::getInstance().getMatchFunc();
+    double base =
+        measure(nLookups, expected, [this, generic](uint32_t b, uint32_t s) { return lookupKernel(generic, b, s); });
+    printf("  %2u/%2u/%3u  generic %6.1f", fixed.nBitsPerKey, fixed.nBitsPerValue, fixed.nSlots, base);
+
+    struct {
+      const char *name;
+      bool supported;
+      SignatureScanner::MatchFunc match;
+    } kernels[] = {
+        {"AVX2", SignatureScanner::isAVX2Supported(), fixed.avx2},
+        {"AVX-512 VBMI", SignatureScanner::isAVX512VBMISupported(), fixed.avx512},
+    };
+    for (auto &kernel : kernels) {
+      if (!kernel.supported || kernel.match == nullptr) continue;
+      auto match = kernel.match;
+      double cycles =
+          measure(nLookups, checksum, [this, match](uint32_t b, uint32_t s) { return lookupKernel(match, b, s); });
+      printf(" | %s %6.1f (%.2fx)%s", kernel.name, cycles, base / cycles, checksum == expected ? "" : " MISMATCH");
+    }
+    printf("\n");
+  }
+
+  uint32_t lookupAligned(SignatureScanner::MatchKeys16Func match, uint32_t bucketId, uint32_t signature) {
+    uint64_t mask[MAX_NUM_SLOTS_PER_BUCKET / 64];
+    match(keys_.get() + nSlots_ * bucketId, valid_.get() + nBytesPerBucketForValid_ * bucketId, nSlots_, signature,
+          mask);
+    return SignatureScanner::findFirst(mask, nSlots_);
+  }
+
+  template <typename F>
+  double measure(uint32_t nLookups, uint64_t &checksum, F lookup) {
+    checksum = 0;
+    uint64_t begin = __rdtsc();
+    for (uint32_t i = 0; i < nLookups; ++i) {
+      const auto &q = queries_[i % kNumQueries];
+      checksum = checksum * 31 + lookup(q.first, q.second);
+    }
+    return (double)(__rdtsc() - begin) / nLookups;
+  }
+
+  void run(const char *name, uint32_t nLookups) {
+    uint64_t expected, checksum;
+    printf("%s: %u-bit signature, %u bits per slot, %u slots per bucket\n", name, nBitsPerKey_, nBitsPerSlot_, nSlots_);
+    double base = measure(nLookups, expected, [this](uint32_t b, uint32_t s) { return lookupBitmap(b, s); });
+    printf("    %-8s %8.1f cycles/lookup\n", "bitmap", base);
+
+    struct {
+      const char *name;
+      bool supported;
+      SignatureScanner::MatchFunc match;
+    } kernels[] = {
+        {"scalar", true, SignatureScanner::matchScalar},
+        {"SSE4.2", SignatureScanner::isSSE42Supported(), SignatureScanner::matchSSE42},
+        {"AVX2", SignatureScanner::isAVX2Supported(), SignatureScanner::matchAVX2},
+        {"AVX-512", SignatureScanner::isAVX512Supported(), SignatureScanner::matchAVX512},
+    };
+    for (auto &kernel : kernels) {
+      if (!kernel.supported) continue;
+      auto match = kernel.match;
+      double cycles =
+          measure(nLookups, checksum, [this, match](uint32_t b, uint32_t s) { return lookupKernel(match, b, s); });
+      printf("    %-8s %8.1f cycles/lookup (%.2fx)%s\n", kernel.name, cycles, base / cycles,
+             checksum == expected ? "" : "  MISMATCH");
+    }
+
+    struct {
+      const char *name;
+      bool supported;
+      SignatureScanner::MatchKeys16Func match;
+    } alignedKernels[] = {
+        {"scalar", true, SignatureScanner::matchKeys16Scalar},
+        {"SSE4.2", SignatureScanner::isSSE42Supported(), SignatureScanner::matchKeys16SSE42},
+        {"AVX2", SignatureScanner::isAVX2Supported(), SignatureScanner::matchKeys16AVX2},
+        {"AVX-512", SignatureScanner::isAVX512Supported(), SignatureScanner::matchKeys16AVX512},
+    };
+    printf("  aligned layout (uint16_t signature array):\n");
+    for (auto &kernel : alignedKernels) {
+      if (!kernel.supported) continue;
+      auto match = kernel.match;
+      double cycles =
+          measure(nLookups, checksum, [this, match](uint32_t b, uint32_t s) { return lookupAligned(match, b, s); });
+      printf("    %-8s %8.1f cycles/lookup (%.2fx)%s\n", kernel.name, cycles, base / cycles,
+             checksum == expected ? "" : "  MISMATCH");
+    }
+  }
+
+ private:
+  static const uint32_t kNumQueries = 1u << 16;
+  uint32_t nBitsPerKey_, nBitsPerSlot_, nSlots_, nBuckets_, nBytesPerBucket_, nBytesPerBucketForValid_;
+  std::unique_ptr<uint8_t[]> data_;
+  std::unique_ptr<uint8_t[]> valid_;
+  std::unique_ptr<uint16_t[]> keys_;
+  std::vector<std::pair<uint32_t, uint32_t>> queries_;
+};
+}  // namespace cache
+
+int main(int argc, char **argv) {
+  uint32_t nSlots = argc > 1 ? atoi(argv[1]) : 128;
+  uint32_t nLookups = argc > 2 ? atoi(argv[2]) : 2000000;
+  if (nSlots == 0 || nSlots > MAX_NUM_SLOTS_PER_BUCKET) {
+    fprintf(stderr, "nSlotsPerBucket must be in [1, %u]\n", MAX_NUM_SLOTS_PER_BUCKET);
+    return 1;
+  }
+  printf("dispatched kernel: %s\n", cache::SignatureScanner::getInstance().getKernelName());
+
+  cache::BucketLookupBenchmark lba(16, 20, nSlots, 4096);
+  lba.run("LBA bucket", nLookups);
+  cache::BucketLookupBenchmark fp(16, 4, nSlots, 4096);
+  fp.run("FP bucket", nLookups);
+
+  printf("specialized geometries (signature/value bits/slots), cycles/lookup:\n");
+  for (uint32_t i = 0; i < cache::SignatureScanner::kNumFixedMatches; ++i) {
+    const cache::SignatureScanner::FixedMatch &fixed = cache::SignatureScanner::kFixedMatches[i];
+    cache::BucketLookupBenchmark(fixed.nBitsPerKey, fixed.nBitsPerValue, fixed.nSlots, 4096).runFixed(fixed, nLookups);
+  }
+  return 0;
+}
@@ -0,0 +1,154 @@
+// Micro benchmark of content-defined chunking.
+// 1. Dedup ratio: a synthetic VM image is written as a stream of requests, followed by versions
+//    of it where sectors were inserted, deleted and overwritten (as a backup of the image would
+//    see them). Every request is chunked with fixed-size chunks (8 KiB and the 32 KiB chunk
+//    size) and with content-defined chunks (cdcMinSize/cdcAvgSize/chunkSize), and the share of
+//    bytes whose chunk was already seen is reported.
+//    The FIU traces only carry one fingerprint per fixed-size chunk, not the data, so they cannot
+//    tell the two apart.
+// 2. Chunking throughput of the scalar, AVX2 and AVX-512 kernels on the image; the chunk lengths
+//    of every kernel are checked against the scalar ones.
+//
+// usage: cdc_chunking [imageSize(MiB)] [nVersions] [requestSize(KiB)]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+#include "chunking/content_defined_chunking.h"
+#include "common/config.h"
+#include "utils/xxh3.h"
+
+namespace cache {
+class CDCBenchmark {
+ public:
+  CDCBenchmark(uint64_t imageSize, uint32_t nVersions, uint32_t requestSize)
+      : rng_(2024u), requestSize_(requestSize) {
+    // Base image: random sectors, a quarter of them zero-filled (free space)
+    std::vector<uint8_t> image(imageSize);
+    for (uint64_t i = 0; i < imageSize; i += kSector) {
+      if (rng_() % 4 == 0) continue;
+      fillRandom(image.data() + i, kSector);
+    }
+    versions_.push_back(image);
+    // Every version inserts, deletes and overwrites runs of 1 ~ 16 sectors at random places
+    uint32_t nEdits = imageSize / (1024 * 1024) * 4;
+    for (uint32_t v = 1; v < nVersions; ++v) {
+      for (uint32_t e = 0; e < nEdits; ++e) {
+        uint64_t pos = rng_() % (image.size() / kSector) * kSector;
+        uint64_t len = (rng_() % 16 + 1) * kSector;
+        std::vector<uint8_t> data(len);
+        fillRandom(data.data(), len);
+        switch (rng_() % 3) {
+          case 0:
+            image.insert(image.begin() + pos, data.begin(), data.end());
+            break;
+          case 1:
+            image.erase(image.begin() + pos, image.begin() + std::min(pos + len, (uint64_t)image.size()));
+            break;
+          default:
+            memcpy(image.data() + pos, data.data(), std::min(len, image.size() - pos));
+        }
+      }
+      versions_.push_back(image);
+    }
+  }
+
+  void runDedup() {
+    uint32_t chunkSize = Config::getInstance().getChunkSize();
+    ContentDefinedChunking &cdc = ContentDefinedChunking::getInstance();
+    printf("Dedup ratio over %zu versions, %u KiB requests:\n", versions_.size(), requestSize_ / 1024);
+    for (uint32_t fixedSize : {8192u, chunkSize}) {
+      printf("    fixed %2u KiB:                 %6.2f%%\n", fixedSize / 1024,
+             dedupRatio([fixedSize](const uint8_t *, uint64_t len, std::vector<uint32_t> &lengths) {
+               for (uint64_t p = 0; p < len; p += fixedSize) lengths.push_back(std::min<uint64_t>(fixedSize, len - p));
+             }));
+    }
+    printf("    content-defined %u/%u/%u KiB: %6.2f%%\n", cdc.getMinSize() / 1024, cdc.getAvgSize() / 1024,
+           cdc.getMaxSize() / 1024,
+           dedupRatio([&cdc](const uint8_t *data, uint64_t len, std::vector<uint32_t> &lengths) {
+             cdc.chunk(data, len, lengths);
+           }));
+  }
+
+  void runThroughput() {
+    Config &config = Config::getInstance();
+    const std::vector<uint8_t> &image = versions_[0];
+    std::vector<uint32_t> reference;
+    printf("Chunking throughput (%s selected at startup):\n", ContentDefinedChunking::getKernelName());
+    struct {
+      const char *name;
+      bool supported;
+      ContentDefinedChunking::ScanFunc scan;
+    } kernels[] = {{"scalar", true, ContentDefinedChunking::scanScalar},
+                   {"AVX2", (bool)__builtin_cpu_supports("avx2"), ContentDefinedChunking::scanAVX2},
+                   {"AVX-512", (bool)__builtin_cpu_supports("avx512f"), ContentDefinedChunking::scanAVX512}};
+    for (const auto &kernel : kernels) {
+      if (!kernel.supported) {
+        printf("    %-8s not supported\n", kernel.name);
+        continue;
+      }
+      ContentDefinedChunking cdc(config.getCDCMinSize(), config.getCDCAvgSize(), config.getChunkSize(), kernel.scan);
+      std::vector<uint32_t> lengths;
+      auto begin = std::chrono::steady_clock::now();
+      cdc.chunk(image.data(), image.size(), lengths);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      if (reference.empty()) reference = lengths;
+      printf("    %-8s %8.1f MB/s, %zu chunks, average %lu bytes%s\n", kernel.name,
+             image.size() / seconds / 1024 / 1024, lengths.size(), image.size() / lengths.size(),
+             lengths == reference ? "" : " (MISMATCH)");
+      if (lengths != reference) exit(1);
+    }
+  }
+
+ private:
+  static const uint64_t kSector = 512;
+
+  void fillRandom(uint8_t *buf, uint64_t len) {
+    for (uint64_t i = 0; i < len; i += sizeof(uint64_t)) {
+      uint64_t v = rng_();
+      memcpy(buf + i, &v, std::min<uint64_t>(sizeof(v), len - i));
+    }
+  }
+
+  // Share of the bytes of all versions in chunks whose content was seen before
+  template <class ChunkFunc>
+  double dedupRatio(ChunkFunc chunkFunc) {
+    std::unordered_set<uint64_t> seen;
+    uint64_t nBytes = 0, nDupBytes = 0;
+    std::vector<uint32_t> lengths;
+    for (const auto &version : versions_) {
+      for (uint64_t req = 0; req < version.size(); req += requestSize_) {
+        uint64_t len = std::min<uint64_t>(requestSize_, version.size() - req);
+        const uint8_t *data = version.data() + req;
+        lengths.clear();
+        chunkFunc(data, len, lengths);
+        for (uint32_t length : lengths) {
+          XXH128_hash_t h = XXH3_128bits(data, length);
+          if (!seen.insert(h.low64 ^ h.high64 * 0x9e3779b97f4a7c15ull).second) nDupBytes += length;
+          nBytes += length;
+          data += length;
+        }
+      }
+    }
+    return 100.0 * nDupBytes / nBytes;
+  }
+
+  std::mt19937_64 rng_;
+  uint32_t requestSize_;
+  std::vector<std::vector<uint8_t>> versions_;
+};
+}  // namespace cache
+
+int main(int argc, char **argv) {
+  uint64_t imageSize = (argc > 1 ? atoll(argv[1]) : 256) * 1024 * 1024;
+  uint32_t nVersions = argc > 2 ? atoi(argv[2]) : 4;
+  uint32_t requestSize = (argc > 3 ? atoi(argv[3]) : 1024) * 1024;
+  cache::CDCBenchmark benchmark(imageSize, nVersions, requestSize);
+  benchmark.runDedup();
+  benchmark.runThroughput();
+  return 0;
+}
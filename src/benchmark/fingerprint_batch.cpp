@@ -0,0 +1,96 @@
+// Micro benchmark of the fingerprint stage.
+// Fingerprints a buffer of random chunks one at a time with mh_sha1 (Chunk::computeFingerprint)
+// and in batches of 1 ~ FINGERPRINT_BATCH_SIZE chunks with the SHA-1 multi-buffer manager
+// (Chunk::computeFingerprints), for 8, 16 and 32 KiB chunks. Batches of one chunk give the
+// single-lane cost of sha1_mb; the batched digests are checked against the single-lane ones.
+// The speedup of the largest batch over one chunk is printed too: without one, the binary is not
+// using the SIMD lanes of ISA-L (e.g. it was linked against a serial implementation of the API).
+//
+// usage: fingerprint_batch [bufferSize(MiB)]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "common/common.h"
+#include "common/config.h"
+
+namespace cache {
+class FingerprintBatchBenchmark {
+ public:
+  explicit FingerprintBatchBenchmark(uint64_t bufferSize) : data_(bufferSize) {
+    std::mt19937_64 rng(107u);
+    for (uint64_t i = 0; i + sizeof(uint64_t) <= data_.size(); i += sizeof(uint64_t)) {
+      uint64_t v = rng();
+      memcpy(data_.data() + i, &v, sizeof(v));
+    }
+  }
+
+  void run(uint32_t chunkSize) {
+    Config::getInstance().setChunkSize(chunkSize);
+    std::vector<uint8_t> reference(data_.size() / chunkSize * 20);
+
+    printf("%2u KiB chunks:", chunkSize / 1024);
+    Config::getInstance().enableFingerprintBatching(false);
+    printf(" mh_sha1 %7.1f MB/s |", measure(chunkSize, 1, nullptr));
+
+    Config::getInstance().enableFingerprintBatching(true);
+    double single = measure(chunkSize, 1, reference.data()), batched = 0;
+    printf(" sha1_mb x1  %7.1f MB/s", single);
+    for (uint32_t batchSize : {4u, 8u, 16u}) {
+      batched = measure(chunkSize, batchSize, reference.data(), true);
+      printf(" x%-2u %7.1f MB/s", batchSize, batched);
+    }
+    printf(" | x16 / x1 %.2fx\n", batched / single);
+    if (batched < 1.5 * single) {
+      printf("  warning: no multi-buffer speedup, sha1_mb does not run on SIMD lanes\n");
+    }
+  }
+
+ private:
+  // Fingerprint every chunk of the buffer in batches of batchSize; record (or check) the digests
+  double measure(uint32_t chunkSize, uint32_t batchSize, uint8_t *digests, bool check = false) {
+    uint32_t nChunks = data_.size() / chunkSize;
+    Chunk chunks[FINGERPRINT_BATCH_SIZE];
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < nChunks; i += batchSize) {
+      uint32_t n = nChunks - i < batchSize ? nChunks - i : batchSize;
+      for (uint32_t j = 0; j < n; ++j) {
+        chunks[j].addr_ = 1ull * (i + j) * chunkSize;
+        chunks[j].len_ = chunkSize;
+        chunks[j].buf_ = data_.data() + 1ull * (i + j) * chunkSize;
+        chunks[j].traceFingerprint_ = nullptr;
+        chunks[j].bypassDedup_ = false;
+      }
+      if (Config::getInstance().isFingerprintBatchingEnabled()) {
+        Chunk::computeFingerprints(chunks, n);
+      } else {
+        chunks[0].computeFingerprint();
+      }
+      if (digests == nullptr) continue;
+      for (uint32_t j = 0; j < n; ++j) {
+        if (!check) {
+          memcpy(digests + (i + j) * 20, chunks[j].fingerprint_, 20);
+        } else if (memcmp(digests + (i + j) * 20, chunks[j].fingerprint_, 20) != 0) {
+          fprintf(stderr, "digest mismatch: chunk %u, batch size %u\n", i + j, batchSize);
+          exit(1);
+        }
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return 1.0 * nChunks * chunkSize / seconds / 1024 / 1024;
+  }
+
+  std::vector<uint8_t> data_;
+};
+}  // namespace cache
+
+int main(int argc, char **argv) {
+  uint64_t bufferSize = (argc > 1 ? atoll(argv[1]) : 256) * 1024 * 1024;
+  cache::Config::getInstance().enableTraceReplay(false);
+  cache::FingerprintBatchBenchmark benchmark(bufferSize);
+  for (uint32_t chunkSize : {8192u, 16384u, 32768u}) benchmark.run(chunkSize);
+  return 0;
+}
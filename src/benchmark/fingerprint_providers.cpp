@@ -0,0 +1,114 @@
+// Micro benchmark of the fingerprint algorithms (FingerprintProvider).
+// Fingerprints a buffer of random chunks with every algorithm, one chunk at a time (digest) and in
+// batches of FINGERPRINT_BATCH_SIZE chunks (digestBatch), for 8, 16 and 32 KiB chunks; the batched
+// digests are checked against the single ones. The BLAKE3 kernels (portable, AVX2) are compared
+// on their own, their digests checked against each other.
+//
+// usage: fingerprint_providers [bufferSize(MiB)]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "chunking/blake3.h"
+#include "chunking/fingerprint_provider.h"
+#include "common/common.h"
+
+namespace cache {
+class FingerprintProviderBenchmark {
+ public:
+  explicit FingerprintProviderBenchmark(uint64_t bufferSize) : data_(bufferSize) {
+    std::mt19937_64 rng(107u);
+    for (uint64_t i = 0; i + sizeof(uint64_t) <= data_.size(); i += sizeof(uint64_t)) {
+      uint64_t v = rng();
+      memcpy(data_.data() + i, &v, sizeof(v));
+    }
+  }
+
+  void run(uint32_t chunkSize) {
+    printf("%2u KiB chunks:\n", chunkSize / 1024);
+    for (FingerprintAlgorithmEnum algorithm :
+         {tSHA1Fingerprint, tSHA256Fingerprint, tBLAKE3Fingerprint, tXXH3Fingerprint}) {
+      std::unique_ptr<FingerprintProvider> provider(FingerprintProvider::create(algorithm));
+      std::vector<uint8_t> reference(data_.size() / chunkSize * provider->getLength());
+      double single = measure(*provider, chunkSize, 1, reference.data(), false);
+      double batched = measure(*provider, chunkSize, FINGERPRINT_BATCH_SIZE, reference.data(),
+                               algorithm != tSHA1Fingerprint);
+      printf("    %-8s digest %8.1f MB/s | batch of %u %8.1f MB/s\n", provider->getName(), single,
+             FINGERPRINT_BATCH_SIZE, batched);
+    }
+    printf("    BLAKE3 kernels (%s selected at startup):", Blake3::getKernelName());
+    std::vector<uint8_t> reference(data_.size() / chunkSize * Blake3::kOutLen);
+    printf(" portable %8.1f MB/s", measureBlake3(Blake3::hashManyPortable, chunkSize, reference.data(), false));
+    if (__builtin_cpu_supports("avx2")) {
+      printf(" | AVX2 %8.1f MB/s", measureBlake3(Blake3::hashManyAVX2, chunkSize, reference.data(), true));
+    }
+    printf("\n");
+  }
+
+ private:
+  static double throughput(uint64_t nBytes, std::chrono::steady_clock::time_point begin) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return nBytes / seconds / 1024 / 1024;
+  }
+
+  static void checkOrRecord(uint8_t *expected, const uint8_t *digest, uint32_t len, bool check, uint32_t chunk) {
+    if (!check) {
+      memcpy(expected, digest, len);
+    } else if (memcmp(expected, digest, len) != 0) {
+      fprintf(stderr, "digest mismatch: chunk %u\n", chunk);
+      exit(1);
+    }
+  }
+
+  // Fingerprint every chunk of the buffer in batches of batchSize; record (or check) the digests.
+  // sha1_mb and mh_sha1 digests differ: SHA1 batches are not checked.
+  double measure(FingerprintProvider &provider, uint32_t chunkSize, uint32_t batchSize, uint8_t *digests,
+                 bool check) {
+    uint32_t nChunks = data_.size() / chunkSize, len = provider.getLength();
+    const uint8_t *data[FINGERPRINT_BATCH_SIZE];
+    uint32_t lens[FINGERPRINT_BATCH_SIZE];
+    uint8_t out[FINGERPRINT_BATCH_SIZE][MAX_FINGERPRINT_LENGTH];
+    uint8_t *fingerprints[FINGERPRINT_BATCH_SIZE];
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < nChunks; i += batchSize) {
+      uint32_t n = nChunks - i < batchSize ? nChunks - i : batchSize;
+      for (uint32_t j = 0; j < n; ++j) {
+        data[j] = data_.data() + 1ull * (i + j) * chunkSize;
+        lens[j] = chunkSize;
+        fingerprints[j] = out[j];
+      }
+      if (batchSize == 1) {
+        provider.digest(data[0], lens[0], fingerprints[0]);
+      } else {
+        provider.digestBatch(data, lens, n, fingerprints);
+      }
+      for (uint32_t j = 0; j < n; ++j) checkOrRecord(digests + (i + j) * len, out[j], len, check, i + j);
+    }
+    return throughput(1ull * nChunks * chunkSize, begin);
+  }
+
+  double measureBlake3(Blake3::HashManyFunc hashMany, uint32_t chunkSize, uint8_t *digests, bool check) {
+    uint32_t nChunks = data_.size() / chunkSize;
+    uint8_t out[Blake3::kOutLen];
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < nChunks; ++i) {
+      Blake3::hash(data_.data() + 1ull * i * chunkSize, chunkSize, out, hashMany);
+      checkOrRecord(digests + i * Blake3::kOutLen, out, Blake3::kOutLen, check, i);
+    }
+    return throughput(1ull * nChunks * chunkSize, begin);
+  }
+
+  std::vector<uint8_t> data_;
+};
+}  // namespace cache
+
+int main(int argc, char **argv) {
+  uint64_t bufferSize = (argc > 1 ? atoll(argv[1]) : 256) * 1024 * 1024;
+  cache::FingerprintProviderBenchmark benchmark(bufferSize);
+  for (uint32_t chunkSize : {8192u, 16384u, 32768u}) benchmark.run(chunkSize);
+  return 0;
+}
@@ -0,0 +1,132 @@
+// Micro benchmark of heap allocations on the metadata hot path.
+// Replaces the global operator new with a counting one and drives
+// MetadataModule::dedup/lookup/update directly (write path: dedup + update;
+// read path: lookup, then dedup + update on a miss) on synthetic chunks, after
+// a warm-up pass that fills the index. Reports heap allocations per chunk,
+// which is expected to be 0.
+//
+// usage: metadata_alloc <cacheDevice> [nChunks] [cacheDeviceSize(MiB)] [compactCachePolicy(0/1)]
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+#include "common/config.h"
+#include "io/io_module.h"
+#include "metadata/metadata_module.h"
+
+namespace {
+std::atomic<bool> gCountAllocations(false);
+std::atomic<uint64_t> gNumAllocations(0);
+}  // namespace
+
+void *operator new(size_t size) {
+  if (gCountAllocations.load(std::memory_order_relaxed)) gNumAllocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace cache {
+class MetadataAllocBenchmark {
+ public:
+  explicit MetadataAllocBenchmark(uint32_t nChunks) : nChunks_(nChunks), rng_(17) {
+    // Working set of 4x the cache, content drawn from a pool with ~50% duplicates
+    nAddresses_ = Config::getInstance().getWorkingSetSize() / Config::getInstance().getChunkSize();
+    nContents_ = nAddresses_ / 2;
+  }
+
+  void write(Chunk &chunk) {
+    MetadataModule::getInstance().dedup(chunk);
+    MetadataModule::getInstance().update(chunk);
+    chunk.fpBucketLock_.reset();
+    chunk.lbaBucketLock_.reset();
+  }
+
+  void read(Chunk &chunk) {
+    MetadataModule::getInstance().lookup(chunk);
+    if (chunk.lookupResult_ == NOT_HIT) {
+      // a read miss fetches the data and computes its fingerprint before dedup
+      chunk.fingerprintHash_ = Chunk::computeFingerprintHash(chunk.fingerprint_);
+      chunk.hasFingerprint_ = true;
+      MetadataModule::getInstance().dedup(chunk);
+    }
+    MetadataModule::getInstance().update(chunk);
+    chunk.fpBucketLock_.reset();
+    chunk.lbaBucketLock_.reset();
+  }
+
+  void next(Chunk &chunk, bool isRead) {
+    uint64_t content = rng_() % nContents_;
+    memset(&chunk.metadata_, 0, sizeof(chunk.metadata_));
+    chunk.addr_ = rng_() % nAddresses_ * Config::getInstance().getChunkSize();
+    chunk.len_ = Config::getInstance().getChunkSize();
+    chunk.lbaHash_ = Chunk::computeLBAHash(chunk.addr_);
+    memset(chunk.fingerprint_, 0, sizeof(chunk.fingerprint_));
+    memcpy(chunk.fingerprint_, &content, sizeof(content));
+    chunk.fingerprintHash_ = isRead ? 0 : Chunk::computeFingerprintHash(chunk.fingerprint_);
+    chunk.hasFingerprint_ = !isRead;
+    chunk.nSubchunks_ = 1 + content % (Config::getInstance().getChunkSize() / Config::getInstance().getSubchunkSize());
+    chunk.compressedLen_ = chunk.nSubchunks_ * Config::getInstance().getSubchunkSize();
+    chunk.hitLBAIndex_ = chunk.hitFPIndex_ = false;
+    chunk.dedupResult_ = DEDUP_UNKNOWN;
+    chunk.lookupResult_ = LOOKUP_UNKNOWN;
+    chunk.verficationResult_ = VERIFICATION_UNKNOWN;
+  }
+
+  // Returns the number of heap allocations
+  uint64_t run(bool isRead, bool count) {
+    alignas(512) Chunk chunk;
+    gNumAllocations = 0;
+    gCountAllocations = count;
+    for (uint32_t i = 0; i < nChunks_; ++i) {
+      next(chunk, isRead);
+      if (isRead) {
+        read(chunk);
+      } else {
+        write(chunk);
+      }
+    }
+    gCountAllocations = false;
+    return gNumAllocations;
+  }
+
+ private:
+  uint32_t nChunks_;
+  uint64_t nAddresses_, nContents_;
+  std::mt19937_64 rng_;
+};
+}  // namespace cache
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <cacheDevice> [nChunks] [cacheDeviceSize(MiB)] [compactCachePolicy(0/1)]\n", argv[0]);
+    return 1;
+  }
+  uint32_t nChunks = argc > 2 ? atoi(argv[2]) : 1000000;
+  uint64_t cacheDeviceSize = (argc > 3 ? atoll(argv[3]) : 256) * 1024 * 1024;
+  cache::Config::getInstance().setCacheDeviceName(argv[1]);
+  cache::Config::getInstance().setCacheDeviceSize(cacheDeviceSize);
+  cache::Config::getInstance().setWorkingSetSize(cacheDeviceSize * 4);
+  if (argc > 4) cache::Config::getInstance().enableCompactCachePolicy(atoi(argv[4]));
+  cache::IOModule::getInstance().addCacheDevice(argv[1]);
+  cache::MetadataModule::getInstance();
+
+  cache::MetadataAllocBenchmark benchmark(nChunks);
+  // warm-up: fill the index so that every later operation runs against full buckets
+  benchmark.run(false, false);
+  uint64_t nWriteAllocations = benchmark.run(false, true);
+  uint64_t nReadAllocations = benchmark.run(true, true);
+  printf("write path: %" PRIu64 " heap allocations in %u chunks (%.4f per chunk)\n", nWriteAllocations, nChunks,
+         (double)nWriteAllocations / nChunks);
+  printf("read path:  %" PRIu64 " heap allocations in %u chunks (%.4f per chunk)\n", nReadAllocations, nChunks,
+         (double)nReadAllocations / nChunks);
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Micro benchmark of the reference counters.
+// Replays the LBA -> fingerprint mappings of an FIU trace ("<lba> <len> <R/W> <sha1>
+// <compressibility>" per line): a write of new content to an LBA references the new
+// fingerprint hash and dereferences the one it replaces, as LBA index updates do.
+// Both the row layout (SketchReferenceCounter) and the blocked layout
+// (BlockedSketchReferenceCounter) are fed the same stream and compared against exact
+// counts: over-estimation at every write, then per-query and per-update cost. The exact
+// counter (MapReferenceCounter) gives the cost of exact counting.
+//
+// usage: reference_sketch <trace> [cacheDeviceSize(MiB)] [workingSetSize(MiB)]
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.h"
+#include "common/config.h"
+#include "metadata/reference_counter.h"
+
+namespace cache {
+class ReferenceSketchBenchmark {
+ public:
+  explicit ReferenceSketchBenchmark(const char *fileName) {
+    FILE *f = fopen(fileName, "r");
+    if (f == nullptr) return;
+    uint64_t lba;
+    int len;
+    char op[2], sha1[64];
+    double compressibility;
+    while (fscanf(f, "%" SCNu64 " %d %1s %63s %lf", &lba, &len, op, sha1, &compressibility) == 5) {
+      if (op[0] != 'w' && op[0] != 'W') continue;
+      uint8_t fingerprint[20] = {0};
+      for (int i = 0; i < 40 && sha1[i] && sha1[i + 1]; i += 2) {
+        fingerprint[i / 2] = (hex(sha1[i]) << 4) | hex(sha1[i + 1]);
+      }
+      writes_.emplace_back(lba, Chunk::computeFingerprintHash(fingerprint));
+    }
+    fclose(f);
+  }
+
+  size_t size() { return writes_.size(); }
+
+  template <typename Counter>
+  void run(const char *name, Counter &counter) {
+    std::unordered_map<uint64_t, uint64_t> lba2Fp;
+    std::unordered_map<uint64_t, uint32_t> exact;
+    uint64_t nQueries = 0, nExact = 0, nUnder = 0, overEstimation = 0, maxOverEstimation = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (auto &w : writes_) {
+      auto it = lba2Fp.find(w.first);
+      if (it != lba2Fp.end() && it->second == w.second) continue;
+      if (it != lba2Fp.end()) {
+        counter.dereference(it->second);
+        if (--exact[it->second] == 0) exact.erase(it->second);
+      }
+      lba2Fp[w.first] = w.second;
+      counter.reference(w.second);
+      uint32_t truth = ++exact[w.second], estimate = counter.query(w.second);
+      ++nQueries;
+      nExact += estimate == truth;
+      nUnder += estimate < truth;
+      uint64_t error = estimate > truth ? estimate - truth : 0;
+      overEstimation += error;
+      maxOverEstimation = error > maxOverEstimation ? error : maxOverEstimation;
+    }
+    double updateNs =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / nQueries;
+
+    // Query cost on the populated sketch, over the keys of the trace
+    uint64_t checksum = 0;
+    const uint32_t nPasses = 10;
+    begin = std::chrono::steady_clock::now();
+    for (uint32_t pass = 0; pass < nPasses; ++pass) {
+      for (auto &w : writes_) checksum += counter.query(w.second);
+    }
+    double queryNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() /
+                     (nPasses * writes_.size());
+
+    printf("%-8s %7.1f ns/query %7.1f ns/write (incl. model) | exact %6.2f%%, under %.2f%%, mean over-estimate %.4f, "
+           "max %" PRIu64 " (checksum %" PRIu64 ")\n",
+           name, queryNs, updateNs, 100.0 * nExact / nQueries, 100.0 * nUnder / nQueries,
+           (double)overEstimation / nQueries, maxOverEstimation, checksum);
+  }
+
+ private:
+  static uint8_t hex(char c) {
+    if (c <= '9') return c - '0';
+    if (c <= 'F') return c - 'A' + 10;
+    return c - 'a' + 10;
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> writes_;
+};
+}  // namespace cache
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <trace> [cacheDeviceSize(MiB)] [workingSetSize(MiB)]\n", argv[0]);
+    return 1;
+  }
+  uint64_t cacheDeviceSize = (argc > 2 ? atoll(argv[2]) : 4096) * 1024 * 1024;
+  uint64_t workingSetSize = (argc > 3 ? atoll(argv[3]) : 20480) * 1024 * 1024;
+  cache::Config::getInstance().setCacheDeviceSize(cacheDeviceSize);
+  cache::Config::getInstance().setWorkingSetSize(workingSetSize);
+
+  cache::ReferenceSketchBenchmark benchmark(argv[1]);
+  if (benchmark.size() == 0) {
+    fprintf(stderr, "no writes read from %s\n", argv[1]);
+    return 1;
+  }
+  printf("%zu writes, sketch width %u x 4 counters\n", benchmark.size(),
+         cache::Config::getInstance().getnLbaBuckets() * cache::Config::getInstance().getnLBASlotsPerBucket());
+  benchmark.run("rows", cache::SketchReferenceCounter::getInstance());
+  benchmark.run("blocked", cache::BlockedSketchReferenceCounter::getInstance());
+  benchmark.run("map", cache::MapReferenceCounter::getInstance());
+  return 0;
+}
@@ -20,6 +20,7 @@
 #include "meta/meta_dedup.h"
 #include "utils/cJSON.h"
 #include "utils/gen_zipf.h"
+#include "utils/perf_counter.h"
 #include "utils/utils.h"
 struct Request {
   Request() {
@@ -46,10 +47,13 @@ class RunSystem {
   ~RunSystem() {}
 
   void parse_argument(int argc, char **argv) {
-    char source[2000 + 1];
+    std::vector<char> source(1, '\0');
     FILE *fp = fopen(argv[1], "r");
     if (fp != NULL) {
-      size_t newLen = fread(source, sizeof(char), 1001, fp);
+      fseek(fp, 0, SEEK_END);
+      source.resize(ftell(fp) + 1);
+      fseek(fp, 0, SEEK_SET);
+      size_t newLen = fread(source.data(), sizeof(char), source.size() - 1, fp);
       if (ferror(fp) != 0) {
         fputs("Error reading file", stderr);
       } else {
@@ -60,7 +64,7 @@ class RunSystem {
       perror("open json file failed");
     }
 
-    cJSON *config = cJSON_Parse(source);
+    cJSON *config = cJSON_Parse(source.data());
     for (cJSON *param = config->child->next->child; param != nullptr; param = param->next) {
       char *name = param->string;
       char *valuestring = param->valuestring;
@@ -97,8 +101,18 @@ class RunSystem {
         Config::getInstance().enableCompactCachePolicy(valuell);
       } else if (strcmp(name, "sketchBasedReferenceCounter") == 0) {
         Config::getInstance().enableSketchRF(valuell);
+      } else if (strcmp(name, "sketchLayout") == 0) {
+        if (strcmp(valuestring, "Rows") == 0) {
+          Config::getInstance().setSketchLayout(SketchLayoutEnum::tRowSketch);
+        } else if (strcmp(valuestring, "Blocked") == 0) {
+          Config::getInstance().setSketchLayout(SketchLayoutEnum::tBlockedSketch);
+        }
+      } else if (strcmp(name, "inlineReferenceCount") == 0) {
+        Config::getInstance().enableInlineReferenceCount(valuell);
       } else if (strcmp(name, "multiThreading") == 0) {
         Config::getInstance().enableMultiThreading(valuell);
+      } else if (strcmp(name, "optimisticLookup") == 0) {
+        Config::getInstance().enableOptimisticLookup(valuell);
       } else if (strcmp(name, "nThreads") == 0) {
         Config::getInstance().setnThreads(valuell);
       } else if (strcmp(name, "cacheMode") == 0) {
@@ -107,6 +121,20 @@ class RunSystem {
         } else if (strcmp(valuestring, "WriteBack") == 0) {
           Config::getInstance().setCacheMode(CacheModeEnum::tWriteBack);
         }
+      } else if (strcmp(name, "indexLayout") == 0) {
+        if (strcmp(valuestring, "Compact") == 0) {
+          Config::getInstance().setIndexLayout(IndexLayoutEnum::tCompactLayout);
+        } else if (strcmp(valuestring, "Aligned") == 0) {
+          Config::getInstance().setIndexLayout(IndexLayoutEnum::tAlignedLayout);
+        }
+      } else if (strcmp(name, "lbaCachePolicy") == 0) {
+        if (strcmp(valuestring, "BucketAwareLRU") == 0) {
+          Config::getInstance().setLBACachePolicy(LBACachePolicyEnum::tBucketAwareLRU);
+        } else if (strcmp(valuestring, "BucketAwareCLOCK") == 0) {
+          Config::getInstance().setLBACachePolicy(LBACachePolicyEnum::tBucketAwareCLOCK);
+        }
+      } else if (strcmp(name, "cacheLineAlignedBuckets") == 0) {
+        Config::getInstance().enableCacheLineAlignedBuckets(valuell);
       } else if (strcmp(name, "directIO") == 0) {
         Config::getInstance().enableDirectIO(valuell);
       } else if (strcmp(name, "traceReplay") == 0) {
@@ -117,6 +145,42 @@ class RunSystem {
         Config::getInstance().enableSC(valuell);
       } else if (strcmp(name, "SelectiveDeduplication") == 0) {
         Config::getInstance().enableSD(valuell);
+      } else if (strcmp(name, "selectiveDedupTargetOccupancy") == 0) {
+        Config::getInstance().setSelectiveDedupTargetOccupancy(param->valuedouble);
+      } else if (strcmp(name, "subchunkDedup") == 0) {
+        Config::getInstance().enableSubchunkDedup(valuell);
+      } else if (strcmp(name, "mergeBufferSize") == 0) {
+        Config::getInstance().setMergeBufferSize(valuell);
+      } else if (strcmp(name, "chunking") == 0) {
+        if (strcmp(valuestring, "Fixed") == 0) {
+          Config::getInstance().setChunking(ChunkingEnum::tFixedChunking);
+        } else if (strcmp(valuestring, "ContentDefined") == 0) {
+          Config::getInstance().setChunking(ChunkingEnum::tContentDefinedChunking);
+        }
+      } else if (strcmp(name, "cdcMinSize") == 0) {
+        Config::getInstance().setCDCMinSize(valuell);
+      } else if (strcmp(name, "cdcAvgSize") == 0) {
+        Config::getInstance().setCDCAvgSize(valuell);
+      } else if (strcmp(name, "fingerprint") == 0) {
+        if (strcmp(valuestring, "SHA1") == 0) {
+          Config::getInstance().setFingerprintAlgorithm(FingerprintAlgorithmEnum::tSHA1Fingerprint);
+        } else if (strcmp(valuestring, "SHA256") == 0) {
+          Config::getInstance().setFingerprintAlgorithm(FingerprintAlgorithmEnum::tSHA256Fingerprint);
+        } else if (strcmp(valuestring, "BLAKE3") == 0) {
+          Config::getInstance().setFingerprintAlgorithm(FingerprintAlgorithmEnum::tBLAKE3Fingerprint);
+        } else if (strcmp(valuestring, "XXH3-128") == 0) {
+          Config::getInstance().setFingerprintAlgorithm(FingerprintAlgorithmEnum::tXXH3Fingerprint);
+        }
+      } else if (strcmp(name, "fingerprintBatching") == 0) {
+        Config::getInstance().enableFingerprintBatching(valuell);
+      } else if (strcmp(name, "loadAdaptiveBypass") == 0) {
+        Config::getInstance().enableLoadAdaptiveBypass(valuell);
+      } else if (strcmp(name, "bypassQueueDepth") == 0) {
+        Config::getInstance().setBypassQueueDepth(valuell);
+      } else if (strcmp(name, "bypassCompressibility") == 0) {
+        Config::getInstance().setBypassCompressibility(param->valuedouble);
+      } else if (strcmp(name, "patternChunkFastPath") == 0) {
+        Config::getInstance().enablePatternChunkFastPath(valuell);
       }
     }
 
@@ -193,8 +257,6 @@ class RunSystem {
     std::string s = std::string(req.sha1_);
     convertStr2Sha1(req.sha1_, sha1);
 
-    Config::getInstance().setFingerprint(req.address_, sha1);
-
     if (Config::getInstance().isSynthenticCompressionEnabled()) {
       if (Config::getInstance().isFakeIOEnabled() || !req.isRead_) {
         memcpy(rwdata, originalChunks_[req.compressionLength_], len);
@@ -209,9 +271,9 @@ class RunSystem {
     //  -->
     // [LBA] [R/W bytes] [R/W] [原始数据/压缩后数据] [Compressity]
     if (req.isRead_) {
-      Meta_->read(lba, rwdata, len);
+      Meta_->read(lba, rwdata, len, (uint8_t *)sha1);
     } else {
-      Meta_->write(lba, rwdata, len, req.compressibility_);
+      Meta_->write(lba, rwdata, len, req.compressibility_, (uint8_t *)sha1);
     }
   }
 
@@ -345,13 +407,24 @@ int main(int argc, char **argv) {
   std::atomic<uint64_t> total_bytes(0);
   long long elapsed = 0;
 
+  // LLC misses of the whole replay (all worker threads)
+  cache::PerfCounter llcMisses;
+  llcMisses.start();
   // sendRequest() in work(), will be called by multiple threads
   PERF_FUNCTION(elapsed, run_system.work, total_bytes);
+  llcMisses.stop();
 
   std::cout << "Replay finished, statistics: \n";
   std::cout << "total MBs: " << (double)total_bytes / (1024 * 1024) << std::endl;
   std::cout << "elapsed: " << elapsed << " us" << std::endl;
   std::cout << "Throughput: " << (double)total_bytes / elapsed << " MBytes/s" << std::endl;
+  if (llcMisses.isAvailable()) {
+    uint64_t nRequests = total_bytes / cache::Config::getInstance().getChunkSize();
+    std::cout << "LLC misses: " << llcMisses.read() << ", per request: "
+              << (double)llcMisses.read() / std::max(nRequests, (uint64_t)1) << std::endl;
+  } else {
+    std::cout << "LLC misses: unavailable (perf_event_open: " << strerror(llcMisses.getError()) << ")" << std::endl;
+  }
 
   run_system.clear();
   return 0;
@@ -0,0 +1,257 @@
+#include "blake3.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace cache {
+namespace {
+enum Blake3Flags : uint8_t { CHUNK_START = 1, CHUNK_END = 2, PARENT = 4, ROOT = 8 };
+
+const uint32_t kIV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                         0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+constexpr uint8_t kPermutation[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+// Message word order of each of the 7 rounds: the words of a round are the ones of the previous
+// round permuted
+struct MessageSchedule {
+  uint8_t v[7][16];
+  constexpr MessageSchedule() : v() {
+    for (uint32_t i = 0; i < 16; ++i) v[0][i] = i;
+    for (uint32_t r = 1; r < 7; ++r) {
+      for (uint32_t i = 0; i < 16; ++i) v[r][i] = v[r - 1][kPermutation[i]];
+    }
+  }
+};
+constexpr MessageSchedule kSchedule;
+
+// Chunks hashed level by level at most; a longer input is split into subtrees first
+const uint32_t kMaxLevelChunks = 64;
+
+inline uint32_t rotr(uint32_t w, uint32_t c) { return (w >> c) | (w << (32 - c)); }
+
+inline void g(uint32_t *s, uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t mx, uint32_t my) {
+  s[a] = s[a] + s[b] + mx;
+  s[d] = rotr(s[d] ^ s[a], 16);
+  s[c] = s[c] + s[d];
+  s[b] = rotr(s[b] ^ s[c], 12);
+  s[a] = s[a] + s[b] + my;
+  s[d] = rotr(s[d] ^ s[a], 8);
+  s[c] = s[c] + s[d];
+  s[b] = rotr(s[b] ^ s[c], 7);
+}
+
+// One block into the chaining value cv (in place)
+void compress(uint32_t *cv, const uint8_t *block, uint32_t blockLen, uint64_t counter, uint8_t flags) {
+  uint32_t m[16], s[16];
+  memcpy(m, block, sizeof(m));
+  memcpy(s, cv, 8 * sizeof(uint32_t));
+  memcpy(s + 8, kIV, 4 * sizeof(uint32_t));
+  s[12] = (uint32_t)counter, s[13] = (uint32_t)(counter >> 32), s[14] = blockLen, s[15] = flags;
+  for (uint32_t r = 0; r < 7; ++r) {
+    const uint8_t *w = kSchedule.v[r];
+    g(s, 0, 4, 8, 12, m[w[0]], m[w[1]]);
+    g(s, 1, 5, 9, 13, m[w[2]], m[w[3]]);
+    g(s, 2, 6, 10, 14, m[w[4]], m[w[5]]);
+    g(s, 3, 7, 11, 15, m[w[6]], m[w[7]]);
+    g(s, 0, 5, 10, 15, m[w[8]], m[w[9]]);
+    g(s, 1, 6, 11, 12, m[w[10]], m[w[11]]);
+    g(s, 2, 7, 8, 13, m[w[12]], m[w[13]]);
+    g(s, 3, 4, 9, 14, m[w[14]], m[w[15]]);
+  }
+  for (uint32_t i = 0; i < 8; ++i) cv[i] = s[i] ^ s[i + 8];
+}
+
+// Chaining value of one (possibly partial, possibly empty) chunk; rootFlag on its last block
+void hashChunk(const uint8_t *data, uint64_t len, uint64_t counter, uint8_t rootFlag, uint8_t *out) {
+  uint32_t cv[8];
+  memcpy(cv, kIV, sizeof(cv));
+  uint32_t nBlocks = len == 0 ? 1 : (len + Blake3::kBlockLen - 1) / Blake3::kBlockLen;
+  for (uint32_t b = 0; b < nBlocks; ++b) {
+    uint8_t block[Blake3::kBlockLen] = {0};
+    uint32_t blockLen = std::min<uint64_t>(Blake3::kBlockLen, len - b * Blake3::kBlockLen);
+    memcpy(block, data + b * Blake3::kBlockLen, blockLen);
+    uint8_t flags = (b == 0 ? CHUNK_START : 0) | (b == nBlocks - 1 ? CHUNK_END | rootFlag : 0);
+    compress(cv, block, blockLen, counter, flags);
+  }
+  memcpy(out, cv, Blake3::kOutLen);
+}
+
+// Chaining value (the hash if root) of the subtree of data[0, len), whose first chunk is number counter
+void hashSubtree(const uint8_t *data, uint64_t len, uint64_t counter, bool root, Blake3::HashManyFunc hashMany,
+                 uint8_t *out) {
+  uint64_t nChunks = len <= Blake3::kChunkLen ? 1 : (len + Blake3::kChunkLen - 1) / Blake3::kChunkLen;
+  if (nChunks == 1) {
+    hashChunk(data, len, counter, root ? ROOT : 0, out);
+    return;
+  }
+  const uint8_t *inputs[kMaxLevelChunks];
+  if (nChunks > kMaxLevelChunks) {
+    // The left subtree holds the largest power of two of chunks below nChunks
+    uint64_t leftLen = (1ull << (63 - __builtin_clzll(nChunks - 1))) * Blake3::kChunkLen;
+    uint8_t cvs[2 * Blake3::kOutLen];
+    hashSubtree(data, leftLen, counter, false, hashMany, cvs);
+    hashSubtree(data + leftLen, len - leftLen, counter + leftLen / Blake3::kChunkLen, false, hashMany,
+                cvs + Blake3::kOutLen);
+    inputs[0] = cvs;
+    hashMany(inputs, 1, 1, 0, false, PARENT | (root ? ROOT : 0), 0, 0, out);
+    return;
+  }
+
+  alignas(32) uint8_t cvs[kMaxLevelChunks * Blake3::kOutLen], parents[kMaxLevelChunks / 2 * Blake3::kOutLen];
+  uint32_t nFull = len / Blake3::kChunkLen;
+  for (uint32_t i = 0; i < nFull; ++i) inputs[i] = data + i * Blake3::kChunkLen;
+  hashMany(inputs, nFull, Blake3::kChunkLen / Blake3::kBlockLen, counter, true, 0, CHUNK_START, CHUNK_END, cvs);
+  if (nFull < nChunks) {
+    hashChunk(data + nFull * Blake3::kChunkLen, len - nFull * Blake3::kChunkLen, counter + nFull, 0,
+              cvs + nFull * Blake3::kOutLen);
+  }
+  // Pairs of adjacent chaining values are the blocks of the parents of the next level
+  for (uint32_t n = nChunks; n > 1;) {
+    uint32_t nParents = n / 2;
+    for (uint32_t i = 0; i < nParents; ++i) inputs[i] = cvs + 2 * i * Blake3::kOutLen;
+    hashMany(inputs, nParents, 1, 0, false, PARENT | (n == 2 && root ? ROOT : 0), 0, 0, parents);
+    if (n % 2 == 1) memcpy(parents + nParents * Blake3::kOutLen, cvs + (n - 1) * Blake3::kOutLen, Blake3::kOutLen);
+    n = nParents + n % 2;
+    memcpy(cvs, parents, n * Blake3::kOutLen);
+  }
+  memcpy(out, cvs, Blake3::kOutLen);
+}
+
+__attribute__((target("avx2"))) inline __m256i rotr16(__m256i x) {
+  return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1,
+                                                 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13));
+}
+
+__attribute__((target("avx2"))) inline __m256i rotr8(__m256i x) {
+  return _mm256_shuffle_epi8(x, _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12, 1, 2, 3, 0,
+                                                 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12));
+}
+
+__attribute__((target("avx2"))) inline void g8(__m256i *s, uint32_t a, uint32_t b, uint32_t c, uint32_t d, __m256i mx,
+                                               __m256i my) {
+  s[a] = _mm256_add_epi32(_mm256_add_epi32(s[a], s[b]), mx);
+  s[d] = rotr16(_mm256_xor_si256(s[d], s[a]));
+  s[c] = _mm256_add_epi32(s[c], s[d]);
+  s[b] = _mm256_xor_si256(s[b], s[c]);
+  s[b] = _mm256_or_si256(_mm256_srli_epi32(s[b], 12), _mm256_slli_epi32(s[b], 20));
+  s[a] = _mm256_add_epi32(_mm256_add_epi32(s[a], s[b]), my);
+  s[d] = rotr8(_mm256_xor_si256(s[d], s[a]));
+  s[c] = _mm256_add_epi32(s[c], s[d]);
+  s[b] = _mm256_xor_si256(s[b], s[c]);
+  s[b] = _mm256_or_si256(_mm256_srli_epi32(s[b], 7), _mm256_slli_epi32(s[b], 25));
+}
+
+// 8x8 transpose of 32-bit words: v[i] word j <-> v[j] word i
+__attribute__((target("avx2"))) inline void transpose8(__m256i *v) {
+  __m256i t[8], u[8];
+  for (uint32_t i = 0; i < 8; i += 2) {
+    t[i] = _mm256_unpacklo_epi32(v[i], v[i + 1]);
+    t[i + 1] = _mm256_unpackhi_epi32(v[i], v[i + 1]);
+  }
+  for (uint32_t i = 0; i < 8; i += 4) {
+    u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+    u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+    u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+    u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+  }
+  for (uint32_t i = 0; i < 4; ++i) {
+    v[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+    v[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+  }
+}
+
+// 8 inputs, one per lane
+__attribute__((target("avx2"))) void hash8AVX2(const uint8_t *const *inputs, uint32_t nBlocks, uint64_t counter,
+                                               bool incrementCounter, uint8_t flags, uint8_t flagsStart,
+                                               uint8_t flagsEnd, uint8_t *out) {
+  __m256i h[8], m[16], s[16];
+  for (uint32_t i = 0; i < 8; ++i) h[i] = _mm256_set1_epi32(kIV[i]);
+  alignas(32) uint32_t counterLow[8], counterHigh[8];
+  for (uint32_t i = 0; i < 8; ++i) {
+    uint64_t c = counter + (incrementCounter ? i : 0);
+    counterLow[i] = (uint32_t)c, counterHigh[i] = (uint32_t)(c >> 32);
+  }
+  __m256i counterLowV = _mm256_load_si256((const __m256i *)counterLow);
+  __m256i counterHighV = _mm256_load_si256((const __m256i *)counterHigh);
+
+  for (uint32_t b = 0; b < nBlocks; ++b) {
+    for (uint32_t half = 0; half < 2; ++half) {
+      for (uint32_t i = 0; i < 8; ++i) {
+        m[half * 8 + i] = _mm256_loadu_si256((const __m256i *)(inputs[i] + b * Blake3::kBlockLen + half * 32));
+      }
+      transpose8(m + half * 8);
+    }
+    uint8_t blockFlags = flags | (b == 0 ? flagsStart : 0) | (b == nBlocks - 1 ? flagsEnd : 0);
+    for (uint32_t i = 0; i < 8; ++i) s[i] = h[i];
+    for (uint32_t i = 0; i < 4; ++i) s[8 + i] = _mm256_set1_epi32(kIV[i]);
+    s[12] = counterLowV, s[13] = counterHighV;
+    s[14] = _mm256_set1_epi32(Blake3::kBlockLen), s[15] = _mm256_set1_epi32(blockFlags);
+    // Unrolled: the message words of every round stay in registers
+#pragma GCC unroll 7
+    for (uint32_t r = 0; r < 7; ++r) {
+      const uint8_t *w = kSchedule.v[r];
+      g8(s, 0, 4, 8, 12, m[w[0]], m[w[1]]);
+      g8(s, 1, 5, 9, 13, m[w[2]], m[w[3]]);
+      g8(s, 2, 6, 10, 14, m[w[4]], m[w[5]]);
+      g8(s, 3, 7, 11, 15, m[w[6]], m[w[7]]);
+      g8(s, 0, 5, 10, 15, m[w[8]], m[w[9]]);
+      g8(s, 1, 6, 11, 12, m[w[10]], m[w[11]]);
+      g8(s, 2, 7, 8, 13, m[w[12]], m[w[13]]);
+      g8(s, 3, 4, 9, 14, m[w[14]], m[w[15]]);
+    }
+    for (uint32_t i = 0; i < 8; ++i) h[i] = _mm256_xor_si256(s[i], s[i + 8]);
+  }
+  transpose8(h);
+  for (uint32_t i = 0; i < 8; ++i) _mm256_storeu_si256((__m256i *)(out + i * Blake3::kOutLen), h[i]);
+}
+}  // namespace
+
+void Blake3::hashManyPortable(const uint8_t *const *inputs, uint32_t n, uint32_t nBlocks, uint64_t counter,
+                              bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd,
+                              uint8_t *out) {
+  for (uint32_t i = 0; i < n; ++i) {
+    uint32_t cv[8];
+    memcpy(cv, kIV, sizeof(cv));
+    for (uint32_t b = 0; b < nBlocks; ++b) {
+      uint8_t blockFlags = flags | (b == 0 ? flagsStart : 0) | (b == nBlocks - 1 ? flagsEnd : 0);
+      compress(cv, inputs[i] + b * kBlockLen, kBlockLen, counter + (incrementCounter ? i : 0), blockFlags);
+    }
+    memcpy(out + i * kOutLen, cv, kOutLen);
+  }
+}
+
+// Groups of 8 inputs in the lanes, the rest one by one
+__attribute__((target("avx2"))) void Blake3::hashManyAVX2(const uint8_t *const *inputs, uint32_t n,
+                                                          uint32_t nBlocks, uint64_t counter, bool incrementCounter,
+                                                          uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd,
+                                                          uint8_t *out) {
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    hash8AVX2(inputs + i, nBlocks, counter + (incrementCounter ? i : 0), incrementCounter, flags, flagsStart,
+              flagsEnd, out + i * kOutLen);
+  }
+  hashManyPortable(inputs + i, n - i, nBlocks, counter + (incrementCounter ? i : 0), incrementCounter, flags,
+                   flagsStart, flagsEnd, out + i * kOutLen);
+}
+
+Blake3::HashManyFunc Blake3::getHashManyFunc() {
+  if (__builtin_cpu_supports("avx2")) return hashManyAVX2;
+  return hashManyPortable;
+}
+
+const char *Blake3::getKernelName() {
+  if (__builtin_cpu_supports("avx2")) return "AVX2";
+  return "portable";
+}
+
+void Blake3::hash(const uint8_t *data, uint64_t len, uint8_t *out) {
+  static const HashManyFunc hashMany = getHashManyFunc();
+  hash(data, len, out, hashMany);
+}
+
+void Blake3::hash(const uint8_t *data, uint64_t len, uint8_t *out, HashManyFunc hashMany) {
+  hashSubtree(data, len, 0, true, hashMany, out);
+}
+}  // namespace cache
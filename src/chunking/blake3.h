@@ -0,0 +1,50 @@
+/* File: chunking/blake3.h
+ * Description:
+ *   This file contains the BLAKE3 hash (unkeyed, 32-byte output) used as a chunk fingerprint.
+ *
+ *   1. The input is split into 1 KiB BLAKE3 chunks, each compressed block by block (64 bytes)
+ *      into a chaining value; the chaining values are merged by parent nodes, pairwise and level
+ *      by level (an odd one is carried up), which gives the BLAKE3 tree (left subtrees always
+ *      hold a power of two of chunks), up to the root node.
+ *   2. The full chunks of the input, and the parents of a level, do not depend on each other:
+ *      the AVX2 kernel compresses 8 of them at once, one per 32-bit lane, the message words of
+ *      the 8 inputs being transposed into the lanes.
+ *   3. The kernel (AVX2 or portable) is chosen once at startup according to the running CPU.
+ *      Both kernels produce the same chaining values.
+ */
+#ifndef __BLAKE3_H__
+#define __BLAKE3_H__
+
+#include <cstdint>
+
+namespace cache {
+class Blake3 {
+ public:
+  static const uint32_t kOutLen = 32;
+  static const uint32_t kBlockLen = 64;
+  static const uint32_t kChunkLen = 1024;
+
+  // Compress the n inputs of nBlocks full blocks each into n chaining values (out + kOutLen * i).
+  // Input i has the counter counter + i (chunks) or counter (parents); the first block has
+  // flagsStart, the last one flagsEnd, on top of flags.
+  typedef void (*HashManyFunc)(const uint8_t *const *inputs, uint32_t n, uint32_t nBlocks, uint64_t counter,
+                               bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd,
+                               uint8_t *out);
+
+  // BLAKE3 of data[0, len) into out[0, kOutLen)
+  static void hash(const uint8_t *data, uint64_t len, uint8_t *out);
+  static void hash(const uint8_t *data, uint64_t len, uint8_t *out, HashManyFunc hashMany);
+
+  // All kernels are exposed so that the micro benchmark can compare them.
+  static void hashManyPortable(const uint8_t *const *inputs, uint32_t n, uint32_t nBlocks, uint64_t counter,
+                               bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd,
+                               uint8_t *out);
+  static void hashManyAVX2(const uint8_t *const *inputs, uint32_t n, uint32_t nBlocks, uint64_t counter,
+                           bool incrementCounter, uint8_t flags, uint8_t flagsStart, uint8_t flagsEnd, uint8_t *out);
+  // The kernel for the running CPU
+  static HashManyFunc getHashManyFunc();
+  static const char *getKernelName();
+};
+}  // namespace cache
+
+#endif  //__BLAKE3_H__
@@ -1,34 +1,63 @@
 #include "chunk_module.h"
 
-#include <isa-l_crypto.h>
-
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 
+#include "chunking/content_defined_chunking.h"
+#include "chunking/fingerprint_provider.h"
 #include "common/config.h"
+#include "common/hash_geometry.h"
 #include "common/stats.h"
 #include "utils/utils.h"
-#include "utils/xxhash.h"
+#include "utils/xxh3.h"
 
 namespace cache {
+namespace {
+// Load-adaptive bypass: a fast hash only names the chunk in the indexes. It is stored in native
+// byte order, unlike the canonical (big-endian) digest of XXH3Provider, so it never matches a
+// fingerprint, whatever the algorithm. In trace replay too the chunk keeps this name, so that it
+// is not deduplicated against the chunks named by the trace.
+void computeWeakFingerprint(const Chunk &chunk, uint8_t *fingerprint) {
+  XXH128_hash_t hash = XXH3_128bits(chunk.buf_, chunk.len_);
+  memset(fingerprint, 0, sizeof(chunk.fingerprint_));
+  memcpy(fingerprint, &hash, sizeof(hash));
+}
+
+// Trace replay: the trace SHA-1 stands for the fingerprint, cut or zero-padded to its length
+void copyTraceFingerprint(const uint8_t *traceFingerprint, uint8_t *fingerprint) {
+  uint32_t len = Config::getInstance().getFingerprintLength();
+  memset(fingerprint, 0, len);
+  memcpy(fingerprint, traceFingerprint, std::min(len, TRACE_FINGERPRINT_LENGTH));
+}
+}  // namespace
 
 void Chunk::computeFingerprint() {
+  // sha1_mb and mh_sha1 digests differ: a run uses one of them for every chunk
+  if (Config::getInstance().isFingerprintBatchingEnabled()) {
+    computeFingerprints(this, 1);
+    return;
+  }
   BEGIN_TIMER();
-  assert(len_ == Config::getInstance().getChunkSize());
-  assert(addr_ % Config::getInstance().getChunkSize() == 0);
+  bool contentDefined = Config::getInstance().isContentDefinedChunkingEnabled();
+  assert(len_ == Config::getInstance().getChunkSize() || contentDefined);
+  assert(addr_ % Config::getInstance().getChunkSize() == 0 || contentDefined);
 
-  struct mh_sha1_ctx ctx;
-  if (Config::getInstance().isTraceReplayEnabled()) {
+  FingerprintProvider &provider = FingerprintProvider::getInstance();
+  if (bypassDedup_) {
+    computeWeakFingerprint(*this, fingerprint_);
+  } else if (Config::getInstance().isTraceReplayEnabled() && !contentDefined) {
     if (!Config::getInstance().isFakeIOEnabled()) {
-      mh_sha1_init(&ctx);
-      mh_sha1_update(&ctx, buf_, len_);
-      mh_sha1_finalize(&ctx, fingerprint_);
+      provider.digest(buf_, len_, fingerprint_);
+      Stats::getInstance().add_fingerprinted_bytes(len_);
+    }
+    if (traceFingerprint_ != nullptr) {
+      copyTraceFingerprint(traceFingerprint_, fingerprint_);
     }
-    Config::getInstance().getFingerprint(addr_, (char *)fingerprint_);
   } else {
-    mh_sha1_init(&ctx);
-    mh_sha1_update(&ctx, buf_, len_);
-    mh_sha1_finalize(&ctx, fingerprint_);
+    provider.digest(buf_, len_, fingerprint_);
+    Stats::getInstance().add_fingerprinted_bytes(len_);
   }
   hasFingerprint_ = true;
 
@@ -36,38 +65,98 @@ void Chunk::computeFingerprint() {
   END_TIMER(fingerprinting);
 }
 
+// The chunks to hash go to the provider at once (FingerprintProvider::digestBatch)
+void Chunk::computeFingerprints(Chunk *chunks, uint32_t n) {
+  BEGIN_TIMER();
+  assert(n <= FINGERPRINT_BATCH_SIZE);
+  bool contentDefined = Config::getInstance().isContentDefinedChunkingEnabled();
+  // Trace fingerprints name fixed-size chunks: content-defined chunks always hash their data
+  bool traceReplay = Config::getInstance().isTraceReplayEnabled() && !contentDefined;
+  bool hashData = !traceReplay || !Config::getInstance().isFakeIOEnabled();
+  const uint8_t *data[FINGERPRINT_BATCH_SIZE];
+  uint32_t lens[FINGERPRINT_BATCH_SIZE];
+  uint8_t *fingerprints[FINGERPRINT_BATCH_SIZE];
+  uint32_t nHashed = 0;
+  uint64_t nBytes = 0;
+
+  for (uint32_t i = 0; i < n; ++i) {
+    assert(chunks[i].len_ == Config::getInstance().getChunkSize() || contentDefined);
+    if (chunks[i].bypassDedup_ || !hashData) continue;
+    data[nHashed] = chunks[i].buf_;
+    lens[nHashed] = chunks[i].len_;
+    fingerprints[nHashed++] = chunks[i].fingerprint_;
+    nBytes += chunks[i].len_;
+  }
+  if (nHashed != 0) {
+    FingerprintProvider::getInstance().digestBatch(data, lens, nHashed, fingerprints);
+    Stats::getInstance().add_fingerprinted_bytes(nBytes);
+  }
+
+  for (uint32_t i = 0; i < n; ++i) {
+    Chunk &c = chunks[i];
+    if (c.bypassDedup_) {
+      computeWeakFingerprint(c, c.fingerprint_);
+    } else if (traceReplay && c.traceFingerprint_ != nullptr) {
+      copyTraceFingerprint(c.traceFingerprint_, c.fingerprint_);
+    }
+    c.hasFingerprint_ = true;
+    c.fingerprintHash_ = computeFingerprintHash(c.fingerprint_);
+  }
+  END_TIMER(fingerprinting);
+}
+
+// One XXH3 hash per key: the low bits give the signature, the high 32 bits the bucket
 uint64_t Chunk::computeFingerprintHash(uint8_t *fingerprint) {
-  uint32_t signature, bucketId;
-  bucketId = XXH32(fingerprint, Config::getInstance().getFingerprintLength(), 2);
-  signature = XXH32(fingerprint, Config::getInstance().getFingerprintLength(), 101);
-  return ((uint64_t)(bucketId % Config::getInstance().getnFpBuckets())
-          << Config::getInstance().getnBitsPerFpSignature()) |
-         (uint64_t)((signature & ((1u << Config::getInstance().getnBitsPerFpSignature()) - 1u)));
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  uint64_t hash = XXH3_64bits(fingerprint, geometry.getFingerprintLength());
+  return ((uint64_t)geometry.getFpBucketMod().mod(hash >> 32) << geometry.getnBitsPerFpSignature()) |
+         (hash & geometry.getFpSignatureMask());
 }
 
 uint64_t Chunk::computeLBAHash(uint64_t addr) {
-  uint64_t lbaHash = XXH64(&addr, 8, 3);
-  lbaHash >>= 64 - (Config::getInstance().getnBitsPerLbaSignature() + Config::getInstance().getnBitsPerLbaBucketId());
-  return ((uint64_t)((lbaHash >> Config::getInstance().getnBitsPerLbaSignature()) %
-                     Config::getInstance().getnLbaBuckets())
-          << Config::getInstance().getnBitsPerLbaSignature()) |
-         (lbaHash & ((1u << Config::getInstance().getnBitsPerLbaSignature()) - 1u));
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  uint64_t hash = XXH3_64bits(&addr, sizeof(addr));
+  return ((uint64_t)geometry.getLbaBucketMod().mod(hash >> 32) << geometry.getnBitsPerLbaSignature()) |
+         (hash & geometry.getLbaSignatureMask());
 }
 
 Chunker::Chunker(uint64_t addr, void *buf, uint32_t len)
-    : chunkSize_(Config::getInstance().getChunkSize()), addr_(addr), len_(len), buf_((uint8_t *)buf) {}
+    : addr_(addr), buf_((uint8_t *)buf), len_(len), chunkSize_(Config::getInstance().getChunkSize()), nextLength_(0) {}
 
-bool Chunker::next(Chunk &c) {
-  if (len_ == 0) return false;
+Chunker::Chunker(uint64_t addr, void *buf, uint32_t len, std::vector<uint32_t> lengths)
+    : addr_(addr),
+      buf_((uint8_t *)buf),
+      len_(len),
+      chunkSize_(Config::getInstance().getChunkSize()),
+      lengths_(std::move(lengths)),
+      nextLength_(0) {}
 
+// Length of the next chunk: up to the next chunkSize-aligned address, or the next content-defined length
+uint32_t Chunker::nextLength() {
+  if (!lengths_.empty()) {
+    assert(nextLength_ < lengths_.size() && lengths_[nextLength_] <= len_);
+    return lengths_[nextLength_++];
+  }
   uint64_t next_addr = ((addr_ & ~(chunkSize_ - 1)) + chunkSize_) < (addr_ + len_)
                            ? ((addr_ & ~(chunkSize_ - 1)) + chunkSize_)
                            : (addr_ + len_);
+  return next_addr - addr_;
+}
+
+bool Chunker::next(Chunk &c) {
+  if (len_ == 0) return false;
 
   c.addr_ = addr_;
-  c.len_ = next_addr - addr_;
+  c.len_ = nextLength();
   c.buf_ = buf_;
+  c.traceFingerprint_ = nullptr;
   c.hasFingerprint_ = false;
+  c.bypassDedup_ = false;
+  c.patternChunk_ = false;
+  c.nSubchunkRefs_ = 0;
+  c.nDupSubchunks_ = 0;
+  // Only writes know the compressibility of their data; a read miss caches incompressible data
+  c.compressibility = 1;
 
   c.lbaHash_ = ~0ull;
   c.fingerprintHash_ = ~0ull;
@@ -93,12 +182,8 @@ bool Chunker::next(Chunk &c) {
 bool Chunker::next(uint64_t &addr, uint8_t *&buf, uint32_t &len) {
   if (len_ == 0) return false;
 
-  uint64_t next_addr = ((addr_ & ~(chunkSize_ - 1)) + chunkSize_) < (addr_ + len_)
-                           ? ((addr_ & ~(chunkSize_ - 1)) + chunkSize_)
-                           : (addr_ + len_);
-
   addr = addr_;
-  len = next_addr - addr_;
+  len = nextLength();
   buf = buf_;
 
   addr_ += len;
@@ -108,12 +193,106 @@ bool Chunker::next(uint64_t &addr, uint8_t *&buf, uint32_t &len) {
   return true;
 }
 
-ChunkModule::ChunkModule() = default;
+ChunkModule::ChunkModule() {
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  uint64_t nLBASlots = (uint64_t)geometry.getnLbaBuckets() * geometry.getnLBASlotsPerBucket();
+  nMaxExtentsPerShard_ = std::max<uint64_t>((nLBASlots + kNumExtentShards - 1) / kNumExtentShards, 1);
+}
+
 Chunker ChunkModule::createChunker(uint64_t addr, void *buf, uint32_t len) {
   Chunker chunker(addr, buf, len);
   return chunker;
 }
 
+uint64_t ChunkModule::getShardMask(uint64_t begin, uint64_t end) {
+  uint64_t first = begin >> kExtentRegionBits, last = (end - 1) >> kExtentRegionBits, mask = 0;
+  if (last - first + 1 >= kNumExtentShards) return ~0ull;
+  for (uint64_t region = first; region <= last; ++region) mask |= 1ull << (region % kNumExtentShards);
+  return mask;
+}
+
+bool ChunkModule::evict(ExtentShard &shard, uint64_t keepBegin, uint64_t keepEnd, std::vector<uint64_t> &dropped) {
+  auto next = [&shard](uint64_t from) {
+    auto it = shard.extents_.lower_bound(from);
+    return it == shard.extents_.end() ? shard.extents_.begin() : it;
+  };
+  auto it = next(shard.hand_);
+  if (it->first >= keepBegin && it->first < keepEnd) it = next(keepEnd);
+  if (it->first >= keepBegin && it->first < keepEnd) return false;
+  shard.hand_ = it->first + it->second;
+  dropped.push_back(it->first);
+  shard.extents_.erase(it);
+  return true;
+}
+
+Chunker ChunkModule::createContentDefinedChunker(uint64_t addr, void *buf, uint32_t len,
+                                                 std::vector<uint64_t> &dropped) {
+  std::vector<uint32_t> lengths;
+  BEGIN_TIMER();
+  ContentDefinedChunking::getInstance().chunk((const uint8_t *)buf, len, lengths);
+  END_TIMER(chunking);
+
+  std::vector<uint64_t> starts;
+  uint64_t start = addr, end = addr + len;
+  for (uint32_t length : lengths) {
+    starts.push_back(start);
+    start += length;
+  }
+  // A chunk is at most chunkSize long: the chunks overlapping the write start after `from`
+  uint64_t chunkSize = Config::getInstance().getChunkSize(), from = addr > chunkSize ? addr - chunkSize : 0;
+  uint64_t mask = getShardMask(from, end);
+  std::unique_lock<std::mutex> locks[kNumExtentShards];
+  for (uint64_t m = mask; m != 0; m &= m - 1) {
+    locks[__builtin_ctzll(m)] = std::unique_lock<std::mutex>(shards_[__builtin_ctzll(m)].mutex_);
+  }
+
+  // The chunks replace every chunk they overlap; what the overlapped chunks keep out of
+  // [addr, addr + len) is only on the primary device from now on
+  size_t nDropped = dropped.size();
+  for (uint64_t m = mask; m != 0; m &= m - 1) {
+    auto &extents = shards_[__builtin_ctzll(m)].extents_;
+    for (auto it = extents.lower_bound(from); it != extents.end() && it->first < end;) {
+      if (it->first + it->second <= addr) {
+        ++it;
+        continue;
+      }
+      dropped.push_back(it->first);
+      it = extents.erase(it);
+    }
+  }
+  // A chunk starting where a new one starts keeps its LBA index entry, which the new chunk updates
+  dropped.erase(std::remove_if(dropped.begin() + nDropped, dropped.end(),
+                               [&starts](uint64_t a) { return std::binary_search(starts.begin(), starts.end(), a); }),
+                dropped.end());
+
+  for (size_t i = 0; i < starts.size(); ++i) {
+    shards_[(starts[i] >> kExtentRegionBits) % kNumExtentShards].extents_.emplace(starts[i], lengths[i]);
+  }
+  for (uint64_t m = mask; m != 0; m &= m - 1) {
+    ExtentShard &shard = shards_[__builtin_ctzll(m)];
+    while (shard.extents_.size() > nMaxExtentsPerShard_) {
+      if (!evict(shard, addr, end, dropped)) break;
+    }
+  }
+  return Chunker(addr, buf, len, std::move(lengths));
+}
+
+void ChunkModule::findChunks(uint64_t addr, uint32_t len, std::vector<std::pair<uint64_t, uint32_t>> &chunks) {
+  uint64_t chunkSize = Config::getInstance().getChunkSize(), from = addr > chunkSize ? addr - chunkSize : 0;
+  uint64_t mask = getShardMask(from, addr + len);
+  std::unique_lock<std::mutex> locks[kNumExtentShards];
+  for (uint64_t m = mask; m != 0; m &= m - 1) {
+    locks[__builtin_ctzll(m)] = std::unique_lock<std::mutex>(shards_[__builtin_ctzll(m)].mutex_);
+  }
+  for (uint64_t m = mask; m != 0; m &= m - 1) {
+    auto &extents = shards_[__builtin_ctzll(m)].extents_;
+    for (auto it = extents.lower_bound(from); it != extents.end() && it->first < addr + len; ++it) {
+      if (it->first + it->second > addr) chunks.emplace_back(*it);
+    }
+  }
+  std::sort(chunks.begin(), chunks.end());
+}
+
 ChunkModule &ChunkModule::getInstance() {
   static ChunkModule instance;
   return instance;
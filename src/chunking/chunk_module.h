@@ -2,6 +2,9 @@
 #define __CHUNK_H__
 
 #include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include "common/common.h"
 #include "common/config.h"
@@ -11,14 +14,20 @@ namespace cache {
 class Chunker {
  public:
   Chunker(uint64_t addr, void *buf, uint32_t len);
+  // Content-defined chunking: the chunks have the given lengths (summing up to len)
+  Chunker(uint64_t addr, void *buf, uint32_t len, std::vector<uint32_t> lengths);
   bool next(Chunk &c);
   bool next(uint64_t &addr, uint8_t *&buf, uint32_t &len);
 
  protected:
+  uint32_t nextLength();
+
   uint64_t addr_;
   uint8_t *buf_;
   uint32_t len_;
   uint32_t chunkSize_;
+  std::vector<uint32_t> lengths_;
+  uint32_t nextLength_;
 };
 
 class ChunkModule {
@@ -28,6 +37,34 @@ class ChunkModule {
  public:
   static ChunkModule &getInstance();
   Chunker createChunker(uint64_t addr, void *buf, uint32_t len);
+  // Content-defined chunking of a write; the chunks are recorded in the extent map. The start
+  // addresses of the chunks dropped from the map (replaced, or evicted from a full shard) and not
+  // reused by a new chunk are appended to `dropped`: their LBA index entries are never read again.
+  Chunker createContentDefinedChunker(uint64_t addr, void *buf, uint32_t len, std::vector<uint64_t> &dropped);
+  // The content-defined chunks (start address, length) overlapping [addr, addr + len), in order
+  void findChunks(uint64_t addr, uint32_t len, std::vector<std::pair<uint64_t, uint32_t>> &chunks);
+
+ private:
+  // Content-defined chunks are not aligned: reads locate them by the extent map (start -> length).
+  // The map is sharded by the 1 MiB region of the start address, each shard under its own lock,
+  // and holds no more extents than the LBA index has slots (a chunk beyond that would miss in the
+  // LBA index anyway). A full shard evicts in address order from its hand; the bytes of an evicted
+  // chunk are read from the primary device.
+  struct ExtentShard {
+    std::map<uint64_t, uint32_t> extents_;
+    uint64_t hand_ = 0;
+    std::mutex mutex_;
+  };
+  static const uint32_t kExtentRegionBits = 20;
+  static const uint32_t kNumExtentShards = 64;
+
+  // Shards (bit i <-> shard i) of the regions of [begin, end)
+  static uint64_t getShardMask(uint64_t begin, uint64_t end);
+  // Drop the extent at the hand of `shard`, skipping those starting in [keepBegin, keepEnd)
+  static bool evict(ExtentShard &shard, uint64_t keepBegin, uint64_t keepEnd, std::vector<uint64_t> &dropped);
+
+  ExtentShard shards_[kNumExtentShards];
+  size_t nMaxExtentsPerShard_;
 };
 }  // namespace cache
 
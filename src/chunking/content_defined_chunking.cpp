@@ -0,0 +1,218 @@
+#include "content_defined_chunking.h"
+
+#include <immintrin.h>
+
+#include <cassert>
+#include <cstring>
+
+#include "common/config.h"
+
+namespace cache {
+namespace {
+// Gear table: 256 pseudo-random 64-bit values (splitmix64), fixed so that cut points are
+// stable across runs and builds
+struct GearTable {
+  uint64_t v[256];
+  constexpr GearTable() : v() {
+    uint64_t x = 0x6a09e667f3bcc908ull;
+    for (uint32_t i = 0; i < 256; ++i) {
+      x += 0x9e3779b97f4a7c15ull;
+      uint64_t z = x;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      v[i] = z ^ (z >> 31);
+    }
+  }
+};
+constexpr GearTable kGear;
+
+// Mask of the top nBits bits: only they depend on the whole 64-byte window
+inline uint64_t topBits(uint32_t nBits) { return nBits == 0 ? 0 : ~0ull << (64 - nBits); }
+
+inline uint32_t log2Floor(uint32_t v) { return 31 - __builtin_clz(v); }
+
+// Hash of the (at most 64) bytes before data[from]
+inline uint64_t warmUp(const uint8_t *data, uint64_t from) {
+  uint64_t h = 0;
+  for (uint64_t p = from < 64 ? 0 : from - 64; p < from; ++p) h = (h << 1) + kGear.v[data[p]];
+  return h;
+}
+
+// First set bit of bits (bit i <-> position base + i) in positions [from, to), ~0 if none
+inline uint64_t findFirst(const uint64_t *bits, uint64_t base, uint64_t from, uint64_t to) {
+  for (uint64_t p = from; p < to;) {
+    uint64_t word = bits[(p - base) >> 6] >> ((p - base) & 63u);
+    if (word) {
+      uint64_t hit = p + __builtin_ctzll(word);
+      return hit < to ? hit : ~0ull;
+    }
+    p = base + (((p - base) >> 6) + 1) * 64;
+  }
+  return ~0ull;
+}
+}  // namespace
+
+void ContentDefinedChunking::scanScalar(const uint8_t *data, uint64_t from, uint64_t len, uint64_t hardMask,
+                                        uint64_t easyMask, uint64_t *hard, uint64_t *easy) {
+  uint64_t h = warmUp(data, from);
+  for (uint64_t w = 0; w < (len + 63) / 64; ++w) {
+    uint64_t hardBits = 0, easyBits = 0;
+    uint32_t n = len - w * 64 < 64 ? len - w * 64 : 64;
+    const uint8_t *p = data + from + w * 64;
+    for (uint32_t i = 0; i < n; ++i) {
+      h = (h << 1) + kGear.v[p[i]];
+      hardBits |= (uint64_t)((h & hardMask) == 0) << i;
+      easyBits |= (uint64_t)((h & easyMask) == 0) << i;
+    }
+    hard[w] = hardBits, easy[w] = easyBits;
+  }
+}
+
+// 4 lanes, each hashing len / 4 consecutive bytes; 8 bytes of every lane are gathered at once
+__attribute__((target("avx2"))) void ContentDefinedChunking::scanAVX2(const uint8_t *data, uint64_t from,
+                                                                      uint64_t len, uint64_t hardMask,
+                                                                      uint64_t easyMask, uint64_t *hard,
+                                                                      uint64_t *easy) {
+  const uint64_t kLanes = 4;
+  assert(len % kLaneAlignment == 0);
+  uint64_t segLen = len / kLanes, nWordsPerLane = segLen / 64;
+  alignas(32) uint64_t init[kLanes], offsets[kLanes], hardWords[kLanes], easyWords[kLanes];
+  for (uint64_t k = 0; k < kLanes; ++k) {
+    init[k] = warmUp(data, from + k * segLen);
+    offsets[k] = from + k * segLen;
+  }
+  const __m256i byteMask = _mm256_set1_epi64x(0xff), zero = _mm256_setzero_si256();
+  const __m256i hardV = _mm256_set1_epi64x(hardMask), easyV = _mm256_set1_epi64x(easyMask);
+  const __m256i offsetV = _mm256_load_si256((const __m256i *)offsets);
+  __m256i h = _mm256_load_si256((const __m256i *)init);
+
+  for (uint64_t w = 0; w < nWordsPerLane; ++w) {
+    __m256i hardAcc = zero, easyAcc = zero, bit = _mm256_set1_epi64x(1);
+    for (uint64_t t = w * 64; t < w * 64 + 64; t += 8) {
+      __m256i index = _mm256_add_epi64(offsetV, _mm256_set1_epi64x(t));
+      __m256i bytes = _mm256_i64gather_epi64((const long long *)data, index, 1);
+      for (uint32_t j = 0; j < 8; ++j) {
+        __m256i b = _mm256_and_si256(_mm256_srli_epi64(bytes, 8 * j), byteMask);
+        __m256i g = _mm256_i64gather_epi64((const long long *)kGear.v, b, 8);
+        h = _mm256_add_epi64(_mm256_slli_epi64(h, 1), g);
+        __m256i hardHit = _mm256_cmpeq_epi64(_mm256_and_si256(h, hardV), zero);
+        __m256i easyHit = _mm256_cmpeq_epi64(_mm256_and_si256(h, easyV), zero);
+        hardAcc = _mm256_or_si256(hardAcc, _mm256_and_si256(hardHit, bit));
+        easyAcc = _mm256_or_si256(easyAcc, _mm256_and_si256(easyHit, bit));
+        bit = _mm256_slli_epi64(bit, 1);
+      }
+    }
+    _mm256_store_si256((__m256i *)hardWords, hardAcc);
+    _mm256_store_si256((__m256i *)easyWords, easyAcc);
+    for (uint64_t k = 0; k < kLanes; ++k) {
+      hard[k * nWordsPerLane + w] = hardWords[k];
+      easy[k * nWordsPerLane + w] = easyWords[k];
+    }
+  }
+}
+
+// 8 lanes, each hashing len / 8 consecutive bytes
+__attribute__((target("avx512f"))) void ContentDefinedChunking::scanAVX512(const uint8_t *data, uint64_t from,
+                                                                           uint64_t len, uint64_t hardMask,
+                                                                           uint64_t easyMask, uint64_t *hard,
+                                                                           uint64_t *easy) {
+  const uint64_t kLanes = 8;
+  assert(len % kLaneAlignment == 0);
+  uint64_t segLen = len / kLanes, nWordsPerLane = segLen / 64;
+  alignas(64) uint64_t init[kLanes], offsets[kLanes], words[kLanes];
+  for (uint64_t k = 0; k < kLanes; ++k) {
+    init[k] = warmUp(data, from + k * segLen);
+    offsets[k] = from + k * segLen;
+    words[k] = k * nWordsPerLane;
+  }
+  const __m512i byteMask = _mm512_set1_epi64(0xff);
+  const __m512i hardV = _mm512_set1_epi64(hardMask), easyV = _mm512_set1_epi64(easyMask);
+  const __m512i offsetV = _mm512_load_si512(offsets);
+  __m512i h = _mm512_load_si512(init), wordV = _mm512_load_si512(words);
+
+  for (uint64_t w = 0; w < nWordsPerLane; ++w) {
+    __m512i hardAcc = _mm512_setzero_si512(), easyAcc = _mm512_setzero_si512(), bit = _mm512_set1_epi64(1);
+    for (uint64_t t = w * 64; t < w * 64 + 64; t += 8) {
+      __m512i index = _mm512_add_epi64(offsetV, _mm512_set1_epi64(t));
+      __m512i bytes = _mm512_i64gather_epi64(index, data, 1);
+      for (uint32_t j = 0; j < 8; ++j) {
+        __m512i b = _mm512_and_si512(_mm512_srli_epi64(bytes, 8 * j), byteMask);
+        __m512i g = _mm512_i64gather_epi64(b, kGear.v, 8);
+        h = _mm512_add_epi64(_mm512_slli_epi64(h, 1), g);
+        hardAcc = _mm512_mask_or_epi64(hardAcc, _mm512_testn_epi64_mask(h, hardV), hardAcc, bit);
+        easyAcc = _mm512_mask_or_epi64(easyAcc, _mm512_testn_epi64_mask(h, easyV), easyAcc, bit);
+        bit = _mm512_slli_epi64(bit, 1);
+      }
+    }
+    _mm512_i64scatter_epi64(hard, wordV, hardAcc, 8);
+    _mm512_i64scatter_epi64(easy, wordV, easyAcc, 8);
+    wordV = _mm512_add_epi64(wordV, _mm512_set1_epi64(1));
+  }
+}
+
+ContentDefinedChunking::ScanFunc ContentDefinedChunking::getScanFunc() {
+  if (__builtin_cpu_supports("avx512f")) return scanAVX512;
+  if (__builtin_cpu_supports("avx2")) return scanAVX2;
+  return scanScalar;
+}
+
+const char *ContentDefinedChunking::getKernelName() {
+  if (__builtin_cpu_supports("avx512f")) return "AVX-512";
+  if (__builtin_cpu_supports("avx2")) return "AVX2";
+  return "scalar";
+}
+
+ContentDefinedChunking &ContentDefinedChunking::getInstance() {
+  static ContentDefinedChunking instance(Config::getInstance().getCDCMinSize(), Config::getInstance().getCDCAvgSize(),
+                                         Config::getInstance().getChunkSize(), getScanFunc());
+  return instance;
+}
+
+ContentDefinedChunking::ContentDefinedChunking(uint32_t minSize, uint32_t avgSize, uint32_t maxSize, ScanFunc scan)
+    : minSize_(minSize), avgSize_(avgSize), maxSize_(maxSize), scan_(scan) {
+  assert(0 < minSize_ && minSize_ <= avgSize_ && avgSize_ <= maxSize_);
+  assert(minSize_ % kSectorSize == 0 && maxSize_ % kSectorSize == 0);
+  uint32_t nBits = log2Floor(avgSize_);
+  hardMask_ = topBits(nBits + 2);
+  easyMask_ = topBits(nBits > 2 ? nBits - 2 : 0);
+}
+
+// The candidates are computed block by block; a chunk is cut at the first hard candidate in
+// [min, avg), else at the first easy candidate in [avg, max), else at max, rounded up to a
+// sector. Blocks holding no possible cut (within the min size of the current chunk) are not scanned.
+void ContentDefinedChunking::chunk(const uint8_t *data, uint64_t len, std::vector<uint32_t> &lengths) {
+  uint64_t hard[kBlockSize / 64], easy[kBlockSize / 64];
+  uint64_t start = 0;  // first byte of the current chunk
+  for (uint64_t block = 0; block < len; block += kBlockSize) {
+    uint64_t blockEnd = block + kBlockSize < len ? block + kBlockSize : len;
+    if (blockEnd <= start + minSize_ - 1) continue;
+    if (blockEnd - block == kBlockSize) {
+      scan_(data, block, kBlockSize, hardMask_, easyMask_, hard, easy);
+    } else {
+      scanScalar(data, block, blockEnd - block, hardMask_, easyMask_, hard, easy);
+    }
+
+    // Cut after byte `cut`: the chunk length is cut + 1 - start
+    while (true) {
+      uint64_t hardFrom = start + minSize_ - 1, easyFrom = start + avgSize_ - 1, forced = start + maxSize_ - 1;
+      uint64_t cut = ~0ull;
+      if (hardFrom < blockEnd) {
+        cut = findFirst(hard, block, hardFrom > block ? hardFrom : block, easyFrom < blockEnd ? easyFrom : blockEnd);
+      }
+      if (cut == ~0ull && easyFrom < blockEnd) {
+        cut = findFirst(easy, block, easyFrom > block ? easyFrom : block, forced < blockEnd ? forced : blockEnd);
+      }
+      if (cut == ~0ull && forced < blockEnd) cut = forced;
+      if (cut == ~0ull) break;
+      // Chunks end on a sector: the devices are accessed in sectors, and a block-level insert
+      // shifts the data by whole sectors, so the rounded cuts still resynchronize
+      uint64_t chunkEnd = (cut + kSectorSize) & ~(kSectorSize - 1);
+      if (chunkEnd > start + maxSize_) chunkEnd = start + maxSize_;
+      if (chunkEnd > len) chunkEnd = len;
+      lengths.push_back(chunkEnd - start);
+      start = chunkEnd;
+    }
+  }
+  if (start < len) lengths.push_back(len - start);
+}
+}  // namespace cache
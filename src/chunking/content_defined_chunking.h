@@ -0,0 +1,66 @@
+/* File: chunking/content_defined_chunking.h
+ * Description:
+ *   This file contains the content-defined chunking (FastCDC) engine used by Chunker.
+ *
+ *   1. Gear rolling hash h = (h << 1) + G[byte]: bit k of h only depends on the last k + 1
+ *      bytes, so h is a hash of the 64-byte window ending at the byte, wherever the hashing
+ *      started (at least 64 bytes before, or at the beginning of the buffer).
+ *   2. A chunk is cut after a byte whose window hash is zero under a mask of top bits.
+ *      Normalized chunking (FastCDC, level 2): below the average size the mask has
+ *      log2(avg) + 2 bits, above it log2(avg) - 2 bits; chunks are bounded by min and max.
+ *      Cuts are rounded up to the next 512-byte sector, which is what the devices accept.
+ *   3. Window hashes do not depend on where a chunk starts, so the cut candidates of a block
+ *      of the buffer are computed in parallel SIMD lanes, each lane hashing its own segment
+ *      after a 64-byte warm up, into two bitmaps; the cuts are then picked from the bitmaps.
+ *   4. The kernel (AVX-512, AVX2 or scalar) is chosen once at startup according to the
+ *      running CPU. All kernels produce the same candidates.
+ */
+#ifndef __CONTENT_DEFINED_CHUNKING_H__
+#define __CONTENT_DEFINED_CHUNKING_H__
+
+#include <cstdint>
+#include <vector>
+
+namespace cache {
+class ContentDefinedChunking {
+ public:
+  // Bit p of hard / easy <-> the window hash at data[from + p] is zero under hardMask / easyMask,
+  // for p in [0, len). The SIMD kernels need len to be a multiple of kLaneAlignment.
+  typedef void (*ScanFunc)(const uint8_t *data, uint64_t from, uint64_t len, uint64_t hardMask, uint64_t easyMask,
+                           uint64_t *hard, uint64_t *easy);
+
+  static const uint64_t kBlockSize = 16384;
+  static const uint64_t kLaneAlignment = 8 * 64;
+  // Chunk lengths are multiples of the sector size (the request is assumed sector-aligned)
+  static const uint64_t kSectorSize = 512;
+
+  // Chunk sizes from Config (cdcMinSize, cdcAvgSize, and the chunk size as the maximum)
+  static ContentDefinedChunking &getInstance();
+  ContentDefinedChunking(uint32_t minSize, uint32_t avgSize, uint32_t maxSize, ScanFunc scan);
+
+  // Append the lengths of the chunks of data[0, len) to lengths
+  void chunk(const uint8_t *data, uint64_t len, std::vector<uint32_t> &lengths);
+
+  uint32_t getMinSize() { return minSize_; }
+  uint32_t getAvgSize() { return avgSize_; }
+  uint32_t getMaxSize() { return maxSize_; }
+
+  // All kernels are exposed so that the micro benchmark can compare them.
+  static void scanScalar(const uint8_t *data, uint64_t from, uint64_t len, uint64_t hardMask, uint64_t easyMask,
+                         uint64_t *hard, uint64_t *easy);
+  static void scanAVX2(const uint8_t *data, uint64_t from, uint64_t len, uint64_t hardMask, uint64_t easyMask,
+                       uint64_t *hard, uint64_t *easy);
+  static void scanAVX512(const uint8_t *data, uint64_t from, uint64_t len, uint64_t hardMask, uint64_t easyMask,
+                         uint64_t *hard, uint64_t *easy);
+  // The kernel for the running CPU
+  static ScanFunc getScanFunc();
+  static const char *getKernelName();
+
+ private:
+  uint32_t minSize_, avgSize_, maxSize_;
+  uint64_t hardMask_, easyMask_;
+  ScanFunc scan_;
+};
+}  // namespace cache
+
+#endif  //__CONTENT_DEFINED_CHUNKING_H__
@@ -0,0 +1,124 @@
+#include "fingerprint_provider.h"
+
+#include <isa-l_crypto.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+
+#include "chunking/blake3.h"
+#include "common/common.h"
+#include "utils/xxh3.h"
+
+namespace cache {
+namespace {
+// One multi-buffer manager of each kind per thread (lanes are shared by all jobs of a manager).
+// The buffers are submitted at once, the manager hashes up to 16 of them in SIMD lanes; the flush
+// completes the partially filled lanes.
+template <class Manager, class Context, uint32_t kNWords, void (*Init)(Manager *),
+          Context *(*Submit)(Manager *, Context *, const void *, uint32_t, HASH_CTX_FLAG),
+          Context *(*Flush)(Manager *)>
+void digestMultiBuffer(const uint8_t *const *data, const uint32_t *lens, uint32_t n, uint8_t *const *fingerprints) {
+  thread_local std::unique_ptr<Manager, decltype(&free)> manager(nullptr, &free);
+  if (manager == nullptr) {
+    void *p = nullptr;
+    if (posix_memalign(&p, 64, sizeof(Manager)) != 0) {
+      std::cout << "Cannot allocate memory!" << std::endl;
+      exit(-1);
+    }
+    Init((Manager *)p);
+    manager.reset((Manager *)p);
+  }
+  assert(n <= FINGERPRINT_BATCH_SIZE);
+  Context ctxs[FINGERPRINT_BATCH_SIZE];
+  for (uint32_t i = 0; i < n; ++i) {
+    hash_ctx_init(&ctxs[i]);
+    Submit(manager.get(), &ctxs[i], data[i], lens[i], HASH_ENTIRE);
+  }
+  while (Flush(manager.get()) != nullptr) {
+  }
+  // Digest words are big-endian in the SHA output
+  for (uint32_t i = 0; i < n; ++i) {
+    for (uint32_t w = 0; w < kNWords; ++w) {
+      uint32_t word = __builtin_bswap32(ctxs[i].job.result_digest[w]);
+      memcpy(fingerprints[i] + w * sizeof(word), &word, sizeof(word));
+    }
+  }
+}
+
+class SHA1Provider : public FingerprintProvider {
+ public:
+  const char *getName() override { return "SHA1"; }
+  uint32_t getLength() override { return 20; }
+  void digest(const uint8_t *data, uint32_t len, uint8_t *fingerprint) override {
+    struct mh_sha1_ctx ctx;
+    mh_sha1_init(&ctx);
+    mh_sha1_update(&ctx, data, len);
+    mh_sha1_finalize(&ctx, fingerprint);
+  }
+  void digestBatch(const uint8_t *const *data, const uint32_t *lens, uint32_t n,
+                   uint8_t *const *fingerprints) override {
+    digestMultiBuffer<SHA1_HASH_CTX_MGR, SHA1_HASH_CTX, SHA1_DIGEST_NWORDS, sha1_ctx_mgr_init, sha1_ctx_mgr_submit,
+                      sha1_ctx_mgr_flush>(data, lens, n, fingerprints);
+  }
+};
+
+// ISA-L has no single-buffer SHA-256: a single chunk is a batch of one (one lane, or SHA-NI)
+class SHA256Provider : public FingerprintProvider {
+ public:
+  const char *getName() override { return "SHA256"; }
+  uint32_t getLength() override { return 32; }
+  void digest(const uint8_t *data, uint32_t len, uint8_t *fingerprint) override {
+    digestBatch(&data, &len, 1, &fingerprint);
+  }
+  void digestBatch(const uint8_t *const *data, const uint32_t *lens, uint32_t n,
+                   uint8_t *const *fingerprints) override {
+    digestMultiBuffer<SHA256_HASH_CTX_MGR, SHA256_HASH_CTX, SHA256_DIGEST_NWORDS, sha256_ctx_mgr_init,
+                      sha256_ctx_mgr_submit, sha256_ctx_mgr_flush>(data, lens, n, fingerprints);
+  }
+};
+
+class BLAKE3Provider : public FingerprintProvider {
+ public:
+  const char *getName() override { return "BLAKE3"; }
+  uint32_t getLength() override { return Blake3::kOutLen; }
+  void digest(const uint8_t *data, uint32_t len, uint8_t *fingerprint) override {
+    Blake3::hash(data, len, fingerprint);
+  }
+};
+
+class XXH3Provider : public FingerprintProvider {
+ public:
+  const char *getName() override { return "XXH3-128"; }
+  uint32_t getLength() override { return sizeof(XXH128_canonical_t); }
+  bool needsVerification() override { return true; }
+  void digest(const uint8_t *data, uint32_t len, uint8_t *fingerprint) override {
+    XXH128_canonicalFromHash((XXH128_canonical_t *)fingerprint, XXH3_128bits(data, len));
+  }
+};
+}  // namespace
+
+FingerprintProvider &FingerprintProvider::getInstance() {
+  static std::unique_ptr<FingerprintProvider> instance(create(Config::getInstance().getFingerprintAlgorithm()));
+  assert(instance->getLength() == Config::getInstance().getFingerprintLength());
+  return *instance;
+}
+
+FingerprintProvider *FingerprintProvider::create(FingerprintAlgorithmEnum algorithm) {
+  FingerprintProvider *provider = nullptr;
+  switch (algorithm) {
+    case tSHA256Fingerprint:
+      provider = new SHA256Provider();
+      break;
+    case tBLAKE3Fingerprint:
+      provider = new BLAKE3Provider();
+      break;
+    case tXXH3Fingerprint:
+      provider = new XXH3Provider();
+      break;
+    default:
+      provider = new SHA1Provider();
+  }
+  return provider;
+}
+}  // namespace cache
@@ -0,0 +1,44 @@
+/* File: chunking/fingerprint_provider.h
+ * Description:
+ *   This file contains the fingerprint algorithms of the chunks (Config::getFingerprintAlgorithm).
+ *
+ *   1. SHA1: mh_sha1 per chunk, sha1_mb for batches (20 bytes). The two digests differ: a run
+ *      uses one of them for every chunk (Config::isFingerprintBatchingEnabled).
+ *   2. SHA256: the ISA-L SHA-256 multi-buffer manager (32 bytes), whose dispatcher runs the
+ *      SHA-NI kernels on CPUs with the SHA extensions.
+ *   3. BLAKE3 (32 bytes): the 1 KiB BLAKE3 chunks of a chunk are hashed in SIMD lanes (Blake3).
+ *   4. XXH3-128 (16 bytes): not collision resistant, a fingerprint match is only a duplicate
+ *      once the cached data compared equal byte by byte (MetaVerification::verify).
+ */
+#ifndef __FINGERPRINT_PROVIDER_H__
+#define __FINGERPRINT_PROVIDER_H__
+
+#include <cstdint>
+
+#include "common/config.h"
+
+namespace cache {
+class FingerprintProvider {
+ public:
+  virtual ~FingerprintProvider() = default;
+
+  // The provider of Config::getFingerprintAlgorithm
+  static FingerprintProvider &getInstance();
+  static FingerprintProvider *create(FingerprintAlgorithmEnum algorithm);
+
+  virtual const char *getName() = 0;
+  // Digest length in bytes (Config::getFingerprintLength)
+  virtual uint32_t getLength() = 0;
+  // A fingerprint match needs the data to be compared
+  virtual bool needsVerification() { return false; }
+  // Digest of data[0, len) into fingerprint[0, getLength())
+  virtual void digest(const uint8_t *data, uint32_t len, uint8_t *fingerprint) = 0;
+  // Digests of n (<= FINGERPRINT_BATCH_SIZE) buffers; one by one unless the algorithm has a
+  // multi-buffer implementation
+  virtual void digestBatch(const uint8_t *const *data, const uint32_t *lens, uint32_t n, uint8_t *const *fingerprints) {
+    for (uint32_t i = 0; i < n; ++i) digest(data[i], lens[i], fingerprints[i]);
+  }
+};
+}  // namespace cache
+
+#endif  //__FINGERPRINT_PROVIDER_H__
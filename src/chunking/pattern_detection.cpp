@@ -0,0 +1,76 @@
+#include "pattern_detection.h"
+
+#include <immintrin.h>
+
+#include <cstring>
+
+namespace cache {
+namespace {
+// Bytes [from, len) compared one word at a time, then one byte at a time
+bool matchesFrom(const uint8_t *data, uint32_t from, uint32_t len) {
+  uint64_t pattern = 0x0101010101010101ull * data[0], word;
+  uint32_t i = from;
+  for (; i + sizeof(word) <= len; i += sizeof(word)) {
+    memcpy(&word, data + i, sizeof(word));
+    if (word != pattern) return false;
+  }
+  for (; i < len; ++i) {
+    if (data[i] != data[0]) return false;
+  }
+  return true;
+}
+}  // namespace
+
+bool PatternDetection::detect(const uint8_t *data, uint32_t len, uint8_t &byte) {
+  static const DetectFunc detectFunc = getDetectFunc();
+  if (len == 0 || !detectFunc(data, len)) return false;
+  byte = data[0];
+  return true;
+}
+
+bool PatternDetection::detectScalar(const uint8_t *data, uint32_t len) { return matchesFrom(data, 0, len); }
+
+// 128 bytes per step: the differences of four vectors are ORed and tested once
+__attribute__((target("avx2"))) bool PatternDetection::detectAVX2(const uint8_t *data, uint32_t len) {
+  const __m256i pattern = _mm256_set1_epi8((char)data[0]);
+  uint32_t i = 0;
+  for (; i + 128 <= len; i += 128) {
+    const __m256i *p = (const __m256i *)(data + i);
+    __m256i diff = _mm256_or_si256(
+        _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(p), pattern),
+                        _mm256_xor_si256(_mm256_loadu_si256(p + 1), pattern)),
+        _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(p + 2), pattern),
+                        _mm256_xor_si256(_mm256_loadu_si256(p + 3), pattern)));
+    if (!_mm256_testz_si256(diff, diff)) return false;
+  }
+  return matchesFrom(data, i, len);
+}
+
+// 256 bytes per step
+__attribute__((target("avx512f"))) bool PatternDetection::detectAVX512(const uint8_t *data, uint32_t len) {
+  const __m512i pattern = _mm512_set1_epi8((char)data[0]);
+  uint32_t i = 0;
+  for (; i + 256 <= len; i += 256) {
+    const uint8_t *p = data + i;
+    __m512i diff = _mm512_or_si512(
+        _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p), pattern),
+                        _mm512_xor_si512(_mm512_loadu_si512(p + 64), pattern)),
+        _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p + 128), pattern),
+                        _mm512_xor_si512(_mm512_loadu_si512(p + 192), pattern)));
+    if (_mm512_test_epi64_mask(diff, diff) != 0) return false;
+  }
+  return matchesFrom(data, i, len);
+}
+
+PatternDetection::DetectFunc PatternDetection::getDetectFunc() {
+  if (__builtin_cpu_supports("avx512f")) return detectAVX512;
+  if (__builtin_cpu_supports("avx2")) return detectAVX2;
+  return detectScalar;
+}
+
+const char *PatternDetection::getKernelName() {
+  if (__builtin_cpu_supports("avx512f")) return "AVX-512";
+  if (__builtin_cpu_supports("avx2")) return "AVX2";
+  return "scalar";
+}
+}  // namespace cache
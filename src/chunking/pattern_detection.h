@@ -0,0 +1,39 @@
+/* File: chunking/pattern_detection.h
+ * Description:
+ *   This file contains the detector of pattern chunks (Config::isPatternChunkFastPathEnabled):
+ *   chunks whose bytes all have the same value, all-zero chunks first of all (thin-provisioned
+ *   volumes, freshly formatted file systems).
+ *
+ *   1. A pattern chunk is named by its byte alone: the LBA index records it with a reserved
+ *      value (HashGeometry::getPatternFpHash) instead of a fingerprint hash, and it takes no FP
+ *      index slot, no metadata and no cached data. Its reads are served by a memset.
+ *   2. The chunk is compared with its first byte broadcast to a vector, several vectors per
+ *      step, stopping at the first step with a difference: most chunks differ within the first
+ *      vectors, a pattern chunk is read once.
+ *   3. The kernel (AVX-512, AVX2 or scalar) is chosen once at startup according to the running
+ *      CPU. All kernels give the same answer.
+ */
+#ifndef __PATTERN_DETECTION_H__
+#define __PATTERN_DETECTION_H__
+
+#include <cstdint>
+
+namespace cache {
+class PatternDetection {
+ public:
+  // Whether all bytes of data[0, len) are data[0]
+  typedef bool (*DetectFunc)(const uint8_t *data, uint32_t len);
+
+  // Whether data[0, len) is a pattern chunk, and its byte if so
+  static bool detect(const uint8_t *data, uint32_t len, uint8_t &byte);
+
+  static bool detectScalar(const uint8_t *data, uint32_t len);
+  static bool detectAVX2(const uint8_t *data, uint32_t len);
+  static bool detectAVX512(const uint8_t *data, uint32_t len);
+  // The kernel for the running CPU
+  static DetectFunc getDetectFunc();
+  static const char *getKernelName();
+};
+}  // namespace cache
+
+#endif  //__PATTERN_DETECTION_H__
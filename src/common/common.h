@@ -2,13 +2,19 @@
 #define __COMMON_H__
 
 #define DIRECT_IO
+// Chunks fingerprinted together by a multi-buffer manager (16 lanes with AVX-512)
+#define FINGERPRINT_BATCH_SIZE 16
+
+#include <immintrin.h>
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #include "common/config.h"
 #include "common/env.h"
@@ -21,14 +27,36 @@ namespace cache {
  *        When a chunk matches both LBA index and CA index for prefix matching,
  *        metadata is fetched from SSD to verify if the chunk is duplicate or not.
  */
-// MetadataSize_: 60 * 8 + 20 + 4 + 4 + 4 = 512
+// MetadataSize_: 60 * 8 + 20 + 2 + 2 + 4 + 4 = 512
+// A fingerprint (Config::getFingerprintLength) ends where fingerprint_ ends: a longer one than
+// 20 bytes extends into the last LBAs_ entries (getFingerprint), which hold no LBA then.
 struct Metadata {
   uint64_t LBAs_[MAX_NUM_LBAS_PER_CACHED_CHUNK];  // 8 byte * 60 = 480
   uint8_t fingerprint_[20];
-  uint32_t nextEvict_;
-  uint32_t numLBAs_;
+  uint16_t nextEvict_;
+  uint16_t numLBAs_;
   // If the data is compressed, the compressed_len is valid, otherwise, it is 0.
   uint32_t compressedLen_;
+  // Subchunk deduplication: a composite chunk is stored as nSubchunkRefs_ references to cached
+  // subchunks, whose fingerprint hashes take the last MAX_NUM_SUBCHUNK_REFS entries of LBAs_;
+  // 0 for a chunk stored whole.
+  uint32_t nSubchunkRefs_;
+
+  // LBAs_ entries taken by the fingerprint
+  static inline uint32_t getnFingerprintLBAs() {
+    uint32_t len = Config::getInstance().getFingerprintLength();
+    return len <= sizeof(fingerprint_) ? 0 : (len - sizeof(fingerprint_) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  }
+  inline uint8_t *getFingerprint() {
+    return (uint8_t *)this + offsetof(Metadata, fingerprint_) + sizeof(fingerprint_) -
+           Config::getInstance().getFingerprintLength();
+  }
+  inline uint32_t getMaxNumLBAs() const {
+    return MAX_NUM_LBAS_PER_CACHED_CHUNK - getnFingerprintLBAs() - (nSubchunkRefs_ == 0 ? 0 : MAX_NUM_SUBCHUNK_REFS);
+  }
+  inline uint64_t *getSubchunkHashes() {
+    return LBAs_ + MAX_NUM_LBAS_PER_CACHED_CHUNK - getnFingerprintLBAs() - MAX_NUM_SUBCHUNK_REFS;
+  }
 };
 
 enum DedupResult { DUP_CONTENT, NOT_DUP, DEDUP_UNKNOWN };
@@ -45,6 +73,66 @@ enum VerificationResult {
 
 enum DeviceType { PRIMARY_DEVICE, CACHE_DEVICE };
 
+/*
+ * A bucket-level lock held by a chunk along its data path.
+ * Move-only RAII handle over a one-byte bucket spinlock (embedded in the bucket
+ * header, or an entry of the dense lock array of the index), without any heap
+ * allocation; an empty handle (single-threaded mode) holds nothing.
+ * Locking is test-and-test-and-set with exponential backoff; as a chunk may hold
+ * the lock across device I/O, a waiter yields its CPU once the backoff is maxed out.
+ */
+class BucketLock {
+ public:
+  BucketLock() : lock_(nullptr) {}
+  explicit BucketLock(std::atomic<uint8_t> *lock) : lock_(lock) { acquire(lock_); }
+  BucketLock(BucketLock &&other) noexcept : lock_(other.lock_) { other.lock_ = nullptr; }
+  BucketLock &operator=(BucketLock &&other) noexcept {
+    if (this != &other) {
+      reset();
+      lock_ = other.lock_;
+      other.lock_ = nullptr;
+    }
+    return *this;
+  }
+  BucketLock(const BucketLock &) = delete;
+  BucketLock &operator=(const BucketLock &) = delete;
+  ~BucketLock() { reset(); }
+
+  // A handle holding the lock if it is free right now, an empty one otherwise
+  static BucketLock tryAcquire(std::atomic<uint8_t> *lock) {
+    BucketLock handle;
+    if (lock->load(std::memory_order_relaxed) == 0 && lock->exchange(1, std::memory_order_acquire) == 0) {
+      handle.lock_ = lock;
+    }
+    return handle;
+  }
+
+  inline bool isLocked() const { return lock_ != nullptr; }
+  inline void reset() {
+    if (lock_ != nullptr) {
+      lock_->store(0, std::memory_order_release);
+      lock_ = nullptr;
+    }
+  }
+
+ private:
+  static const uint32_t kMaxBackoff = 1024;
+
+  static inline void acquire(std::atomic<uint8_t> *lock) {
+    for (uint32_t backoff = 1;;) {
+      if (lock->load(std::memory_order_relaxed) == 0 && lock->exchange(1, std::memory_order_acquire) == 0) return;
+      if (backoff <= kMaxBackoff) {
+        for (uint32_t i = 0; i < backoff; ++i) _mm_pause();
+        backoff <<= 1;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  std::atomic<uint8_t> *lock_;
+};
+
 /*
  * The basic read/write/evict unit.
  * An object of class Chunk is passed along the data path of a single request.
@@ -79,11 +167,28 @@ struct Chunk {
   uint32_t nSubchunks_;  // compression level: 0, 1, 2, 3 representing 1, 2, 3, 4 * 8 KiB
   double compressibility;
 
-  uint8_t fingerprint_[20];
+  uint8_t fingerprint_[MAX_FINGERPRINT_LENGTH];
+  // Trace replay: the fingerprint given by the trace for this chunk (TRACE_FINGERPRINT_LENGTH bytes), nullptr if none
+  const uint8_t *traceFingerprint_;
   uint64_t lbaHash_;
   uint64_t fingerprintHash_;
   
   bool hasFingerprint_;
+  // Load-adaptive bypass: no cryptographic fingerprint and no FP index lookup for this chunk
+  bool bypassDedup_;
+  // Pattern chunk (PatternDetection): fingerprintHash_ is HashGeometry::getPatternFpHash of its byte,
+  // the chunk has no fingerprint, FP index entry, metadata or cached data
+  bool patternChunk_;
+
+  // Subchunk deduplication (a full chunk that is not duplicate as a whole): the hashes of its
+  // subchunk fingerprints and, for a composite chunk, the cache location of every subchunk;
+  // nDupSubchunks_ of them are cached already, the others are packed in compressedBuf_.
+  uint64_t subchunkHashes_[MAX_NUM_SUBCHUNK_REFS];
+  uint64_t subchunkLocations_[MAX_NUM_SUBCHUNK_REFS];
+  // Generation of the slot of every located subchunk (SubchunkDeduplicationModule::validate)
+  uint32_t subchunkGenerations_[MAX_NUM_SUBCHUNK_REFS];
+  uint32_t nSubchunkRefs_;  // 0: stored whole
+  uint32_t nDupSubchunks_;
 
   uint64_t cachedataLocation_;
   uint64_t metadataLocation_;
@@ -97,16 +202,21 @@ struct Chunk {
 
   // For multithreading, indexing update must be serialized
   // Bucket-level locks are used to guarantee the consistency of index
-  std::unique_ptr<std::lock_guard<std::mutex>> lbaBucketLock_;
-  std::unique_ptr<std::lock_guard<std::mutex>> fpBucketLock_;
+  BucketLock lbaBucketLock_;
+  BucketLock fpBucketLock_;
 
   Chunk() = default;
   Chunk(const Chunk &c) {
     addr_ = c.addr_;
     len_ = c.len_;
     buf_ = c.buf_;
+    traceFingerprint_ = c.traceFingerprint_;
 
     hasFingerprint_ = false;
+    bypassDedup_ = false;
+    patternChunk_ = false;
+    nSubchunkRefs_ = 0;
+    nDupSubchunks_ = 0;
     hitLBAIndex_ = false;
     hitFPIndex_ = false;
     verficationResult_ = VERIFICATION_UNKNOWN;
@@ -119,6 +229,11 @@ struct Chunk {
    * @brief compute fingerprint of current chunk.
    */
   void computeFingerprint();
+  /**
+   * @brief compute the fingerprints of n (<= FINGERPRINT_BATCH_SIZE) chunks together, with the
+   * multi-buffer manager of the fingerprint algorithm if any (Config::isFingerprintBatchingEnabled).
+   */
+  static void computeFingerprints(Chunk *chunks, uint32_t n);
   static uint64_t computeFingerprintHash(uint8_t *fingerprint);
   static uint64_t computeLBAHash(uint64_t lba);
   inline bool aligned() {
@@ -37,6 +37,29 @@ enum CachePolicyEnum {
 
 enum CacheModeEnum { tWriteThrough, tWriteBack };
 
+// Cache policy of the LBA index when the compact cache policy is enabled
+// BucketAwareLRU: slots are kept ordered by recency (promote shifts slots)
+// BucketAwareCLOCK: per-slot reference/core bits, O(1) promote
+enum LBACachePolicyEnum { tBucketAwareLRU, tBucketAwareCLOCK };
+
+// Compact: keys and values are bit-packed (minimal DRAM)
+// Aligned: keys and values are stored in separate byte-aligned arrays (plain loads)
+enum IndexLayoutEnum { tCompactLayout, tAlignedLayout };
+
+// Layout of the sketch-based reference counter
+// Rows: four rows of 4-bit counters, one XXH32 hash per row, overflow table for saturated counters
+// Blocked: one XXH64 hash, the four counters of a key share one 64-byte block, in-line escalation
+enum SketchLayoutEnum { tRowSketch, tBlockedSketch };
+
+// Fixed: a request is split at chunkSize-aligned addresses
+// ContentDefined: writes are split at content-defined cut points (FastCDC), between
+// cdcMinSize and chunkSize bytes, cdcAvgSize on average
+enum ChunkingEnum { tFixedChunking, tContentDefinedChunking };
+
+// Fingerprint of a chunk (FingerprintProvider): SHA-1 (20 bytes), SHA-256 (32 bytes), BLAKE3
+// (32 bytes), XXH3-128 (16 bytes, non-cryptographic: matches are verified against the data)
+enum FingerprintAlgorithmEnum { tSHA1Fingerprint, tSHA256Fingerprint, tBLAKE3Fingerprint, tXXH3Fingerprint };
+
 class Config {
  private:
   Config() {
@@ -97,10 +120,39 @@ class Config {
   CacheModeEnum cacheMode_ = tWriteThrough;
 
   bool enableCompactCachePolicy_ = true;
+  IndexLayoutEnum indexLayout_ = tCompactLayout;
+  bool enableCacheLineAlignedBuckets_ = false;
+  bool enableOptimisticLookup_ = false;
+  SketchLayoutEnum sketchLayout_ = tRowSketch;
+  // Reference counts kept in the value bits of the FP index slots instead of a global counter
+  bool enableInlineReferenceCount_ = false;
+  LBACachePolicyEnum lbaCachePolicy_ = tBucketAwareLRU;
+
+  ChunkingEnum chunking_ = tFixedChunking;
+  uint32_t cdcMinSize_ = 2048;
+  uint32_t cdcAvgSize_ = 8192;
+
+  FingerprintAlgorithmEnum fingerprintAlgorithm_ = tSHA1Fingerprint;
+  // Fingerprints by multi-buffer SHA-1 (sha1_mb) over the chunks of a request instead of mh_sha1.
+  // Off until the speedup is measured against ISA-L's sha1_mb (benchmark/fingerprint_batch.cpp).
+  bool enableFingerprintBatching_ = false;
+
+  // A full chunk that is not duplicate as a whole is deduplicated by subchunks
+  bool enableSubchunkDedup_ = false;
+
+  // Chunks whose partial writes are staged in the write merge buffer (MergeBuffer), 0: none
+  uint32_t mergeBufferSize_ = 0;
+
+  // Load-adaptive bypass of deduplication and compression (LoadController)
+  bool enableLoadAdaptiveBypass_ = false;
+  uint32_t bypassQueueDepth_ = 1;
+  double bypassCompressibility_ = 2.0;
 
-  std::map<uint64_t, Fingerprint> lba2Fingerprints_;
-  std::map<Fingerprint, int> fingerprintCnts_;
-  std::mutex mutex_;
+  // All-zero and constant-byte chunks are only recorded in the LBA index (PatternDetection)
+  bool enablePatternChunkFastPath_ = false;
+
+  // Share of the deduplicated chunks that selective deduplication routes through the FP index
+  double selectiveDedupTargetOccupancy_ = 0.5;
 
  public:
   static Config &getInstance() {
@@ -108,7 +160,7 @@ class Config {
     return instance;
   }
 
-  void release() { lba2Fingerprints_.clear(); }
+  void release() {}
 
   uint32_t getChunkSize() { return chunkSize_; }
   uint32_t getSubchunkSize() { return subchunkSize_; }
@@ -190,12 +242,47 @@ class Config {
   }
   bool isSC() { return enableSC_; }
   bool isSD() { return enableSD_; }
+  void setSelectiveDedupTargetOccupancy(double v) { selectiveDedupTargetOccupancy_ = v; }
+  double getSelectiveDedupTargetOccupancy() { return selectiveDedupTargetOccupancy_; }
+  void setChunking(ChunkingEnum v) { chunking_ = v; }
+  ChunkingEnum getChunking() { return chunking_; }
+  bool isContentDefinedChunkingEnabled() { return chunking_ == tContentDefinedChunking; }
+  void setCDCMinSize(uint32_t v) { cdcMinSize_ = v; }
+  uint32_t getCDCMinSize() { return cdcMinSize_; }
+  void setCDCAvgSize(uint32_t v) { cdcAvgSize_ = v; }
+  uint32_t getCDCAvgSize() { return cdcAvgSize_; }
+  void enableSubchunkDedup(bool v) { enableSubchunkDedup_ = v; }
+  bool isSubchunkDedupEnabled() { return enableSubchunkDedup_; }
+  void setMergeBufferSize(uint32_t v) { mergeBufferSize_ = v; }
+  uint32_t getMergeBufferSize() { return mergeBufferSize_; }
+  // The fingerprint length follows the algorithm
+  void setFingerprintAlgorithm(FingerprintAlgorithmEnum v) {
+    fingerprintAlgorithm_ = v;
+    fingerprintLen_ = v == tSHA1Fingerprint ? 20 : v == tXXH3Fingerprint ? 16 : 32;
+  }
+  FingerprintAlgorithmEnum getFingerprintAlgorithm() { return fingerprintAlgorithm_; }
+  void enableFingerprintBatching(bool v) { enableFingerprintBatching_ = v; }
+  bool isFingerprintBatchingEnabled() { return enableFingerprintBatching_; }
+  void enableLoadAdaptiveBypass(bool v) { enableLoadAdaptiveBypass_ = v; }
+  bool isLoadAdaptiveBypassEnabled() { return enableLoadAdaptiveBypass_; }
+  void enablePatternChunkFastPath(bool v) { enablePatternChunkFastPath_ = v; }
+  bool isPatternChunkFastPathEnabled() { return enablePatternChunkFastPath_; }
+  void setBypassQueueDepth(uint32_t v) { bypassQueueDepth_ = v; }
+  uint32_t getBypassQueueDepth() { return bypassQueueDepth_; }
+  void setBypassCompressibility(double v) { bypassCompressibility_ = v; }
+  double getBypassCompressibility() { return bypassCompressibility_; }
 
   void enableSynthenticCompression(bool v) { enableSynthenticCompression_ = v; }
   void enableTraceReplay(bool v) { enableTraceReplay_ = v; }
   void enableSketchRF(bool v) { enableSketchRF_ = v; }
   void enableCompactCachePolicy(bool v) { enableCompactCachePolicy_ = v; }
   void setCacheMode(CacheModeEnum v) { cacheMode_ = v; }
+  void setIndexLayout(IndexLayoutEnum v) { indexLayout_ = v; }
+  void enableCacheLineAlignedBuckets(bool v) { enableCacheLineAlignedBuckets_ = v; }
+  void enableOptimisticLookup(bool v) { enableOptimisticLookup_ = v; }
+  void setSketchLayout(SketchLayoutEnum v) { sketchLayout_ = v; }
+  void enableInlineReferenceCount(bool v) { enableInlineReferenceCount_ = v; }
+  void setLBACachePolicy(LBACachePolicyEnum v) { lbaCachePolicy_ = v; }
 
   bool isMultiThreadingEnabled() { return enableMultiThreading_; }
   bool isDirectIOEnabled() { return enableDirectIO_; }
@@ -205,27 +292,12 @@ class Config {
   bool isSketchRFEnabled() { return enableSketchRF_; }
   bool isCompactCachePolicyEnabled() { return enableCompactCachePolicy_; }
   CacheModeEnum getCacheMode() { return cacheMode_; }
-
-  void setFingerprint(uint64_t lba, char *fingerprint) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    Fingerprint fp((uint8_t *)fingerprint);
-    lba2Fingerprints_[lba] = fp;
-    fingerprintCnts_[fp]++;
-  }
-
-  void getFingerprint(uint64_t lba, char *fingerprint) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (lba2Fingerprints_.find(lba) != lba2Fingerprints_.end()) {
-      memcpy(fingerprint, lba2Fingerprints_[lba].v_, sizeof(char) * fingerprintLen_);
-      lba2Fingerprints_.erase(lba);
-    }
-  }
-
-  int getFingerprintCnts(char *fingerprint) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    Fingerprint fp((uint8_t *)fingerprint);
-    return fingerprintCnts_[fp];
-  }
+  IndexLayoutEnum getIndexLayout() { return indexLayout_; }
+  bool isCacheLineAlignedBucketsEnabled() { return enableCacheLineAlignedBuckets_; }
+  bool isOptimisticLookupEnabled() { return enableOptimisticLookup_; }
+  SketchLayoutEnum getSketchLayout() { return sketchLayout_; }
+  bool isInlineReferenceCountEnabled() { return enableInlineReferenceCount_; }
+  LBACachePolicyEnum getLBACachePolicy() { return lbaCachePolicy_; }
 };
 
 }  // namespace cache
@@ -1 +1,8 @@
-#define MAX_NUM_LBAS_PER_CACHED_CHUNK 60u
\ No newline at end of file
+#define MAX_NUM_LBAS_PER_CACHED_CHUNK 60u
+// Subchunk deduplication: subchunk references of a composite chunk, kept in the last LBAs_ entries
+// before the fingerprint
+#define MAX_NUM_SUBCHUNK_REFS 4u
+// Longest fingerprint (SHA-256, BLAKE3); the bytes beyond Metadata::fingerprint_ take LBAs_ entries
+#define MAX_FINGERPRINT_LENGTH 32u
+// Fingerprints of the FIU traces (SHA-1)
+#define TRACE_FINGERPRINT_LENGTH 20u
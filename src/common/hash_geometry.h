@@ -0,0 +1,99 @@
+#ifndef __HASH_GEOMETRY_H__
+#define __HASH_GEOMETRY_H__
+
+#include <cassert>
+#include <cstdint>
+
+#include "config.h"
+
+namespace cache {
+// Geometry of the LBA and FP indexes: bucket counts, signature widths and the constants derived
+// from them (masks, fast-modulo multipliers, the LBA core-region separator).
+// Computed once from Config on first use, i.e. after the configuration is loaded, and immutable
+// afterwards: hashing and index code read it instead of recomputing it through Config getters.
+class HashGeometry {
+ public:
+  // a % divisor for a 32-bit a, without a division (Lemire et al., "Faster remainder by direct
+  // computation", 2019): the fractional part of a / divisor is multiplier * a mod 2^64.
+  class FastMod {
+   public:
+    explicit FastMod(uint32_t divisor) : divisor_(divisor), multiplier_(~0ull / divisor + 1) {}
+    inline uint32_t mod(uint32_t a) const {
+      return (uint32_t)(((unsigned __int128)(multiplier_ * a) * divisor_) >> 64);
+    }
+
+   private:
+    uint64_t divisor_, multiplier_;
+  };
+
+  static const HashGeometry &getInstance() {
+    static const HashGeometry instance;
+    return instance;
+  }
+
+  // An LBA / FP hash is (bucketId << nBitsPerSignature) | signature
+  inline uint32_t getnLbaBuckets() const { return nLbaBuckets_; }
+  inline uint32_t getnBitsPerLbaSignature() const { return nBitsPerLbaSignature_; }
+  inline uint32_t getLbaSignatureMask() const { return lbaSignatureMask_; }
+  inline const FastMod &getLbaBucketMod() const { return lbaBucketMod_; }
+  inline uint32_t getnLBASlotsPerBucket() const { return nLBASlotsPerBucket_; }
+
+  inline uint32_t getnFpBuckets() const { return nFpBuckets_; }
+  inline uint32_t getnBitsPerFpSignature() const { return nBitsPerFpSignature_; }
+  inline uint32_t getnBitsPerFpBucketId() const { return nBitsPerFpBucketId_; }
+  inline uint32_t getFpSignatureMask() const { return fpSignatureMask_; }
+  inline const FastMod &getFpBucketMod() const { return fpBucketMod_; }
+  inline uint32_t getnFPSlotsPerBucket() const { return nFPSlotsPerBucket_; }
+  inline uint32_t getFingerprintLength() const { return fingerprintLength_; }
+  // LBA index value of a pattern chunk (PatternDetection): the FP bucket ID past the last FP bucket
+  // (nBitsPerFpBucketId bits always leave one), the byte of the chunk in the signature
+  inline bool canEncodePattern() const { return nBitsPerFpSignature_ >= 8; }
+  inline uint64_t getPatternFpHash(uint8_t byte) const {
+    return ((uint64_t)patternFpBucketId_ << nBitsPerFpSignature_) | byte;
+  }
+  inline bool isPatternFpHash(uint64_t fpHash) const { return (fpHash >> nBitsPerFpSignature_) == patternFpBucketId_; }
+  inline uint8_t getPatternByte(uint64_t fpHash) const { return fpHash & 0xff; }
+  // On-SSD layout behind the FP index slots: | metadata region | cached data region |
+  inline uint32_t getSubchunkSize() const { return subchunkSize_; }
+  inline uint32_t getMetadataSize() const { return metadataSize_; }
+  inline uint64_t getMetadataRegionSize() const { return metadataRegionSize_; }
+
+  // First slot of the core region of an LBA bucket (Config::getLBASlotSeperator)
+  inline uint32_t getLBASlotSeperator() const { return lbaSlotSeperator_; }
+
+ private:
+  HashGeometry()
+      : nLbaBuckets_(Config::getInstance().getnLbaBuckets()),
+        nBitsPerLbaSignature_(Config::getInstance().getnBitsPerLbaSignature()),
+        lbaSignatureMask_((1u << nBitsPerLbaSignature_) - 1),
+        lbaBucketMod_(nLbaBuckets_),
+        nLBASlotsPerBucket_(Config::getInstance().getnLBASlotsPerBucket()),
+        nFpBuckets_(Config::getInstance().getnFpBuckets()),
+        nBitsPerFpSignature_(Config::getInstance().getnBitsPerFpSignature()),
+        nBitsPerFpBucketId_(Config::getInstance().getnBitsPerFpBucketId()),
+        fpSignatureMask_((1u << nBitsPerFpSignature_) - 1),
+        fpBucketMod_(nFpBuckets_),
+        patternFpBucketId_((1u << nBitsPerFpBucketId_) - 1),
+        nFPSlotsPerBucket_(Config::getInstance().getnFPSlotsPerBucket()),
+        fingerprintLength_(Config::getInstance().getFingerprintLength()),
+        subchunkSize_(Config::getInstance().getSubchunkSize()),
+        metadataSize_(Config::getInstance().getMetadataSize()),
+        metadataRegionSize_(1ull * nFpBuckets_ * nFPSlotsPerBucket_ * metadataSize_),
+        lbaSlotSeperator_(Config::getInstance().getLBASlotSeperator()) {
+    assert(nLbaBuckets_ > 0 && nFpBuckets_ > 0);
+    assert(nBitsPerLbaSignature_ < 32 && nBitsPerFpSignature_ < 32);
+    assert(patternFpBucketId_ >= nFpBuckets_);
+  }
+
+  uint32_t nLbaBuckets_, nBitsPerLbaSignature_, lbaSignatureMask_;
+  FastMod lbaBucketMod_;
+  uint32_t nLBASlotsPerBucket_;
+  uint32_t nFpBuckets_, nBitsPerFpSignature_, nBitsPerFpBucketId_, fpSignatureMask_;
+  FastMod fpBucketMod_;
+  uint32_t patternFpBucketId_;
+  uint32_t nFPSlotsPerBucket_, fingerprintLength_, subchunkSize_, metadataSize_;
+  uint64_t metadataRegionSize_;
+  uint32_t lbaSlotSeperator_;
+};
+}  // namespace cache
+#endif
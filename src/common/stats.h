@@ -6,6 +6,7 @@
 #include <iomanip>
 #include <map>
 
+#include "chunking/fingerprint_provider.h"
 #include "common/common.h"
 
 namespace cache {
@@ -57,6 +58,7 @@ struct Stats {
               << "    Time elpased for decompression: " << _time_elapsed_decompression << std::endl
               << "    Time elpased for lookup: " << _time_elapsed_lookup << std::endl
               << "    Time elpased for dedup: " << _time_elapsed_dedup << std::endl
+              << "    Time elpased for dedup(selective_dedup): " << _time_elapsed_selective_dedup << std::endl
               << "    Time elpased for update_index: " << _time_elapsed_update_index << std::endl
               << "    Time elpased for io_ssd: " << _time_elapsed_io_ssd << std::endl
               << "    Time elpased for io_pm: " << _time_elapsed_io_pm << std::endl
@@ -71,6 +73,87 @@ struct Stats {
               << "    Time elpased for debug: " << _time_elapsed_debug << std::endl
               << std::endl;
 
+    if (_n_fingerprinted_bytes + _n_fp_verified != 0) {
+      std::cout << "Fingerprinting: " << std::endl
+                << "    Algorithm: " << FingerprintProvider::getInstance().getName() << std::endl
+                << "    Num bytes fingerprinted: " << _n_fingerprinted_bytes << std::endl
+                << "    Throughput: "
+                << 1.0 * _n_fingerprinted_bytes / std::max<uint64_t>(_time_elapsed_fingerprinting, 1) << " MB/s"
+                << std::endl
+                << "    Num fingerprint matches compared with the cached data: " << _n_fp_verified << std::endl
+                << "    Num fingerprint collisions (data differs): " << _n_fp_collisions << std::endl
+                << std::endl;
+    }
+
+    if (_sd_memory_bytes != 0) {
+      std::cout << "Selective deduplication: " << std::endl
+                << "    Num chunks deduplicated (high frequency): " << _n_sd_high_freq << std::endl
+                << "    Num chunks bypassed (low frequency): " << _n_sd_low_freq << std::endl
+                << "    Frequency threshold: " << _sd_threshold << std::endl
+                << "    Frequency sketch memory: " << _sd_memory_bytes << " bytes" << std::endl
+                << std::endl;
+    }
+
+    if (_subchunk_memory_bytes != 0) {
+      std::cout << "Subchunk deduplication: " << std::endl
+                << "    Num chunks checked: " << _n_subchunk_checked_chunks << std::endl
+                << "    Num composite chunks: " << _n_subchunk_composite_chunks << std::endl
+                << "    Num subchunks checked: " << _n_subchunks_checked << std::endl
+                << "    Num subchunks dup content: " << _n_subchunks_dup << std::endl
+                << "    Num bytes not written to pm (dup subchunks): "
+                << 1ull * _n_subchunks_dup * Config::getInstance().getSubchunkSize() << std::endl
+                << "    Num composite chunks resolved: " << _n_subchunk_resolved << std::endl
+                << "    Num composite chunks not resolved (subchunk overwritten): " << _n_subchunk_not_resolved
+                << std::endl
+                << "    Subchunk index memory: " << _subchunk_memory_bytes << " bytes" << std::endl
+                << "    Time elpased for subchunk_dedup: " << _time_elapsed_subchunk_dedup << std::endl
+                << std::endl;
+    }
+
+    if (_n_cdc_chunks != 0) {
+      std::cout << "Content-defined chunking: " << std::endl
+                << "    Num chunks written: " << _n_cdc_chunks << std::endl
+                << "    Average chunk size: " << _n_cdc_bytes / _n_cdc_chunks << " bytes" << std::endl
+                << "    Num bytes written: " << _n_cdc_bytes << std::endl
+                << "    Num bytes written dup content: " << _n_cdc_dup_bytes << std::endl
+                << "    Time elpased for chunking: " << _time_elapsed_chunking << std::endl
+                << std::endl;
+    }
+
+    if (_n_partial_reads + _n_partial_writes != 0) {
+      std::cout << "Partial chunk I/O: " << std::endl
+                << "    Num partial chunk reads: " << _n_partial_reads << std::endl
+                << "    Num partial chunk writes: " << _n_partial_writes << std::endl
+                << "    Num chunks read for update (hit): " << _n_update_reads_hit << std::endl
+                << "    Num chunks read for update (not hit): " << _n_update_reads_not_hit << std::endl
+                << "    Num merged chunks written (complete): " << _n_merged_complete << std::endl
+                << "    Num merged chunks written (read-modify-write): " << _n_merged_incomplete << std::endl
+                << std::endl;
+    }
+
+    if (_n_load_windows != 0) {
+      std::cout << "Load-adaptive bypass: " << std::endl
+                << "    Num windows: " << _n_load_windows << std::endl
+                << "    Num overloaded windows: " << _n_overloaded_windows << std::endl
+                << "    Num chunks not deduplicated (low frequency under overload): " << _n_bypass_dedup << std::endl
+                << "    Num chunks not compressed (low compressibility under overload): " << _n_bypass_compression
+                << std::endl
+                << "    Bypass level: " << _bypass_level << std::endl
+                << std::endl;
+    }
+
+    if (Config::getInstance().isPatternChunkFastPathEnabled()) {
+      std::cout << "Pattern chunks: " << std::endl
+                << "    Num pattern chunks written: " << _n_pattern_writes << std::endl
+                << "        Num all-zero chunks written: " << _n_zero_writes << std::endl
+                << "    Num pattern chunk reads (memset): " << _n_pattern_read_hits << std::endl
+                << "    Num pattern chunks read from the primary device: " << _n_pattern_read_misses << std::endl
+                << "    Num bytes not written to pm (pattern chunks written or read from the primary device): "
+                << _n_pattern_bytes << std::endl
+                << "    Time elpased for pattern_detection: " << _time_elapsed_pattern_detection << std::endl
+                << std::endl;
+    }
+
     std::cout << std::setprecision(2) << "Overall Stats: " << std::endl
               << "    Hit ratio: " << _n_read_hit * 1.0 / (_n_read_hit + _n_read_not_hit) * 100.0 << "%" << std::endl
               << "    Dup ratio: "
@@ -78,6 +161,10 @@ struct Stats {
               << "%" << std::endl
               << "    Dup ratio (not include read): " << 1.0 * _n_write_dup_content / _n_write * 100.0 << "%"
               << std::endl;
+    if (_n_cdc_bytes != 0) {
+      std::cout << "    Dup ratio (bytes, not include read): " << 1.0 * _n_cdc_dup_bytes / _n_cdc_bytes * 100.0 << "%"
+                << std::endl;
+    }
 
     std::cout << std::defaultfloat;
   }
@@ -130,6 +217,12 @@ struct Stats {
 
   inline void add_write_stat(Chunk &c) {
     _n_write.fetch_add(1, std::memory_order_relaxed);
+    // Content-defined chunks vary in size: the dup ratio is also counted in bytes
+    if (Config::getInstance().isContentDefinedChunkingEnabled()) {
+      _n_cdc_chunks.fetch_add(1, std::memory_order_relaxed);
+      _n_cdc_bytes.fetch_add(c.len_, std::memory_order_relaxed);
+      if (c.dedupResult_ == DUP_CONTENT) _n_cdc_dup_bytes.fetch_add(c.len_, std::memory_order_relaxed);
+    }
     if (c.dedupResult_ == DUP_CONTENT) {
       _n_write_dup_content.fetch_add(1, std::memory_order_relaxed);
     } else if (c.dedupResult_ == NOT_DUP) {
@@ -199,6 +292,54 @@ struct Stats {
   std::atomic<uint64_t> _n_read_not_hit_not_dup_ca_not_hit;
   std::atomic<uint64_t> _n_read_not_hit_not_dup_ca_not_match;
 
+  // selective deduplication; the sketch memory and the threshold survive reset()
+  std::atomic<uint64_t> _n_sd_high_freq;
+  std::atomic<uint64_t> _n_sd_low_freq;
+  std::atomic<uint64_t> _sd_memory_bytes{0};
+  std::atomic<uint32_t> _sd_threshold{0};
+
+  // load-adaptive bypass (LoadController)
+  std::atomic<uint64_t> _n_bypass_dedup;
+  std::atomic<uint64_t> _n_bypass_compression;
+  std::atomic<uint64_t> _n_load_windows;
+  std::atomic<uint64_t> _n_overloaded_windows;
+  std::atomic<uint32_t> _bypass_level{0};
+
+  // subchunk deduplication; the index memory survives reset()
+  std::atomic<uint64_t> _n_subchunk_checked_chunks;
+  std::atomic<uint64_t> _n_subchunk_composite_chunks;
+  std::atomic<uint64_t> _n_subchunks_checked;
+  std::atomic<uint64_t> _n_subchunks_dup;
+  std::atomic<uint64_t> _n_subchunk_resolved;
+  std::atomic<uint64_t> _n_subchunk_not_resolved;
+  std::atomic<uint64_t> _subchunk_memory_bytes{0};
+
+  // partial chunk I/O: reads for update are the reads of read-modify-writes
+  std::atomic<uint64_t> _n_partial_reads;
+  std::atomic<uint64_t> _n_partial_writes;
+  std::atomic<uint64_t> _n_update_reads_hit;
+  std::atomic<uint64_t> _n_update_reads_not_hit;
+  std::atomic<uint64_t> _n_merged_complete;
+  std::atomic<uint64_t> _n_merged_incomplete;
+
+  // fingerprinting: bytes hashed (trace fingerprints not included), and the fingerprint matches of
+  // non-cryptographic fingerprints, verified by comparing the data
+  std::atomic<uint64_t> _n_fingerprinted_bytes;
+  std::atomic<uint64_t> _n_fp_verified;
+  std::atomic<uint64_t> _n_fp_collisions;
+
+  // pattern chunks (PatternDetection): only recorded in the LBA index
+  std::atomic<uint64_t> _n_pattern_writes;
+  std::atomic<uint64_t> _n_zero_writes;
+  std::atomic<uint64_t> _n_pattern_read_hits;
+  std::atomic<uint64_t> _n_pattern_read_misses;
+  std::atomic<uint64_t> _n_pattern_bytes;
+
+  // content-defined chunking (written chunks)
+  std::atomic<uint64_t> _n_cdc_chunks;
+  std::atomic<uint64_t> _n_cdc_bytes;
+  std::atomic<uint64_t> _n_cdc_dup_bytes;
+
   /*
    * Time Elapsed. Time consumed by each part of the system
    */
@@ -210,7 +351,11 @@ struct Stats {
   _(compression);
   _(decompression);
   _(fingerprinting);
+  _(chunking);
   _(dedup);
+  _(selective_dedup);
+  _(subchunk_dedup);
+  _(pattern_detection);
   _(lookup);
   _(update_index);
   _(update_index1);
@@ -272,6 +417,77 @@ struct Stats {
   }
   inline void add_bytes_read_from_pm(uint64_t v) { _n_data_bytes_read_from_pm.fetch_add(v, std::memory_order_relaxed); }
 
+  inline void add_selective_dedup_stat(bool highFreq) {
+    if (highFreq)
+      _n_sd_high_freq.fetch_add(1, std::memory_order_relaxed);
+    else
+      _n_sd_low_freq.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void set_selective_dedup_state(uint64_t memoryBytes, uint32_t threshold) {
+    _sd_memory_bytes.store(memoryBytes, std::memory_order_relaxed);
+    _sd_threshold.store(threshold, std::memory_order_relaxed);
+  }
+
+  inline void add_bypass_dedup_stat() { _n_bypass_dedup.fetch_add(1, std::memory_order_relaxed); }
+  inline void add_bypass_compression_stat() { _n_bypass_compression.fetch_add(1, std::memory_order_relaxed); }
+  inline void add_load_window_stat(bool overloaded, uint32_t level) {
+    _n_load_windows.fetch_add(1, std::memory_order_relaxed);
+    if (overloaded) _n_overloaded_windows.fetch_add(1, std::memory_order_relaxed);
+    _bypass_level.store(level, std::memory_order_relaxed);
+  }
+
+  inline void add_subchunk_dedup_stat(uint32_t nSubchunks, uint32_t nDup) {
+    _n_subchunk_checked_chunks.fetch_add(1, std::memory_order_relaxed);
+    _n_subchunks_checked.fetch_add(nSubchunks, std::memory_order_relaxed);
+    _n_subchunks_dup.fetch_add(nDup, std::memory_order_relaxed);
+    if (nDup != 0) _n_subchunk_composite_chunks.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void add_subchunk_resolve_stat(bool resolved) {
+    if (resolved)
+      _n_subchunk_resolved.fetch_add(1, std::memory_order_relaxed);
+    else
+      _n_subchunk_not_resolved.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void add_fingerprinted_bytes(uint64_t v) { _n_fingerprinted_bytes.fetch_add(v, std::memory_order_relaxed); }
+  inline void add_fp_verification_stat(bool same) {
+    _n_fp_verified.fetch_add(1, std::memory_order_relaxed);
+    if (!same) _n_fp_collisions.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void add_pattern_write_stat(Chunk &c, uint8_t byte) {
+    _n_pattern_writes.fetch_add(1, std::memory_order_relaxed);
+    _n_pattern_bytes.fetch_add(c.len_, std::memory_order_relaxed);
+    if (byte == 0) _n_zero_writes.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void add_pattern_read_stat(Chunk &c, bool hit) {
+    if (hit) {
+      _n_pattern_read_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      _n_pattern_read_misses.fetch_add(1, std::memory_order_relaxed);
+      _n_pattern_bytes.fetch_add(c.len_, std::memory_order_relaxed);
+    }
+  }
+  inline void add_partial_io_stat(bool isWrite) {
+    if (isWrite)
+      _n_partial_writes.fetch_add(1, std::memory_order_relaxed);
+    else
+      _n_partial_reads.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void add_update_read_stat(bool hit) {
+    if (hit)
+      _n_update_reads_hit.fetch_add(1, std::memory_order_relaxed);
+    else
+      _n_update_reads_not_hit.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void add_merged_write_stat(bool complete) {
+    if (complete)
+      _n_merged_complete.fetch_add(1, std::memory_order_relaxed);
+    else
+      _n_merged_incomplete.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void set_subchunk_dedup_memory(uint64_t memoryBytes) {
+    _subchunk_memory_bytes.store(memoryBytes, std::memory_order_relaxed);
+  }
+
   inline void add_compress_level(int compress_level) {
     _compress_level[compress_level].fetch_add(1, std::memory_order_relaxed);
   }
@@ -292,6 +508,36 @@ struct Stats {
     _n_read_not_hit_not_dup_ca_not_hit.store(0, std::memory_order_relaxed);
     _n_read_not_hit_not_dup_ca_not_match.store(0, std::memory_order_relaxed);
 
+    _n_sd_high_freq.store(0, std::memory_order_relaxed);
+    _n_sd_low_freq.store(0, std::memory_order_relaxed);
+    _n_bypass_dedup.store(0, std::memory_order_relaxed);
+    _n_bypass_compression.store(0, std::memory_order_relaxed);
+    _n_load_windows.store(0, std::memory_order_relaxed);
+    _n_overloaded_windows.store(0, std::memory_order_relaxed);
+    _n_subchunk_checked_chunks.store(0, std::memory_order_relaxed);
+    _n_subchunk_composite_chunks.store(0, std::memory_order_relaxed);
+    _n_subchunks_checked.store(0, std::memory_order_relaxed);
+    _n_subchunks_dup.store(0, std::memory_order_relaxed);
+    _n_subchunk_resolved.store(0, std::memory_order_relaxed);
+    _n_subchunk_not_resolved.store(0, std::memory_order_relaxed);
+    _n_partial_reads.store(0, std::memory_order_relaxed);
+    _n_partial_writes.store(0, std::memory_order_relaxed);
+    _n_update_reads_hit.store(0, std::memory_order_relaxed);
+    _n_update_reads_not_hit.store(0, std::memory_order_relaxed);
+    _n_merged_complete.store(0, std::memory_order_relaxed);
+    _n_merged_incomplete.store(0, std::memory_order_relaxed);
+    _n_fingerprinted_bytes.store(0, std::memory_order_relaxed);
+    _n_fp_verified.store(0, std::memory_order_relaxed);
+    _n_fp_collisions.store(0, std::memory_order_relaxed);
+    _n_pattern_writes.store(0, std::memory_order_relaxed);
+    _n_zero_writes.store(0, std::memory_order_relaxed);
+    _n_pattern_read_hits.store(0, std::memory_order_relaxed);
+    _n_pattern_read_misses.store(0, std::memory_order_relaxed);
+    _n_pattern_bytes.store(0, std::memory_order_relaxed);
+    _n_cdc_chunks.store(0, std::memory_order_relaxed);
+    _n_cdc_bytes.store(0, std::memory_order_relaxed);
+    _n_cdc_dup_bytes.store(0, std::memory_order_relaxed);
+
     _n_total_bytes_written_to_ssd.store(0, std::memory_order_relaxed);
     _n_metadata_bytes_written_to_ssd.store(0, std::memory_order_relaxed);
     _n_metadata_bytes_read_from_ssd.store(0, std::memory_order_relaxed);
@@ -304,7 +550,11 @@ struct Stats {
     _(compression);
     _(decompression);
     _(fingerprinting);
+    _(chunking);
     _(dedup);
+    _(selective_dedup);
+    _(subchunk_dedup);
+    _(pattern_detection);
     _(lookup);
     _(update_index);
     _(update_index1);
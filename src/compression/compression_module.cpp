@@ -7,6 +7,7 @@
 #include "common/config.h"
 #include "common/stats.h"
 #include "lz4.h"
+#include "manage/load_controller.h"
 #include "selective_compression_module.h"
 #include "utils/utils.h"
 
@@ -18,7 +19,9 @@ CompressionModule &CompressionModule::getInstance() {
 
 void CompressionModule::compress(Chunk &chunk) {
   BEGIN_TIMER();
-  if (Config::getInstance().isSC()) {
+  if (Config::getInstance().isLoadAdaptiveBypassEnabled() && LoadController::getInstance().bypassCompression(chunk)) {
+    chunk.compressedLen_ = chunk.len_;
+  } else if (Config::getInstance().isSC()) {
     if (SelectiveCompressionModule::getInstance().compressible(chunk)) {
       chunk.compressedLen_ =
           LZ4_compress_default((const char *)chunk.buf_, (char *)chunk.compressedBuf_, chunk.len_, chunk.len_ * 0.75);
@@ -34,15 +37,25 @@ void CompressionModule::compress(Chunk &chunk) {
     chunk.compressedLen_ = 0;
   }
 
-  uint32_t numMaxSubchunks = Config::getInstance().getMaxSubchunks();
+  // Subchunks of the raw chunk: a content-defined chunk only takes the subchunks its length needs
+  uint32_t subchunkSize = Config::getInstance().getSubchunkSize();
+  bool contentDefined = Config::getInstance().isContentDefinedChunkingEnabled();
+  uint32_t numRawSubchunks =
+      contentDefined ? (chunk.len_ + subchunkSize - 1) / subchunkSize : Config::getInstance().getMaxSubchunks();
   if (chunk.compressedLen_ == 0) {
-    chunk.nSubchunks_ = numMaxSubchunks;
+    chunk.nSubchunks_ = numRawSubchunks;
   } else {
-    chunk.nSubchunks_ =
-        (chunk.compressedLen_ + Config::getInstance().getSubchunkSize() - 1) / Config::getInstance().getSubchunkSize();
+    chunk.nSubchunks_ = (chunk.compressedLen_ + subchunkSize - 1) / subchunkSize;
   }
-  if (chunk.nSubchunks_ == numMaxSubchunks) {
-    chunk.compressedBuf_ = chunk.buf_;
+  if (chunk.nSubchunks_ >= numRawSubchunks) {
+    chunk.nSubchunks_ = numRawSubchunks;
+    if (!contentDefined || chunk.len_ % subchunkSize == 0) {
+      chunk.compressedBuf_ = chunk.buf_;
+    } else {
+      // 变长块的最后一个子块不满：拷贝到 compressedBuf_ 并补零，避免越界读写请求的缓冲区
+      memcpy(chunk.compressedBuf_, chunk.buf_, chunk.len_);
+      memset(chunk.compressedBuf_ + chunk.len_, 0, numRawSubchunks * subchunkSize - chunk.len_);
+    }
   }
   END_TIMER(compression);
 }
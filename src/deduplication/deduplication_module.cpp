@@ -4,32 +4,60 @@
 
 #include "common/stats.h"
 #include "selective_deduplication.h"
+#include "subchunk_deduplication.h"
 #include "utils/utils.h"
 
 namespace cache {
+namespace {
+// The chunk is cached as a unique chunk without looking up the FP index
+void bypass(Chunk &chunk) {
+  chunk.dedupResult_ = NOT_DUP;
+  chunk.verficationResult_ = BOTH_LBA_AND_FP_NOT_VALID;
+  chunk.hitFPIndex_ = false;
+  chunk.hitLBAIndex_ = false;
+}
+}  // namespace
+
 DeduplicationModule::DeduplicationModule() = default;
 
 void DeduplicationModule::dedup(Chunk &chunk) {
   BEGIN_TIMER();
-  if (Config::getInstance().isSD()) {
-    if (SelectiveDeduplicationModule::isHighFreq(chunk)) {
+  uint32_t nSubchunks = chunk.nSubchunks_;
+  if (chunk.bypassDedup_) {
+    bypass(chunk);
+  } else if (Config::getInstance().isSD()) {
+    if (SelectiveDeduplicationModule::getInstance().isHighFreq(chunk)) {
       MetadataModule::getInstance().dedup(chunk);
     } else {
-      chunk.dedupResult_ = NOT_DUP;
-      chunk.verficationResult_ = BOTH_LBA_AND_FP_NOT_VALID;
-      chunk.hitFPIndex_ = false;
-      chunk.hitLBAIndex_ = false;
+      bypass(chunk);
     }
   } else {
     MetadataModule::getInstance().dedup(chunk);
   }
+  // A composite chunk is only a duplicate while all of its subchunks are cached; otherwise it is stored again
+  if (Config::getInstance().isSubchunkDedupEnabled() && chunk.dedupResult_ == DUP_CONTENT &&
+      chunk.metadata_.nSubchunkRefs_ != 0 &&
+      !SubchunkDeduplicationModule::getInstance().resolve(chunk)) {
+    chunk.dedupResult_ = NOT_DUP;
+  }
+  // A chunk stored again keeps its own size: an FP index hit returned the size of the cached chunk
+  if (chunk.dedupResult_ == NOT_DUP) chunk.nSubchunks_ = nSubchunks;
   END_TIMER(dedup);
 }
 
 void DeduplicationModule::lookup(Chunk &chunk) {
   BEGIN_TIMER();
   MetadataModule::getInstance().lookup(chunk);
+  // A composite chunk hits only if all of its subchunks are still cached (a pattern chunk has no metadata)
+  if (Config::getInstance().isSubchunkDedupEnabled() && chunk.lookupResult_ == HIT && !chunk.patternChunk_ &&
+      chunk.metadata_.nSubchunkRefs_ != 0 &&
+      !SubchunkDeduplicationModule::getInstance().resolve(chunk)) {
+    chunk.fpBucketLock_.reset();
+    chunk.lookupResult_ = NOT_HIT;
+  }
   END_TIMER(lookup);
 }
 
+bool DeduplicationModule::revalidate(Chunk &chunk) { return MetadataModule::getInstance().revalidate(chunk); }
+
 }  // namespace cache
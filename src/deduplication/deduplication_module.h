@@ -14,6 +14,7 @@ class DeduplicationModule {
  public:
   static void dedup(Chunk &chunk);
   static void lookup(Chunk &chunk);
+  static bool revalidate(Chunk &chunk);
 };
 }  // namespace cache
 
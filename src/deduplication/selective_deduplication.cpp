@@ -1,21 +1,158 @@
 #include "selective_deduplication.h"
 
 #include "common/config.h"
+#include "common/hash_geometry.h"
 #include "common/stats.h"
 #include "utils/utils.h"
 
 namespace cache {
+namespace {
+// splitmix64 finalizer: FP hashes ((bucketId << nBitsPerSignature) | signature) are not uniform
+inline uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
 
-SelectiveDeduplicationModule::SelectiveDeduplicationModule() = default;
-std::map<std::string, int> SelectiveDeduplicationModule::GFFI;
+inline uint64_t nextPowerOfTwo(uint64_t v) {
+  uint64_t p = 1;
+  while (p < v) p <<= 1;
+  return p;
+}
 
-bool SelectiveDeduplicationModule::isHighFreq(Chunk &chunk) {
-  int fingerprintCnts = Config::getInstance().getFingerprintCnts((char *)chunk.fingerprint_);
+// Bit offsets of the four 4-bit counters of a key inside its word (the top 16 bits of the hash)
+inline void counterShifts(uint64_t h, uint32_t *shifts) {
+  for (uint32_t i = 0; i < 4; ++i) shifts[i] = ((h >> (48 + 4 * i)) & 15u) * 4;
+}
+
+inline uint32_t minCounter(uint64_t word, const uint32_t *shifts) {
+  uint32_t count = 15;
+  for (uint32_t i = 0; i < 4; ++i) {
+    uint32_t c = (word >> shifts[i]) & 15u;
+    count = c < count ? c : count;
+  }
+  return count;
+}
+}  // namespace
+
+// Four counters per FP slot (16 per word), one doorkeeper byte per FP slot; the sample size is
+// ten times the number of slots, as in TinyLFU
+FrequencySketch::FrequencySketch(uint64_t nEntries)
+    : nWords_(nextPowerOfTwo((nEntries + 3) / 4)),
+      nDoorkeeperWords_(nextPowerOfTwo((nEntries + 7) / 8)),
+      sampleSize_(10 * nEntries),
+      words_(std::make_unique<std::atomic<uint64_t>[]>(nWords_)),
+      doorkeeper_(std::make_unique<std::atomic<uint64_t>[]>(nDoorkeeperWords_)),
+      nSamples_(0) {
+  for (uint64_t i = 0; i < nWords_; ++i) words_[i].store(0, std::memory_order_relaxed);
+  for (uint64_t i = 0; i < nDoorkeeperWords_; ++i) doorkeeper_[i].store(0, std::memory_order_relaxed);
+}
+
+uint32_t FrequencySketch::record(uint64_t key) {
+  uint64_t h = mix(key), hc = mix(h);
+  uint64_t bitMask = nDoorkeeperWords_ * 64 - 1, b1 = h & bitMask, b2 = (h >> 32) & bitMask;
+  uint64_t m1 = 1ull << (b1 & 63u), m2 = 1ull << (b2 & 63u);
+  uint32_t count;
+
+  // First occurrence in the sample: only the doorkeeper remembers it
+  bool seen = (doorkeeper_[b1 >> 6].load(std::memory_order_relaxed) & m1) &&
+              (doorkeeper_[b2 >> 6].load(std::memory_order_relaxed) & m2);
+  if (!seen) {
+    doorkeeper_[b1 >> 6].fetch_or(m1, std::memory_order_relaxed);
+    doorkeeper_[b2 >> 6].fetch_or(m2, std::memory_order_relaxed);
+    count = estimate(key);
+  } else {
+    // Conservative update: only the minimal counters of the key are incremented
+    uint32_t shifts[4];
+    counterShifts(hc, shifts);
+    std::atomic<uint64_t> &word = words_[hc & (nWords_ - 1)];
+    uint64_t w = word.load(std::memory_order_relaxed), updated;
+    do {
+      count = minCounter(w, shifts);
+      if (count == 15) break;
+      updated = w;
+      for (uint32_t i = 0; i < 4; ++i) {
+        if (((w >> shifts[i]) & 15u) != count) continue;
+        updated = (updated & ~(15ull << shifts[i])) | ((count + 1ull) << shifts[i]);
+      }
+    } while (!word.compare_exchange_weak(w, updated, std::memory_order_relaxed));
+    count = (count == 15 ? 15 : count + 1) + 1;
+  }
+
+  // Exactly one thread sees the sample counter reach the sample size
+  if (nSamples_.fetch_add(1, std::memory_order_relaxed) + 1 == sampleSize_) {
+    age();
+    nSamples_.fetch_sub(sampleSize_, std::memory_order_relaxed);
+  }
+  return count;
+}
+
+uint32_t FrequencySketch::estimate(uint64_t key) {
+  uint64_t h = mix(key), hc = mix(h);
+  uint64_t bitMask = nDoorkeeperWords_ * 64 - 1, b1 = h & bitMask, b2 = (h >> 32) & bitMask;
+  bool seen = (doorkeeper_[b1 >> 6].load(std::memory_order_relaxed) >> (b1 & 63u) & 1) &&
+              (doorkeeper_[b2 >> 6].load(std::memory_order_relaxed) >> (b2 & 63u) & 1);
+  uint32_t shifts[4];
+  counterShifts(hc, shifts);
+  return minCounter(words_[hc & (nWords_ - 1)].load(std::memory_order_relaxed), shifts) + seen;
+}
 
-  if (fingerprintCnts >= SELECTIVE_DEDUPLICATION_TRESHOULD) {
-    return true;
+// Halve every counter and forget the doorkeeper. Concurrent increments may be lost, which only
+// makes the aging slightly stronger.
+void FrequencySketch::age() {
+  for (uint64_t i = 0; i < nWords_; ++i) {
+    words_[i].store((words_[i].load(std::memory_order_relaxed) >> 1) & 0x7777777777777777ull,
+                    std::memory_order_relaxed);
   }
+  for (uint64_t i = 0; i < nDoorkeeperWords_; ++i) doorkeeper_[i].store(0, std::memory_order_relaxed);
+}
+
+SelectiveDeduplicationModule &SelectiveDeduplicationModule::getInstance() {
+  static SelectiveDeduplicationModule instance;
+  return instance;
+}
+
+namespace {
+inline uint64_t getnFPSlots() {
+  return 1ull * HashGeometry::getInstance().getnFpBuckets() * HashGeometry::getInstance().getnFPSlotsPerBucket();
+}
+}  // namespace
+
+SelectiveDeduplicationModule::SelectiveDeduplicationModule()
+    : sketch_(getnFPSlots()),
+      targetOccupancy_(Config::getInstance().getSelectiveDedupTargetOccupancy()),
+      adjustInterval_(getnFPSlots() / 8 > 1024 ? getnFPSlots() / 8 : 1024),
+      threshold_(SELECTIVE_DEDUPLICATION_TRESHOULD),
+      nDecisions_(0),
+      nHighFreq_(0) {
+  Stats::getInstance().set_selective_dedup_state(sketch_.getMemoryUsage(), SELECTIVE_DEDUPLICATION_TRESHOULD);
+}
 
-  return false;
+bool SelectiveDeduplicationModule::isHighFreq(Chunk &chunk) {
+  bool highFreq;
+  BEGIN_TIMER();
+  highFreq = sketch_.record(chunk.fingerprintHash_) >= threshold_.load(std::memory_order_relaxed);
+  if (highFreq) nHighFreq_.fetch_add(1, std::memory_order_relaxed);
+  if (nDecisions_.fetch_add(1, std::memory_order_relaxed) + 1 == adjustInterval_) adjustThreshold();
+  END_TIMER(selective_dedup);
+  Stats::getInstance().add_selective_dedup_stat(highFreq);
+  return highFreq;
+}
+
+// One step towards the target occupancy per interval: alternating between two thresholds when the
+// target lies between them gives the target on average
+void SelectiveDeduplicationModule::adjustThreshold() {
+  double occupancy = (double)nHighFreq_.exchange(0, std::memory_order_relaxed) / adjustInterval_;
+  nDecisions_.fetch_sub(adjustInterval_, std::memory_order_relaxed);
+  uint32_t threshold = threshold_.load(std::memory_order_relaxed);
+  if (occupancy > targetOccupancy_ && threshold < SELECTIVE_DEDUPLICATION_MAX_TRESHOULD) {
+    ++threshold;
+  } else if (occupancy < targetOccupancy_ && threshold > 1) {
+    --threshold;
+  }
+  threshold_.store(threshold, std::memory_order_relaxed);
+  Stats::getInstance().set_selective_dedup_state(sketch_.getMemoryUsage(), threshold);
 }
-}  // namespace cache
\ No newline at end of file
+}  // namespace cache
@@ -1,6 +1,6 @@
 #ifndef __SDEDUP_H__
 #define __SDEDUP_H__
-#include <map>
+#include <atomic>
 #include <memory>
 
 #include "chunking/chunk_module.h"
@@ -8,16 +8,55 @@
 #include "compression/compression_module.h"
 #include "metadata/metadata_module.h"
 
-#define SELECTIVE_DEDUPLICATION_TRESHOULD 10
+// Initial frequency threshold, adapted online to the target occupancy
+#define SELECTIVE_DEDUPLICATION_TRESHOULD 2
+#define SELECTIVE_DEDUPLICATION_MAX_TRESHOULD 16
 
 namespace cache {
+// Online fingerprint frequency estimator (TinyLFU): a doorkeeper Bloom filter absorbs the first
+// occurrence of a fingerprint, later occurrences are counted in a count-min sketch of 4-bit
+// counters whose four counters of a key share one 64-bit word (conservative update, one CAS).
+// Every sampleSize recorded occurrences all counters are halved and the doorkeeper is cleared,
+// so the estimate follows the recent traffic with memory bounded by the FP index size.
+class FrequencySketch {
+ public:
+  // nEntries: number of FP index slots
+  explicit FrequencySketch(uint64_t nEntries);
+
+  // Count one occurrence of the key and return its estimated frequency (0 ~ 16) including it
+  uint32_t record(uint64_t key);
+  uint32_t estimate(uint64_t key);
+  uint64_t getMemoryUsage() { return (nWords_ + nDoorkeeperWords_) * sizeof(uint64_t); }
+
+ private:
+  void age();
+
+  uint64_t nWords_, nDoorkeeperWords_, sampleSize_;
+  std::unique_ptr<std::atomic<uint64_t>[]> words_;
+  std::unique_ptr<std::atomic<uint64_t>[]> doorkeeper_;
+  std::atomic<uint64_t> nSamples_;
+};
+
+// Selective deduplication: only fingerprints estimated as frequent go through FP index deduplication.
+// The threshold follows Config::getSelectiveDedupTargetOccupancy, the share of the deduplication
+// traffic routed through the FP index: it is raised when more chunks than that are deemed frequent,
+// and lowered when fewer are, once every adjustInterval decisions.
 class SelectiveDeduplicationModule {
-  static std::map<std::string, int> GFFI;
   SelectiveDeduplicationModule();
 
  public:
-  static bool isHighFreq(Chunk &chunk);
+  static SelectiveDeduplicationModule &getInstance();
+  bool isHighFreq(Chunk &chunk);
+
+ private:
+  void adjustThreshold();
+
+  FrequencySketch sketch_;
+  double targetOccupancy_;
+  uint64_t adjustInterval_;
+  std::atomic<uint32_t> threshold_;
+  std::atomic<uint64_t> nDecisions_, nHighFreq_;
 };
 }  // namespace cache
 
-#endif
\ No newline at end of file
+#endif
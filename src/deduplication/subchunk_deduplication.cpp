@@ -0,0 +1,197 @@
+#include "subchunk_deduplication.h"
+
+#include <isa-l_crypto.h>
+
+#include <cstring>
+
+#include "common/config.h"
+#include "common/hash_geometry.h"
+#include "common/stats.h"
+#include "io/io_module.h"
+#include "metadata/index.h"
+#include "utils/utils.h"
+#include "utils/xxh3.h"
+
+namespace cache {
+namespace {
+// Hash of the mh_sha1 fingerprint of a subchunk; 0 is kept for "no hash"
+uint64_t hashSubchunk(const uint8_t *data, uint32_t len) {
+  struct mh_sha1_ctx ctx;
+  uint8_t fingerprint[20];
+  mh_sha1_init(&ctx);
+  mh_sha1_update(&ctx, data, len);
+  mh_sha1_finalize(&ctx, fingerprint);
+  uint64_t hash = XXH3_64bits(fingerprint, sizeof(fingerprint));
+  return hash == 0 ? 1 : hash;
+}
+
+inline uint32_t slotOf(uint64_t cachedataLocation) {
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  return (cachedataLocation - geometry.getMetadataRegionSize()) / geometry.getSubchunkSize();
+}
+}  // namespace
+
+SubchunkDeduplicationModule &SubchunkDeduplicationModule::getInstance() {
+  static SubchunkDeduplicationModule instance;
+  return instance;
+}
+
+// One entry per FP slot, i.e. per subchunk the cache can hold
+SubchunkDeduplicationModule::SubchunkDeduplicationModule() {
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  nSlots_ = 1ull * geometry.getnFpBuckets() * geometry.getnFPSlotsPerBucket();
+  nSets_ = (nSlots_ + SUBCHUNK_INDEX_WAYS - 1) / SUBCHUNK_INDEX_WAYS;
+  entries_ = std::make_unique<Entry[]>(nSets_ * SUBCHUNK_INDEX_WAYS);
+  locks_ = std::make_unique<std::atomic<uint8_t>[]>(nSets_);
+  generations_ = std::make_unique<std::atomic<uint32_t>[]>(nSlots_);
+  for (uint64_t i = 0; i < nSets_ * SUBCHUNK_INDEX_WAYS; ++i) entries_[i].slot_ = ~0u;
+  for (uint64_t i = 0; i < nSets_; ++i) locks_[i].store(0, std::memory_order_relaxed);
+  for (uint64_t i = 0; i < nSlots_; ++i) generations_[i].store(0, std::memory_order_relaxed);
+  Stats::getInstance().set_subchunk_dedup_memory(getMemoryUsage());
+}
+
+bool SubchunkDeduplicationModule::eligible(const Chunk &chunk) {
+  return !chunk.bypassDedup_ && !Config::getInstance().isTraceReplayEnabled() &&
+         chunk.len_ == Config::getInstance().getChunkSize() &&
+         Config::getInstance().getMaxSubchunks() <= MAX_NUM_SUBCHUNK_REFS;
+}
+
+void SubchunkDeduplicationModule::dedup(Chunk &chunk) {
+  chunk.nSubchunkRefs_ = chunk.nDupSubchunks_ = 0;
+  if (!eligible(chunk)) return;
+  BEGIN_TIMER();
+  uint32_t subchunkSize = Config::getInstance().getSubchunkSize(), n = Config::getInstance().getMaxSubchunks();
+  uint32_t nDup = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    chunk.subchunkHashes_[i] = hashSubchunk(chunk.buf_ + i * subchunkSize, subchunkSize);
+    if (find(chunk.subchunkHashes_[i], chunk.subchunkLocations_[i], chunk.subchunkGenerations_[i])) {
+      ++nDup;
+    } else {
+      chunk.subchunkLocations_[i] = ~0ull;
+    }
+  }
+  Stats::getInstance().add_subchunk_dedup_stat(n, nDup);
+
+  // 有子块已缓存：只写入其余子块（不压缩，依次放入块自己的槽位），索引项至少占一个槽位
+  if (nDup != 0) {
+    uint32_t nNew = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      if (chunk.subchunkLocations_[i] != ~0ull) continue;
+      memcpy(chunk.compressedBuf_ + nNew * subchunkSize, chunk.buf_ + i * subchunkSize, subchunkSize);
+      ++nNew;
+    }
+    chunk.nSubchunkRefs_ = n;
+    chunk.nDupSubchunks_ = nDup;
+    chunk.compressedLen_ = 0;
+    chunk.nSubchunks_ = nNew == 0 ? 1 : nNew;
+  }
+  END_TIMER(subchunk_dedup);
+}
+
+void SubchunkDeduplicationModule::insert(Chunk &chunk) {
+  if (chunk.dedupResult_ != NOT_DUP) return;
+  BEGIN_TIMER();
+  uint32_t slot = slotOf(chunk.cachedataLocation_);
+  // Bumped before the slots are written, so that a reader of their old subchunks sees the change
+  for (uint32_t s = slot; s < slot + chunk.nSubchunks_; ++s) {
+    generations_[s].fetch_add(1, std::memory_order_seq_cst);
+  }
+  // Compressed subchunks cannot be read on their own
+  bool composite = chunk.nSubchunkRefs_ != 0;
+  if (eligible(chunk) && (composite || chunk.compressedBuf_ == chunk.buf_)) {
+    for (uint32_t i = 0; i < Config::getInstance().getMaxSubchunks(); ++i) {
+      if (composite && chunk.subchunkLocations_[i] != ~0ull) continue;
+      put(chunk.subchunkHashes_[i], slot++);
+    }
+  }
+  END_TIMER(subchunk_dedup);
+}
+
+bool SubchunkDeduplicationModule::resolve(Chunk &chunk) {
+  bool resolved = true;
+  BEGIN_TIMER();
+  const uint64_t *hashes = chunk.metadata_.getSubchunkHashes();
+  for (uint32_t i = 0; i < chunk.metadata_.nSubchunkRefs_ && resolved; ++i) {
+    chunk.subchunkHashes_[i] = hashes[i];
+    resolved = find(hashes[i], chunk.subchunkLocations_[i], chunk.subchunkGenerations_[i]);
+  }
+  chunk.nSubchunkRefs_ = resolved ? chunk.metadata_.nSubchunkRefs_ : 0;
+  Stats::getInstance().add_subchunk_resolve_stat(resolved);
+  END_TIMER(subchunk_dedup);
+  return resolved;
+}
+
+bool SubchunkDeduplicationModule::validate(const Chunk &chunk) {
+  for (uint32_t i = 0; i < chunk.nSubchunkRefs_; ++i) {
+    if (chunk.subchunkLocations_[i] == ~0ull) continue;
+    uint32_t slot = slotOf(chunk.subchunkLocations_[i]);
+    if (generations_[slot].load(std::memory_order_acquire) != chunk.subchunkGenerations_[i]) return false;
+  }
+  return true;
+}
+
+// A subchunk whose slot is reused while it is read compares as different. As for a chunk stored
+// whole, fake I/O only accounts the reads.
+bool SubchunkDeduplicationModule::compare(Chunk &chunk) {
+  if (chunk.len_ != Config::getInstance().getChunkSize()) return false;
+  bool same = true;
+  BEGIN_TIMER();
+  uint32_t subchunkSize = Config::getInstance().getSubchunkSize(), generation = 0;
+  const uint64_t *hashes = chunk.metadata_.getSubchunkHashes();
+  alignas(512) uint8_t cached[subchunkSize];
+  uint64_t location = 0;
+  for (uint32_t i = 0; i < chunk.metadata_.nSubchunkRefs_ && same; ++i) {
+    same = find(hashes[i], location, generation);
+    if (!same) break;
+    IOModule::getInstance().read(CACHE_DEVICE, location, cached, subchunkSize);
+    if (!Config::getInstance().isFakeIOEnabled()) {
+      same = memcmp(cached, chunk.buf_ + i * subchunkSize, subchunkSize) == 0;
+    }
+    same = same && generations_[slotOf(location)].load(std::memory_order_acquire) == generation;
+  }
+  END_TIMER(subchunk_dedup);
+  return same;
+}
+
+BucketLock SubchunkDeduplicationModule::lock(uint64_t set) {
+  if (Config::getInstance().isMultiThreadingEnabled()) {
+    return BucketLock(&locks_[set]);
+  } else {
+    return BucketLock();
+  }
+}
+
+// Hit: move the entry to the front of its set. Entries of reused slots are dropped.
+bool SubchunkDeduplicationModule::find(uint64_t hash, uint64_t &location, uint32_t &generation) {
+  uint64_t set = hash % nSets_;
+  BucketLock guard = lock(set);
+  Entry *ways = &entries_[set * SUBCHUNK_INDEX_WAYS];
+  for (uint32_t w = 0; w < SUBCHUNK_INDEX_WAYS && ways[w].slot_ != ~0u; ++w) {
+    if (ways[w].hash_ != hash) continue;
+    Entry entry = ways[w];
+    if (entry.generation_ != generations_[entry.slot_].load(std::memory_order_acquire)) {
+      memmove(ways + w, ways + w + 1, (SUBCHUNK_INDEX_WAYS - 1 - w) * sizeof(Entry));
+      ways[SUBCHUNK_INDEX_WAYS - 1].slot_ = ~0u;
+      return false;
+    }
+    memmove(ways + 1, ways, w * sizeof(Entry));
+    ways[0] = entry;
+    generation = entry.generation_;
+    location = FPIndex::computeCachedataLocation(entry.slot_ / HashGeometry::getInstance().getnFPSlotsPerBucket(),
+                                                 entry.slot_ % HashGeometry::getInstance().getnFPSlotsPerBucket());
+    return true;
+  }
+  return false;
+}
+
+// Insert at the front of the set (replacing the entry of the same hash), evicting the last way
+void SubchunkDeduplicationModule::put(uint64_t hash, uint32_t slot) {
+  uint64_t set = hash % nSets_;
+  BucketLock guard = lock(set);
+  Entry *ways = &entries_[set * SUBCHUNK_INDEX_WAYS];
+  uint32_t w = 0;
+  while (w < SUBCHUNK_INDEX_WAYS - 1 && ways[w].slot_ != ~0u && ways[w].hash_ != hash) ++w;
+  memmove(ways + 1, ways, w * sizeof(Entry));
+  ways[0] = {hash, slot, generations_[slot].load(std::memory_order_relaxed)};
+}
+}  // namespace cache
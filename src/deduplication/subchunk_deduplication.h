@@ -0,0 +1,77 @@
+#ifndef __SUBCHUNK_DEDUP_H__
+#define __SUBCHUNK_DEDUP_H__
+#include <atomic>
+#include <memory>
+
+#include "common/common.h"
+
+// Ways of a set of the subchunk index
+#define SUBCHUNK_INDEX_WAYS 8
+
+namespace cache {
+// Subchunk deduplication (Config::isSubchunkDedupEnabled).
+// A full chunk that is not duplicate as a whole has its subchunks fingerprinted one by one and
+// looked up in a subchunk-granular FP index, mapping the hash of a subchunk fingerprint to the
+// cache slot holding an uncompressed copy of the subchunk.
+//   1. If some subchunks are cached already, the chunk becomes a composite chunk: only its other
+//      subchunks are written (uncompressed, packed in its own slots), and its metadata lists the
+//      hashes of all of its subchunks (Metadata::getSubchunkHashes).
+//   2. The subchunks of composite chunks and of chunks stored uncompressed enter the index.
+//   3. A composite chunk is resolved to the locations of its subchunks on a read hit or a
+//      duplicate write; it is a miss (and is stored again) once one of its subchunks is gone.
+// Every FP slot has a generation, bumped whenever a chunk is stored in the slot: an entry is valid
+// while the generation of its slot is unchanged, so subchunks survive the eviction of the chunk
+// holding them until the slot is reused, and references do not pin anything. A composite chunk
+// read from the cache is therefore checked against the generations seen when it was resolved
+// once its subchunks are read (validate); a slot reused meanwhile makes the read a miss.
+// The index is set-associative (LRU sets, one spinlock per set).
+// Trace replay data is synthesized from the chunk fingerprint: its subchunks are not deduplicated.
+class SubchunkDeduplicationModule {
+  SubchunkDeduplicationModule();
+
+ public:
+  static SubchunkDeduplicationModule &getInstance();
+
+  // A not-duplicate chunk before compression: fingerprint its subchunks and make it composite
+  // when some of them are cached
+  void dedup(Chunk &chunk);
+  // A not-duplicate chunk once it has its cache slots: invalidate what the slots held, and index
+  // its subchunks
+  void insert(Chunk &chunk);
+  // A composite chunk (Metadata::nSubchunkRefs_ != 0) read or written again: locate its
+  // subchunks, false if one of them is no longer cached
+  bool resolve(Chunk &chunk);
+  // Whether the subchunks located by resolve (or dedup) are still in their slots
+  bool validate(const Chunk &chunk);
+  // Non-cryptographic chunk fingerprints: whether the data of the chunk is the one of the composite
+  // chunk of its metadata, byte by byte against its subchunks read from the cache; false if one
+  // of them is no longer cached
+  bool compare(Chunk &chunk);
+  uint64_t getMemoryUsage() {
+    return nSets_ * (SUBCHUNK_INDEX_WAYS * sizeof(Entry) + sizeof(uint8_t)) + nSlots_ * sizeof(uint32_t);
+  }
+
+ private:
+  // hash_: hash of the subchunk fingerprint, compared whole before the entry is trusted
+  // slot_: global FP slot (bucketId * nFPSlotsPerBucket + slotId) of the subchunk, ~0u if empty
+  // generation_: generation of the slot when the subchunk was stored (32 bits, so that a slot is
+  // not reused as many times as it takes the counter to come back between a lookup and its check)
+  struct Entry {
+    uint64_t hash_;
+    uint32_t slot_;
+    uint32_t generation_;
+  };
+
+  bool eligible(const Chunk &chunk);
+  bool find(uint64_t hash, uint64_t &location, uint32_t &generation);
+  void put(uint64_t hash, uint32_t slot);
+  BucketLock lock(uint64_t set);
+
+  uint64_t nSets_, nSlots_;
+  std::unique_ptr<Entry[]> entries_;
+  std::unique_ptr<std::atomic<uint8_t>[]> locks_;
+  std::unique_ptr<std::atomic<uint32_t>[]> generations_;
+};
+}  // namespace cache
+
+#endif
@@ -0,0 +1,79 @@
+#include "load_controller.h"
+
+#include "common/config.h"
+#include "common/hash_geometry.h"
+#include "common/stats.h"
+#include "utils/xxh3.h"
+
+namespace cache {
+LoadController &LoadController::getInstance() {
+  static LoadController instance;
+  return instance;
+}
+
+LoadController::LoadController()
+    : sketch_(1ull * HashGeometry::getInstance().getnFpBuckets() * HashGeometry::getInstance().getnFPSlotsPerBucket()),
+      bypassCompressibility_(Config::getInstance().getBypassCompressibility()),
+      bypassQueueDepth_(Config::getInstance().getBypassQueueDepth()),
+      level_(kNormal),
+      nInflight_(0),
+      nChunks_(0),
+      inflightSum_(0),
+      lastCpuTime_(0),
+      lastDeviceTime_(0) {}
+
+bool LoadController::bypassDedup(const Chunk &chunk) {
+  uint32_t level = level_.load(std::memory_order_relaxed);
+  if (level < kBypassCompression) return false;
+  // Trace replay: the data is synthetic, the trace fingerprint names the content
+  uint64_t key = chunk.traceFingerprint_ != nullptr
+                     ? XXH3_64bits(chunk.traceFingerprint_, TRACE_FINGERPRINT_LENGTH)
+                     : XXH3_64bits(chunk.buf_, chunk.len_);
+  uint32_t frequency = sketch_.record(key);
+  if (level < kBypassDedup || frequency >= LOAD_CONTROL_HOT_FREQUENCY) return false;
+  Stats::getInstance().add_bypass_dedup_stat();
+  return true;
+}
+
+bool LoadController::bypassCompression(const Chunk &chunk) {
+  if (level_.load(std::memory_order_relaxed) < kBypassCompression) return false;
+  if (chunk.compressibility >= bypassCompressibility_) return false;
+  Stats::getInstance().add_bypass_compression_stat();
+  return true;
+}
+
+void LoadController::record() {
+  inflightSum_.fetch_add(nInflight_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  if (nChunks_.fetch_add(1, std::memory_order_relaxed) + 1 == LOAD_CONTROL_WINDOW) {
+    evaluate();
+  }
+}
+
+// Only the thread completing a window gets here
+void LoadController::evaluate() {
+  Stats &stats = Stats::getInstance();
+  uint64_t cpuTime = stats._time_elapsed_fingerprinting + stats._time_elapsed_dedup + stats._time_elapsed_compression;
+  uint64_t deviceTime = stats._time_elapsed_io_ssd + stats._time_elapsed_io_pm;
+  double queueDepth = (double)inflightSum_.exchange(0, std::memory_order_relaxed) / LOAD_CONTROL_WINDOW;
+  nChunks_.fetch_sub(LOAD_CONTROL_WINDOW, std::memory_order_relaxed);
+
+  // Stats::reset() restarts the timers: skip the window
+  if (cpuTime < lastCpuTime_ || deviceTime < lastDeviceTime_) {
+    lastCpuTime_ = cpuTime, lastDeviceTime_ = deviceTime;
+    return;
+  }
+  uint64_t cpuDelta = cpuTime - lastCpuTime_, deviceDelta = deviceTime - lastDeviceTime_;
+  lastCpuTime_ = cpuTime, lastDeviceTime_ = deviceTime;
+
+  bool queueFull = queueDepth >= bypassQueueDepth_;
+  bool overloaded = queueFull && cpuDelta > deviceDelta;
+  uint32_t level = level_.load(std::memory_order_relaxed);
+  if (overloaded && level < kBypassDedup) {
+    ++level;
+  } else if ((!queueFull || 2 * cpuDelta < deviceDelta) && level > kNormal) {
+    --level;
+  }
+  level_.store(level, std::memory_order_relaxed);
+  stats.add_load_window_stat(overloaded, level);
+}
+}  // namespace cache
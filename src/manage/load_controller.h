@@ -0,0 +1,59 @@
+#ifndef __LOAD_CONTROLLER_H__
+#define __LOAD_CONTROLLER_H__
+
+#include <atomic>
+
+#include "common/common.h"
+#include "deduplication/selective_deduplication.h"
+
+// Number of chunks between two evaluations of the load
+#define LOAD_CONTROL_WINDOW 1024
+// Chunks whose data was seen less often than this recently are not deduplicated under overload
+#define LOAD_CONTROL_HOT_FREQUENCY 2
+
+namespace cache {
+// Load-adaptive bypass of deduplication and compression.
+// Every LOAD_CONTROL_WINDOW chunks the per-chunk time of the CPU stages (fingerprinting,
+// deduplication, compression) is compared with that of the devices (io_ssd, io_pm), both taken from
+// the Stats timers, and the average number of requests in flight with Config::getBypassQueueDepth.
+// When the CPU is the bottleneck and the queue is full, the bypass level is raised by one:
+//   1. chunks with a compressibility below Config::getBypassCompressibility are stored uncompressed;
+//   2. chunks of low predicted frequency also skip the cryptographic fingerprint and the FP index
+//      lookup, and are cached as unique chunks. The frequency is estimated by a FrequencySketch
+//      from a fast hash (XXH3) of the data, or of the trace fingerprint in trace replay; the
+//      sketch learns from level 1 on.
+// The level is lowered by one when the CPU stages take less than half of the device time, or the
+// queue is no longer full.
+class LoadController {
+  LoadController();
+
+ public:
+  enum Level { kNormal = 0, kBypassCompression = 1, kBypassDedup = 2 };
+
+  static LoadController &getInstance();
+
+  // Requests in flight, i.e. the queue depth seen by the cache
+  inline void enter() { nInflight_.fetch_add(1, std::memory_order_relaxed); }
+  inline void leave() { nInflight_.fetch_sub(1, std::memory_order_relaxed); }
+
+  // Decisions for a chunk about to be fingerprinted / compressed
+  bool bypassDedup(const Chunk &chunk);
+  bool bypassCompression(const Chunk &chunk);
+  // Account a deduplicated (or bypassed) chunk in the window
+  void record();
+
+ private:
+  void evaluate();
+
+  FrequencySketch sketch_;
+  double bypassCompressibility_;
+  uint32_t bypassQueueDepth_;
+
+  std::atomic<uint32_t> level_;
+  std::atomic<uint32_t> nInflight_;
+  std::atomic<uint64_t> nChunks_, inflightSum_;
+  uint64_t lastCpuTime_, lastDeviceTime_;
+};
+}  // namespace cache
+
+#endif  //__LOAD_CONTROLLER_H__
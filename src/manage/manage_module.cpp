@@ -3,6 +3,7 @@
 #include <cassert>
 
 #include "common/stats.h"
+#include "deduplication/subchunk_deduplication.h"
 #include "utils/utils.h"
 
 namespace cache {
@@ -37,6 +38,21 @@ int ManageModule::read(Chunk &chunk) {
   uint64_t addr;
   uint8_t *buf;
   uint32_t len;
+  // A composite chunk is read subchunk by subchunk from where each one is cached. The subchunk
+  // slots are not locked: if one was reused during the read, the chunk is read as a miss.
+  if (chunk.lookupResult_ == HIT && chunk.nSubchunkRefs_ != 0) {
+    uint32_t subchunkSize = Config::getInstance().getSubchunkSize();
+    for (uint32_t i = 0; i < chunk.nSubchunkRefs_; ++i) {
+      IOModule::getInstance().read(CACHE_DEVICE, chunk.subchunkLocations_[i], chunk.buf_ + i * subchunkSize,
+                                   subchunkSize);
+    }
+    if (SubchunkDeduplicationModule::getInstance().validate(chunk)) return 0;
+    chunk.fpBucketLock_.reset();
+    chunk.nSubchunkRefs_ = 0;
+    chunk.hitLBAIndex_ = chunk.hitFPIndex_ = false;
+    chunk.verficationResult_ = VERIFICATION_UNKNOWN;
+    chunk.lookupResult_ = NOT_HIT;
+  }
   generateReadRequest(chunk, deviceType, addr, buf, len);
   IOModule::getInstance().read(deviceType, addr, buf, len);
 
@@ -63,7 +79,8 @@ bool ManageModule::generatePrimaryWriteRequest(Chunk &chunk, DeviceType &deviceT
 bool ManageModule::generateCacheWriteRequest(Chunk &chunk, DeviceType &deviceType, uint64_t &addr, uint8_t *&buf,
                                              uint32_t &len) {
   deviceType = CACHE_DEVICE;
-  if (chunk.dedupResult_ == NOT_DUP) {
+  // A composite chunk whose subchunks are all cached already has no data to write
+  if (chunk.dedupResult_ == NOT_DUP && !(chunk.nSubchunkRefs_ != 0 && chunk.nDupSubchunks_ == chunk.nSubchunkRefs_)) {
     addr = chunk.cachedataLocation_;
     buf = chunk.compressedBuf_;
     len = (chunk.nSubchunks_) * Config::getInstance().getSubchunkSize();
@@ -89,4 +106,8 @@ int ManageModule::write(Chunk &chunk) {
 }
 
 void ManageModule::updateMetadata(Chunk &chunk) { MetadataModule::getInstance().update(chunk); }
+void ManageModule::invalidateMetadata(uint64_t addr) { MetadataModule::getInstance().invalidate(addr); }
+BucketLock ManageModule::lockMetadata(uint64_t addr) {
+  return MetadataModule::getInstance().lbaIndex_->lock(Chunk::computeLBAHash(addr));
+}
 }  // namespace cache
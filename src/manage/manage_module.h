@@ -16,6 +16,9 @@ class ManageModule {
   int read(Chunk &chunk);
   int write(Chunk &chunk);
   void updateMetadata(Chunk &chunk);
+  void invalidateMetadata(uint64_t addr);
+  // The LBA bucket lock of the chunk at addr, to hold across a read-modify-write of the chunk
+  BucketLock lockMetadata(uint64_t addr);
 
  private:
   ManageModule();
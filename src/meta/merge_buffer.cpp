@@ -0,0 +1,79 @@
+#include "merge_buffer.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "common/env.h"
+
+namespace cache {
+MergeBuffer::MergeBuffer(uint32_t capacity, uint32_t chunkSize) : capacity_(capacity), chunkSize_(chunkSize), size_(0) {
+  assert(capacity_ != 0 && chunkSize_ % kSectorSize == 0);
+}
+
+void MergeBuffer::write(uint64_t chunkAddr, uint64_t addr, const uint8_t *data, uint32_t len, double compressibility,
+                        const uint8_t *traceFingerprint, std::vector<uint64_t> &ready) {
+  assert(addr % kSectorSize == 0 && len % kSectorSize == 0);
+  assert(chunkAddr <= addr && addr + len <= chunkAddr + chunkSize_);
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = map_.find(chunkAddr);
+  if (it == map_.end()) {
+    // 缓冲区已满：最久未写的块先写出（由调用者取出，取出前缓冲区可暂时超出容量）
+    if (entries_.size() >= capacity_) ready.push_back(entries_.back().addr_);
+    entries_.emplace_front();
+    Entry &entry = entries_.front();
+    entry.addr_ = chunkAddr;
+    entry.data_.resize(chunkSize_);
+    entry.valid_.assign(chunkSize_ / kSectorSize, false);
+    entry.nValidSectors_ = 0;
+    map_[chunkAddr] = entries_.begin();
+  } else {
+    entries_.splice(entries_.begin(), entries_, it->second);
+  }
+
+  Entry &entry = entries_.front();
+  memcpy(entry.data_.data() + (addr - chunkAddr), data, len);
+  for (uint32_t s = (addr - chunkAddr) / kSectorSize; s < (addr - chunkAddr + len) / kSectorSize; ++s) {
+    if (!entry.valid_[s]) {
+      entry.valid_[s] = true;
+      ++entry.nValidSectors_;
+    }
+  }
+  entry.compressibility_ = compressibility;
+  if (traceFingerprint != nullptr) {
+    entry.traceFingerprint_.assign(traceFingerprint, traceFingerprint + TRACE_FINGERPRINT_LENGTH);
+  }
+  if (entry.isComplete()) ready.push_back(chunkAddr);
+  size_.store(entries_.size(), std::memory_order_relaxed);
+}
+
+bool MergeBuffer::take(uint64_t chunkAddr, Entry &entry) {
+  if (size_.load(std::memory_order_relaxed) == 0) return false;
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto it = map_.find(chunkAddr);
+  if (it == map_.end()) return false;
+  entry = std::move(*it->second);
+  entries_.erase(it->second);
+  map_.erase(it);
+  size_.store(entries_.size(), std::memory_order_relaxed);
+  return true;
+}
+
+bool MergeBuffer::contains(uint64_t chunkAddr) {
+  if (size_.load(std::memory_order_relaxed) == 0) return false;
+  std::lock_guard<std::mutex> guard(mutex_);
+  return map_.count(chunkAddr) != 0;
+}
+
+void MergeBuffer::discard(uint64_t chunkAddr) {
+  Entry entry;
+  take(chunkAddr, entry);
+}
+
+void MergeBuffer::drain(std::vector<Entry> &entries) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (auto &entry : entries_) entries.push_back(std::move(entry));
+  entries_.clear();
+  map_.clear();
+  size_.store(0, std::memory_order_relaxed);
+}
+}  // namespace cache
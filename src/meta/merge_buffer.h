@@ -0,0 +1,64 @@
+#ifndef __MERGE_BUFFER_H__
+#define __MERGE_BUFFER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cache {
+// Write merge buffer of partial chunk writes (Config::getMergeBufferSize chunks).
+// A write covering only part of a chunk is staged here, sector by sector, instead of being merged
+// right away with the current data of the chunk (read-modify-write). A staged chunk is handed back
+// to be written as a whole:
+//   1. once all of its sectors are written: no read is needed;
+//   2. otherwise when it is the least recently written chunk of a full buffer, when it is read,
+//      or when the buffer is drained: its missing sectors are read first.
+// A full chunk write supersedes the staged data of the chunk (discard).
+// A chunk to write stays staged until its writer takes it under the lock of the chunk: what is
+// written to a chunk meanwhile joins the same entry, so that its writes are not reordered.
+class MergeBuffer {
+ public:
+  static const uint32_t kSectorSize = 512;
+
+  struct Entry {
+    uint64_t addr_;  // chunk-aligned
+    std::vector<uint8_t> data_;
+    std::vector<bool> valid_;  // per sector
+    uint32_t nValidSectors_;
+    double compressibility_;
+    // Trace replay: the fingerprint given with the last write, empty if none
+    std::vector<uint8_t> traceFingerprint_;
+
+    bool isComplete() const { return nValidSectors_ == valid_.size(); }
+  };
+
+  MergeBuffer(uint32_t capacity, uint32_t chunkSize);
+
+  // Stage data[0, len) at addr, inside the chunk at chunkAddr (sector-aligned). The addresses of
+  // the chunks to write now (the chunk if complete, the evicted one) are appended to ready.
+  void write(uint64_t chunkAddr, uint64_t addr, const uint8_t *data, uint32_t len, double compressibility,
+             const uint8_t *traceFingerprint, std::vector<uint64_t> &ready);
+  // Remove the chunk at chunkAddr: false if it is not staged
+  bool take(uint64_t chunkAddr, Entry &entry);
+  // Whether the chunk at chunkAddr is staged: the caller locks the chunk only then, and takes it
+  bool contains(uint64_t chunkAddr);
+  void discard(uint64_t chunkAddr);
+  bool empty() const { return size_.load(std::memory_order_relaxed) == 0; }
+  // Remove all chunks
+  void drain(std::vector<Entry> &entries);
+
+ private:
+  uint32_t capacity_, chunkSize_;
+  // Most recently written first
+  std::list<Entry> entries_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> map_;
+  // Number of staged chunks, read without the lock: I/O to other chunks skips the buffer when empty
+  std::atomic<uint32_t> size_;
+  std::mutex mutex_;
+};
+}  // namespace cache
+
+#endif  //__MERGE_BUFFER_H__
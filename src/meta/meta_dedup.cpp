@@ -6,19 +6,42 @@
 #include <cassert>
 #include <chrono>
 #include <csignal>
+#include <cstring>
 #include <thread>
 #include <vector>
 
+#include "chunking/pattern_detection.h"
 #include "common/config.h"
 #include "common/env.h"
+#include "common/hash_geometry.h"
+#include "deduplication/subchunk_deduplication.h"
+#include "manage/load_controller.h"
 
 namespace cache {
 Meta::Meta() {
   IOModule::getInstance().addPrimaryDevice(Config::getInstance().getPrimaryDeviceName());
   IOModule::getInstance().addCacheDevice(Config::getInstance().getCacheDeviceName());
+  if (Config::getInstance().getMergeBufferSize() != 0 && !Config::getInstance().isContentDefinedChunkingEnabled()) {
+    mergeBuffer_ = std::make_unique<MergeBuffer>(Config::getInstance().getMergeBufferSize(),
+                                                 Config::getInstance().getChunkSize());
+  }
+  if (Config::getInstance().isPatternChunkFastPathEnabled()) {
+    // 回放 trace 时数据由 trace 指纹合成，块内容以 trace 指纹为准；LBA 索引值的签名需容纳一个字节
+    patternChunks_ = !Config::getInstance().isTraceReplayEnabled() && HashGeometry::getInstance().canEncodePattern();
+    std::cout << "Pattern chunks: " << (patternChunks_ ? PatternDetection::getKernelName() : "disabled")
+              << std::endl;
+  }
 }
 
 Meta::~Meta() {
+  if (mergeBuffer_ != nullptr) {
+    std::vector<MergeBuffer::Entry> entries;
+    mergeBuffer_->drain(entries);
+    for (auto &entry : entries) {
+      BucketLock lbaBucketLock = ManageModule::getInstance().lockMetadata(entry.addr_);
+      writeMerged(entry, lbaBucketLock);
+    }
+  }
   Stats::getInstance().dump();
   Stats::getInstance().release();
   Config::getInstance().release();
@@ -28,31 +51,222 @@ Meta::~Meta() {
   std::cout << std::fixed << "VM: " << vm << "; RSS: " << rss << std::endl;
 }
 
-void Meta::read(uint64_t addr, void *buf, uint32_t len) {
+void Meta::read(uint64_t addr, void *buf, uint32_t len, const uint8_t *fingerprint) {
   Stats::getInstance().setCurrentRequestType(0);  // read
+  bool loadAdaptive = Config::getInstance().isLoadAdaptiveBypassEnabled();
+  if (loadAdaptive) LoadController::getInstance().enter();
+  if (Config::getInstance().isContentDefinedChunkingEnabled()) {
+    readContentDefined(addr, (uint8_t *)buf, len);
+    if (loadAdaptive) LoadController::getInstance().leave();
+    return;
+  }
   Chunker chunker = ChunkModule::getInstance().createChunker(addr, buf, len);
 
   alignas(512) Chunk chunk;
+  uint32_t chunkSize = Config::getInstance().getChunkSize();
   while (chunker.next(chunk)) {
+    chunk.traceFingerprint_ = chunk.addr_ == addr ? fingerprint : nullptr;
+    // 合并缓冲区中暂存的写先写出，读才能看到
+    if (mergeBuffer_ != nullptr) flushMerged(chunk.addr_ & ~(uint64_t)(chunkSize - 1));
+    if (chunk.len_ != chunkSize) {
+      readPartial(chunk);
+      continue;
+    }
     internalRead(chunk);
     chunk.fpBucketLock_.reset();
     chunk.lbaBucketLock_.reset();
   }
+  if (loadAdaptive) LoadController::getInstance().leave();
 }
 
-void Meta::write(uint64_t addr, void *buf, uint32_t len, double cb) {
+void Meta::write(uint64_t addr, void *buf, uint32_t len, double cb, const uint8_t *fingerprint) {
   Stats::getInstance().setCurrentRequestType(1);  // write
-  Chunker chunker = ChunkModule::getInstance().createChunker(addr, buf, len);
-  alignas(512) Chunk c;
+  bool loadAdaptive = Config::getInstance().isLoadAdaptiveBypassEnabled();
+  if (loadAdaptive) LoadController::getInstance().enter();
+  bool contentDefined = Config::getInstance().isContentDefinedChunkingEnabled();
+  std::vector<uint64_t> droppedChunks;
+  Chunker chunker = contentDefined
+                        ? ChunkModule::getInstance().createContentDefinedChunker(addr, buf, len, droppedChunks)
+                        : ChunkModule::getInstance().createChunker(addr, buf, len);
+  // 被替换或移出 extent map 的内容定义块不会再被读到，其 LBA 索引项一并删除
+  for (uint64_t chunkAddr : droppedChunks) ManageModule::getInstance().invalidateMetadata(chunkAddr);
+  bool batching = Config::getInstance().isFingerprintBatchingEnabled();
+  uint32_t batchSize = batching ? FINGERPRINT_BATCH_SIZE : 1, n;
+  uint32_t chunkSize = Config::getInstance().getChunkSize();
+  alignas(512) Chunk chunks[FINGERPRINT_BATCH_SIZE];
+
+  // 多块写请求的指纹按批计算（sha1_mb），其余步骤仍逐块进行
+  do {
+    n = 0;
+    while (n < batchSize && chunker.next(chunks[n])) {
+      Chunk &c = chunks[n];
+      c.compressibility = cb;
+      c.traceFingerprint_ = c.addr_ == addr && !contentDefined ? fingerprint : nullptr;
+      // 定长分块的不完整块：与块的现有数据合并后再写，不进入本批
+      if (!contentDefined && c.len_ != chunkSize) {
+        writePartial(c);
+        continue;
+      }
+      // 整块写覆盖了暂存的部分写
+      if (mergeBuffer_ != nullptr) mergeBuffer_->discard(c.addr_);
+      // 模式块不计算指纹，不进入本批
+      if (batching && writePattern(c)) {
+        c.lbaBucketLock_.reset();
+        continue;
+      }
+      if (batching && loadAdaptive) c.bypassDedup_ = LoadController::getInstance().bypassDedup(c);
+      ++n;
+    }
+    if (batching && n != 0) Chunk::computeFingerprints(chunks, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      internalWrite(chunks[i]);
+      chunks[i].fpBucketLock_.reset();
+      chunks[i].lbaBucketLock_.reset();
+    }
+  } while (n == batchSize);
+  if (loadAdaptive) LoadController::getInstance().leave();
+}
+
+// Content-defined chunks are located by the extent map of ChunkModule. Each chunk overlapping
+// the request is read whole into a temporary buffer (a miss fills the cache with it as usual),
+// and the overlap is copied out; the bytes not covered by any chunk come from the primary device.
+void Meta::readContentDefined(uint64_t addr, uint8_t *buf, uint32_t len) {
+  std::vector<std::pair<uint64_t, uint32_t>> extents;
+  ChunkModule::getInstance().findChunks(addr, len, extents);
+
+  alignas(512) uint8_t chunkBuf[Config::getInstance().getChunkSize()];
+  alignas(512) Chunk chunk;
+  uint64_t pos = addr, end = addr + len;
+  for (const auto &extent : extents) {
+    uint64_t start = extent.first, chunkEnd = extent.first + extent.second;
+    if (pos < start) {
+      IOModule::getInstance().read(PRIMARY_DEVICE, pos, buf + (pos - addr), start - pos);
+      pos = start;
+    }
+    Chunker chunker(start, chunkBuf, extent.second, {extent.second});
+    chunker.next(chunk);
+    internalRead(chunk);
+    chunk.fpBucketLock_.reset();
+    chunk.lbaBucketLock_.reset();
 
-  while (chunker.next(c)) {
-    c.compressibility = cb;
-    internalWrite(c);
-    c.fpBucketLock_.reset();
-    c.lbaBucketLock_.reset();
+    uint64_t copyEnd = chunkEnd < end ? chunkEnd : end;
+    memcpy(buf + (pos - addr), chunkBuf + (pos - start), copyEnd - pos);
+    pos = copyEnd;
+  }
+  if (pos < end) {
+    IOModule::getInstance().read(PRIMARY_DEVICE, pos, buf + (pos - addr), end - pos);
   }
 }
 
+// A partial read is served from the whole chunk, read into a temporary buffer (and cached on a miss
+// as usual).
+void Meta::readPartial(Chunk &chunk) {
+  uint32_t chunkSize = Config::getInstance().getChunkSize();
+  uint64_t chunkAddr = chunk.addr_ & ~(uint64_t)(chunkSize - 1);
+  alignas(512) uint8_t chunkBuf[chunkSize];
+  alignas(512) Chunk whole;
+  Chunker chunker(chunkAddr, chunkBuf, chunkSize);
+  chunker.next(whole);
+  whole.traceFingerprint_ = chunk.traceFingerprint_;
+  internalRead(whole);
+  whole.fpBucketLock_.reset();
+  whole.lbaBucketLock_.reset();
+  memcpy(chunk.buf_, chunkBuf + (chunk.addr_ - chunkAddr), chunk.len_);
+  Stats::getInstance().add_partial_io_stat(false);
+}
+
+// A partial write is staged in the merge buffer if any, otherwise merged with the current data of
+// the chunk right away (read-modify-write).
+void Meta::writePartial(Chunk &chunk) {
+  uint32_t chunkSize = Config::getInstance().getChunkSize();
+  uint64_t chunkAddr = chunk.addr_ & ~(uint64_t)(chunkSize - 1);
+  Stats::getInstance().add_partial_io_stat(true);
+  if (mergeBuffer_ != nullptr) {
+    std::vector<uint64_t> ready;
+    mergeBuffer_->write(chunkAddr, chunk.addr_, chunk.buf_, chunk.len_, chunk.compressibility,
+                        chunk.traceFingerprint_, ready);
+    for (uint64_t readyAddr : ready) flushMerged(readyAddr);
+    return;
+  }
+  alignas(512) uint8_t chunkBuf[chunkSize];
+  BucketLock lbaBucketLock = ManageModule::getInstance().lockMetadata(chunkAddr);
+  readForUpdate(chunkAddr, chunkBuf, lbaBucketLock);
+  memcpy(chunkBuf + (chunk.addr_ - chunkAddr), chunk.buf_, chunk.len_);
+  writeWhole(chunkAddr, chunkBuf, chunk.compressibility, chunk.traceFingerprint_, lbaBucketLock);
+}
+
+// A chunk leaving the merge buffer (complete, evicted, read or drained), taken under the LBA bucket
+// lock of the chunk (lbaBucketLock): the sectors it lacks are read first, under the same lock
+void Meta::writeMerged(MergeBuffer::Entry &entry, BucketLock &lbaBucketLock) {
+  uint32_t chunkSize = Config::getInstance().getChunkSize();
+  alignas(512) uint8_t chunkBuf[chunkSize];
+  bool complete = entry.isComplete();
+  if (complete) {
+    memcpy(chunkBuf, entry.data_.data(), chunkSize);
+  } else {
+    readForUpdate(entry.addr_, chunkBuf, lbaBucketLock);
+    for (uint32_t s = 0; s < entry.valid_.size(); ++s) {
+      if (!entry.valid_[s]) continue;
+      uint32_t e = s;
+      while (e < entry.valid_.size() && entry.valid_[e]) ++e;
+      memcpy(chunkBuf + s * MergeBuffer::kSectorSize, entry.data_.data() + s * MergeBuffer::kSectorSize,
+             (e - s) * MergeBuffer::kSectorSize);
+      s = e;
+    }
+  }
+  writeWhole(entry.addr_, chunkBuf, entry.compressibility_,
+             entry.traceFingerprint_.empty() ? nullptr : entry.traceFingerprint_.data(), lbaBucketLock);
+  Stats::getInstance().add_merged_write_stat(complete);
+}
+
+void Meta::flushMerged(uint64_t chunkAddr) {
+  if (!mergeBuffer_->contains(chunkAddr)) return;
+  MergeBuffer::Entry entry;
+  BucketLock lbaBucketLock = ManageModule::getInstance().lockMetadata(chunkAddr);
+  if (mergeBuffer_->take(chunkAddr, entry)) writeMerged(entry, lbaBucketLock);
+}
+
+// The current data of a chunk about to be partially overwritten: from the cache on a hit, else
+// from the primary device. The cache is not filled, the chunk is written again right after.
+void Meta::readForUpdate(uint64_t addr, uint8_t *buf, BucketLock &lbaBucketLock) {
+  uint32_t chunkSize = Config::getInstance().getChunkSize();
+  alignas(512) uint8_t compressedBuf[chunkSize];
+  alignas(512) Chunk chunk;
+  Chunker chunker(addr, buf, chunkSize);
+  chunker.next(chunk);
+  chunk.compressedBuf_ = compressedBuf;
+  chunk.lbaBucketLock_ = std::move(lbaBucketLock);
+
+  DeduplicationModule::lookup(chunk);
+  if (chunk.patternChunk_) {
+    memset(chunk.buf_, HashGeometry::getInstance().getPatternByte(chunk.fingerprintHash_), chunk.len_);
+  } else {
+    ManageModule::getInstance().read(chunk);
+    if (!DeduplicationModule::revalidate(chunk)) {
+      ManageModule::getInstance().read(chunk);
+    }
+    if (chunk.lookupResult_ == HIT) {
+      CompressionModule::decompress(chunk);
+    }
+  }
+  Stats::getInstance().add_update_read_stat(chunk.lookupResult_ == HIT);
+  chunk.fpBucketLock_.reset();
+  lbaBucketLock = std::move(chunk.lbaBucketLock_);
+}
+
+void Meta::writeWhole(uint64_t addr, uint8_t *buf, double compressibility, const uint8_t *fingerprint,
+                      BucketLock &lbaBucketLock) {
+  alignas(512) Chunk chunk;
+  Chunker chunker(addr, buf, Config::getInstance().getChunkSize());
+  chunker.next(chunk);
+  chunk.compressibility = compressibility;
+  chunk.traceFingerprint_ = fingerprint;
+  chunk.lbaBucketLock_ = std::move(lbaBucketLock);
+  internalWrite(chunk);
+  chunk.fpBucketLock_.reset();
+  chunk.lbaBucketLock_.reset();
+}
+
 void Meta::internalRead(Chunk &chunk) {
   alignas(512) uint8_t compressedBuf[Config::getInstance().getChunkSize()];
   chunk.compressedBuf_ = compressedBuf;
@@ -61,16 +275,45 @@ void Meta::internalRead(Chunk &chunk) {
   // {
   //   Stats::getInstance().addReadLookupStatistics(chunk);
   // }
+  // 模式块命中：按 LBA 索引值中的字节填充，不读设备
+  if (chunk.patternChunk_) {
+    memset(chunk.buf_, HashGeometry::getInstance().getPatternByte(chunk.fingerprintHash_), chunk.len_);
+    ManageModule::getInstance().updateMetadata(chunk);
+    Stats::getInstance().add_pattern_read_stat(chunk, true);
+    return;
+  }
   ManageModule::getInstance().read(chunk);
+  // 乐观查找的命中在读完数据后加锁确认，缓存项已被替换则改为从主存储读取
+  if (!DeduplicationModule::revalidate(chunk)) {
+    ManageModule::getInstance().read(chunk);
+  }
   if (chunk.lookupResult_ == HIT) {
     CompressionModule::decompress(chunk);
   }
 
   if (chunk.lookupResult_ == NOT_HIT) {
+    // 从主存储读出的模式块只记入 LBA 索引，不缓存
+    if (detectPattern(chunk)) {
+      ManageModule::getInstance().updateMetadata(chunk);
+      Stats::getInstance().add_pattern_read_stat(chunk, false);
+      return;
+    }
+    bool loadAdaptive = Config::getInstance().isLoadAdaptiveBypassEnabled();
+    if (loadAdaptive) chunk.bypassDedup_ = LoadController::getInstance().bypassDedup(chunk);
     chunk.computeFingerprint();
     CompressionModule::compress(chunk);
     DeduplicationModule::dedup(chunk);
+    if (loadAdaptive) LoadController::getInstance().record();
+    bool subchunkDedup = Config::getInstance().isSubchunkDedupEnabled() && chunk.dedupResult_ == NOT_DUP;
+    if (subchunkDedup) {
+      // 压缩后 compressedBuf_ 可能指向 buf_：子块去重改用本地缓冲区存放新子块
+      uint8_t *compressed = chunk.compressedBuf_;
+      chunk.compressedBuf_ = compressedBuf;
+      SubchunkDeduplicationModule::getInstance().dedup(chunk);
+      if (chunk.nSubchunkRefs_ == 0) chunk.compressedBuf_ = compressed;
+    }
     ManageModule::getInstance().updateMetadata(chunk);
+    if (subchunkDedup) SubchunkDeduplicationModule::getInstance().insert(chunk);
     if (chunk.dedupResult_ == NOT_DUP) {
       ManageModule::getInstance().write(chunk);
     }
@@ -81,17 +324,56 @@ void Meta::internalRead(Chunk &chunk) {
 }
 
 void Meta::internalWrite(Chunk &chunk) {
+  // Batched writes were checked for patterns before their fingerprints were computed
+  if (!chunk.hasFingerprint_ && writePattern(chunk)) return;
   // chunk.lookupResult_ = LOOKUP_UNKNOWN;
   alignas(512) uint8_t tempBuf[Config::getInstance().getChunkSize()];
   chunk.compressedBuf_ = tempBuf;
-  chunk.computeFingerprint();
+  bool loadAdaptive = Config::getInstance().isLoadAdaptiveBypassEnabled();
+  // Batched writes come with their fingerprints
+  if (!chunk.hasFingerprint_) {
+    if (loadAdaptive) chunk.bypassDedup_ = LoadController::getInstance().bypassDedup(chunk);
+    chunk.computeFingerprint();
+  }
   DeduplicationModule::dedup(chunk);
-  if (chunk.dedupResult_ == NOT_DUP) {  // 唯一块需要压缩
+  if (loadAdaptive) LoadController::getInstance().record();
+  bool subchunkDedup = Config::getInstance().isSubchunkDedupEnabled() && chunk.dedupResult_ == NOT_DUP;
+  if (subchunkDedup) SubchunkDeduplicationModule::getInstance().dedup(chunk);
+  if (chunk.dedupResult_ == NOT_DUP && chunk.nSubchunkRefs_ == 0) {  // 唯一块需要压缩（组合块的新子块不压缩）
     CompressionModule::compress(chunk);
   }
   ManageModule::getInstance().updateMetadata(chunk);
+  if (subchunkDedup) SubchunkDeduplicationModule::getInstance().insert(chunk);
+  ManageModule::getInstance().write(chunk);
+  Stats::getInstance().add_write_stat(chunk);
+}
+
+bool Meta::detectPattern(Chunk &chunk) {
+  if (!patternChunks_) return false;
+  uint8_t byte = 0;
+  bool pattern;
+  BEGIN_TIMER();
+  pattern = PatternDetection::detect(chunk.buf_, chunk.len_, byte);
+  END_TIMER(pattern_detection);
+  if (pattern) {
+    chunk.patternChunk_ = true;
+    chunk.fingerprintHash_ = HashGeometry::getInstance().getPatternFpHash(byte);
+  }
+  return pattern;
+}
+
+// No fingerprint, compression, FP index slot, metadata or cached data: the LBA index entry names
+// the content. A write-through cache still writes the chunk to the primary device.
+// In the write stats the chunk is a duplicate: its content takes no cache space.
+bool Meta::writePattern(Chunk &chunk) {
+  if (!detectPattern(chunk)) return false;
+  chunk.dedupResult_ = DUP_CONTENT;
+  ManageModule::getInstance().updateMetadata(chunk);
   ManageModule::getInstance().write(chunk);
+  uint8_t byte = HashGeometry::getInstance().getPatternByte(chunk.fingerprintHash_);
+  Stats::getInstance().add_pattern_write_stat(chunk, byte);
   Stats::getInstance().add_write_stat(chunk);
+  return true;
 }
 
 }  // namespace cache
\ No newline at end of file
@@ -16,6 +16,7 @@
 #include "compression/compression_module.h"
 #include "deduplication/deduplication_module.h"
 #include "manage/manage_module.h"
+#include "merge_buffer.h"
 #include "utils/thread_pool.h"
 
 namespace cache {
@@ -23,8 +24,9 @@ class Meta {
  public:
   Meta();
   ~Meta();
-  void read(uint64_t addr, void *buf, uint32_t len);
-  void write(uint64_t addr, void *buf, uint32_t len, double compressibility);
+  // fingerprint: in trace replay, the fingerprint the trace gives for the chunk at addr
+  void read(uint64_t addr, void *buf, uint32_t len, const uint8_t *fingerprint = nullptr);
+  void write(uint64_t addr, void *buf, uint32_t len, double compressibility, const uint8_t *fingerprint = nullptr);
   inline void resetStatistics() { stats_->reset(); }
   inline void dumpStatistics() { stats_->dump(); }
 
@@ -64,10 +66,28 @@ class Meta {
   }
 
  private:
+  void readContentDefined(uint64_t addr, uint8_t *buf, uint32_t len);
+  // Fixed-size chunking: chunks covering part of a chunk (unaligned or short requests)
+  void readPartial(Chunk &chunk);
+  void writePartial(Chunk &chunk);
+  void writeMerged(MergeBuffer::Entry &entry, BucketLock &lbaBucketLock);
+  void flushMerged(uint64_t chunkAddr);
+  // A read-modify-write holds the LBA bucket lock of the chunk (lbaBucketLock) from the read to
+  // the end of the write, so that no other write to the chunk comes in between
+  void readForUpdate(uint64_t addr, uint8_t *buf, BucketLock &lbaBucketLock);
+  void writeWhole(uint64_t addr, uint8_t *buf, double compressibility, const uint8_t *fingerprint,
+                  BucketLock &lbaBucketLock);
   void internalRead(Chunk &chunk);
   void internalWrite(Chunk &chunk);
+  // Pattern chunks (PatternDetection) are recorded in the LBA index only
+  bool detectPattern(Chunk &chunk);
+  bool writePattern(Chunk &chunk);
 
   Stats *stats_;
+  // nullptr if Config::getMergeBufferSize is 0 (or with content-defined chunking)
+  std::unique_ptr<MergeBuffer> mergeBuffer_;
+  // Config::isPatternChunkFastPathEnabled, unless the data cannot name the chunks (trace replay)
+  bool patternChunks_ = false;
 };
 }  // namespace cache
 
@@ -7,6 +7,12 @@
 #include <memory>
 
 #include "utils/utils.h"
+
+// getBits/storeBits issue one unaligned 8-byte load at the first byte of a field
+// (little-endian), so every bitmap must be followed by BITMAP_TAIL_PADDING readable bytes.
+#define BITMAP_TAIL_PADDING 8u
+#define BITMAP_MAX_FIELD_BITS 57u
+
 namespace cache {
 class Bitmap {
  public:
@@ -18,53 +24,33 @@ class Bitmap {
 
     void clear(uint32_t index) { data_[index >> 3u] &= ~(1u << (index & 7u)); }
 
-    inline void storeBits(uint32_t b, uint32_t e, uint32_t v) {
-      uint32_t base = b >> 3u, base_e = e >> 3u;
-      uint32_t shift_b = b & 7u, shift_e = e & 7u;
-      if (base == base_e) {
-        data_[base] &= ((1u << shift_b) - 1) | (~((1u << shift_e) - 1));
-        data_[base] |= v << shift_b;
-      } else {
-        if (shift_b) {
-          data_[base] &= (1u << shift_b) - 1;
-          data_[base] |= (v << shift_b) & 0xffu;
-          v >>= (8 - shift_b);
-          ++base;
-        }
-        while (base < base_e) {
-          data_[base] = v & 0xffu;
-          v >>= 8u;
-          ++base;
-        }
-        if (shift_e) {
-          data_[base] &= ~((1u << shift_e) - 1);
-          data_[base] |= v;
-        }
+    // Fields are at most BITMAP_MAX_FIELD_BITS wide, so a field together with its bit
+    // offset in its first byte fits in the 64-bit word loaded at that byte.
+    inline void storeBits(uint32_t b, uint32_t e, uint64_t v) {
+      uint8_t *p = data_ + (b >> 3u);
+      uint32_t shift = b & 7u, nBytes = (shift + e - b + 7) >> 3u;
+      uint64_t mask = ((1ull << (e - b)) - 1) << shift, w;
+      memcpy(&w, p, sizeof(w));
+      w = (w & ~mask) | ((v << shift) & mask);
+      // Only the bytes covering the field are written back: the following bytes
+      // may belong to another bucket, guarded by another lock.
+      if (nBytes >= 4) {
+        uint32_t lo = w, hi = w >> ((nBytes - 4) * 8);
+        memcpy(p, &lo, sizeof(lo));
+        memcpy(p + nBytes - 4, &hi, sizeof(hi));
+      } else if (nBytes >= 2) {
+        uint16_t lo = w, hi = w >> ((nBytes - 2) * 8);
+        memcpy(p, &lo, sizeof(lo));
+        memcpy(p + nBytes - 2, &hi, sizeof(hi));
+      } else if (nBytes == 1) {
+        *p = w;
       }
     }
 
-    inline uint32_t getBits(uint32_t b, uint32_t e) {
-      uint32_t v = 0;
-      uint32_t base = b >> 3u, base_e = e >> 3u;
-      uint32_t shift_b = b & 7u, shift_e = e & 7u;
-      if (base == base_e) {
-        v = data_[base] & ~(((1u << shift_b) - 1) | (~((1u << shift_e) - 1)));
-        v >>= shift_b;
-      } else {
-        uint32_t shift = 0;
-        if (shift_b) {
-          v |= data_[base] >> shift_b;
-          shift += (8 - shift_b);
-          ++base;
-        }
-        while (base < base_e) {
-          v |= data_[base] << shift;
-          shift += 8;
-          ++base;
-        }
-        v |= (data_[base] & ((1u << shift_e) - 1)) << shift;
-      }
-      return v;
+    inline uint64_t getBits(uint32_t b, uint32_t e) {
+      uint64_t w;
+      memcpy(&w, data_ + (b >> 3u), sizeof(w));
+      return (w >> (b & 7u)) & ((1ull << (e - b)) - 1);
     }
 
     inline uint32_t get32bits(uint32_t index) { return getBits(index * 32, (index + 1) * 32); }
@@ -72,8 +58,8 @@ class Bitmap {
 
     uint8_t *data_;
   };
-  explicit Bitmap(uint32_t nBits) : nBits_(nBits), data_(std::make_unique<uint8_t[]>((nBits_ + 7) / 8)) {
-    memset(data_.get(), 0, (nBits_ + 7) / 8);
+  explicit Bitmap(uint32_t nBits) : nBits_(nBits), data_(std::make_unique<uint8_t[]>((nBits_ + 7) / 8 + BITMAP_TAIL_PADDING)) {
+    memset(data_.get(), 0, (nBits_ + 7) / 8 + BITMAP_TAIL_PADDING);
   }
 
   Manipulator getManipulator() { return Manipulator(data_.get()); }
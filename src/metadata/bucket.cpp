@@ -11,44 +11,46 @@
 #include "reference_counter.h"
 
 namespace cache {
-Bucket::Bucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nSlots, uint8_t *data, uint8_t *valid,
-               CachePolicy *cachePolicy, uint32_t slotId)
-    : nBitsPerKey_(nBitsPerKey),
-      nBitsPerValue_(nBitsPerValue),
+Bucket::Bucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nBytesPerKey, uint32_t nBytesPerValue,
+               uint32_t nSlots, uint8_t *data, uint8_t *valid, CachePolicy *cachePolicy, uint32_t slotId,
+               BucketHeader *header, SignatureScanner::MatchFunc match)
+    : data_(data),
+      valid_(valid),
+      header_(header),
+      match_(match),
       nBitsPerSlot_(nBitsPerKey + nBitsPerValue),
       nSlots_(nSlots),
-      data_(data),
-      valid_(valid),
+      nBitsPerKey_(nBitsPerKey),
+      nBitsPerValue_(nBitsPerValue),
+      nBytesPerKey_(nBytesPerKey),
+      nBytesPerValue_(nBytesPerValue),
       bucketId_(slotId) {
+  values_ = nBytesPerValue_ ? data + getValueArrayOffset(nBytesPerKey_, nBytesPerValue_, nSlots_) : nullptr;
+  policyData_ = valid + (nSlots_ + 7) / 8;
   if (cachePolicy != nullptr) {
-    cachePolicyExecutor_ = cachePolicy->getExecutor(this);
+    cachePolicyExecutor_ = cachePolicy->getExecutor();
   } else {
     cachePolicyExecutor_ = nullptr;
   }
 }
 
-Bucket::~Bucket() {
-  if (cachePolicyExecutor_ != nullptr) {
-    free(cachePolicyExecutor_);
-  }
-}
+Bucket::~Bucket() = default;
 
 uint32_t LBABucket::lookup(uint32_t lbaSignature, uint64_t &fpHash) {
-  for (uint32_t slotId = 0; slotId < nSlots_; slotId++) {
-    if (!isValid(slotId)) continue;
-    uint32_t _lbaSignature = getKey(slotId);
-    if (_lbaSignature == lbaSignature) {
-      fpHash = getValue(slotId);
-      return slotId;
-    }
+  uint64_t mask[MAX_NUM_SLOTS_PER_BUCKET / 64];
+  if (isEmpty()) return ~((uint32_t)0);
+  matchKeys(lbaSignature, mask);
+  uint32_t slotId = SignatureScanner::findFirst(mask, nSlots_);
+  if (slotId != ~((uint32_t)0)) {
+    fpHash = getValue(slotId);
   }
-  return ~((uint32_t)0);
+  return slotId;
 }
 
 void LBABucket::promote(uint32_t lbaSignature) {
   uint64_t fingerprintHash = 0;
   uint32_t slotId = lookup(lbaSignature, fingerprintHash);
-  cachePolicyExecutor_->promote(slotId);
+  cachePolicyExecutor_->promote(this, slotId);
 }
 
 // If the request modified an existing chunk,
@@ -64,25 +66,39 @@ uint64_t LBABucket::update(uint32_t lbaSignature, uint64_t fingerprintHash, std:
     } else {
       setEvictedSignature(getValue(slotId));
       if (Config::getInstance().getCachePolicyForFPIndex() == CachePolicyEnum::tRecencyAwareLeastReferenceCount &&
-          slotId >= Config::getInstance().getLBASlotSeperator()) {
+          cachePolicyExecutor_->isCoreSlot(this, slotId)) {
         ReferenceCounter::getInstance().dereference(getValue(slotId));
       }
       setInvalid(slotId);
     }
   }
 
-  slotId = cachePolicyExecutor_->allocate();
+  slotId = cachePolicyExecutor_->allocate(this);
   setKey(slotId, lbaSignature);
   setValue(slotId, fingerprintHash);
   setValid(slotId);
   if (Config::getInstance().getCachePolicyForFPIndex() == CachePolicyEnum::tRecencyAwareLeastReferenceCount &&
-      slotId >= Config::getInstance().getLBASlotSeperator()) {
+      cachePolicyExecutor_->isCoreSlot(this, slotId)) {
     ReferenceCounter::getInstance().reference(fingerprintHash);
   }
-  cachePolicyExecutor_->promote(slotId);
+  cachePolicyExecutor_->promote(this, slotId);
   return evictedSignature_;
 }
 
+uint64_t LBABucket::remove(uint32_t lbaSignature) {
+  uint64_t fingerprintHash = 0;
+  uint32_t slotId = lookup(lbaSignature, fingerprintHash);
+  if (slotId == ~((uint32_t)0)) return ~0ull;
+  if (Config::getInstance().getCachePolicyForFPIndex() == CachePolicyEnum::tRecencyAwareLeastReferenceCount &&
+      cachePolicyExecutor_->isCoreSlot(this, slotId)) {
+    ReferenceCounter::getInstance().dereference(fingerprintHash);
+  }
+  setInvalid(slotId);
+  setKey(slotId, 0);
+  setValue(slotId, 0);
+  return fingerprintHash;
+}
+
 void LBABucket::getFingerprints(std::set<uint64_t> &fpSet) {
   for (uint32_t i = 0; i < nSlots_; ++i) {
     if (isValid(i)) {
@@ -97,28 +113,24 @@ void LBABucket::getFingerprints(std::set<uint64_t> &fpSet) {
  *
  */
 uint32_t FPBucket::lookup(uint64_t fpSignature, uint32_t &nSlotsOccupied) {
-  uint32_t slotId = 0;
+  uint64_t mask[MAX_NUM_SLOTS_PER_BUCKET / 64];
   nSlotsOccupied = 0;
-  for (; slotId < nSlots_;) {
-    if (!isValid(slotId)  // 找到第一个符合的slotId
-        || fpSignature != getKey(slotId)) {
-      ++slotId;
-      continue;
-    }
-    while (slotId < nSlots_ && isValid(slotId) && fpSignature == getKey(slotId)) {
-      ++nSlotsOccupied;
-      ++slotId;
-    }  // PAPER 3-2 每个slot都保存对应的FP-hash，算是重复保存了
-    return slotId - nSlotsOccupied;  // 最后一个符合的ID减占用的slot数量既第一个符合的ID
+  if (isEmpty()) return ~((uint32_t)0);
+  matchKeys(fpSignature, mask);
+  // 找到第一个符合的slotId
+  uint32_t slotId = SignatureScanner::findFirst(mask, nSlots_);
+  if (slotId != ~((uint32_t)0)) {
+    // PAPER 3-2 每个slot都保存对应的FP-hash，算是重复保存了
+    nSlotsOccupied = SignatureScanner::countRun(mask, slotId, nSlots_);
   }
-  return ~((uint32_t)0);
+  return slotId;
 }
 
 void FPBucket::promote(uint64_t fpSignature) {
   uint32_t slot_id = 0, compressibility_level = 0, n_slots_occupied;
   slot_id = lookup(fpSignature, n_slots_occupied);
 
-  cachePolicyExecutor_->promote(slot_id, n_slots_occupied);
+  cachePolicyExecutor_->promote(this, slot_id, n_slots_occupied);
 }
 
 uint32_t FPBucket::update(uint64_t fpSignature, uint32_t nSlotsToOccupy) {
@@ -127,7 +139,10 @@ uint32_t FPBucket::update(uint64_t fpSignature, uint32_t nSlotsToOccupy) {
 
   slotId = lookup(fpSignature, nSlotsOccupied);
 
+  // A re-inserted entry keeps its inline reference count: the LBA entries counted in it still refer to it
+  uint64_t referenceCount = 0;
   if (slotId != ~((uint32_t)0)) {
+    referenceCount = getValue(slotId);
     // if (Config::getInstance().getCacheMode() == tWriteBack) {
     //   DirtyList::getInstance().addEvictedChunk(
     //       /* Compute ssd location of the evicted data */
@@ -141,10 +156,11 @@ uint32_t FPBucket::update(uint64_t fpSignature, uint32_t nSlotsToOccupy) {
     }
   }
 
-  slotId = cachePolicyExecutor_->allocate(nSlotsToOccupy);
+  slotId = cachePolicyExecutor_->allocate(this, nSlotsToOccupy);
 
   for (uint32_t _slotId = slotId; _slotId < slotId + nSlotsToOccupy; ++_slotId) {
     setKey(_slotId, fpSignature);  // fp-hash prefix
+    setValue(_slotId, _slotId == slotId ? referenceCount : 0);  // inline reference count
     setValid(_slotId);
   }
 
@@ -152,13 +168,25 @@ uint32_t FPBucket::update(uint64_t fpSignature, uint32_t nSlotsToOccupy) {
 }
 
 void FPBucket::evict(uint64_t fpSignature) {
-  for (uint32_t index = 0; index < nSlots_; index++) {
-    if (getKey(index) == fpSignature) {
-      setInvalid(index);
+  uint64_t mask[MAX_NUM_SLOTS_PER_BUCKET / 64];
+  matchKeys(fpSignature, mask);
+  for (uint32_t w = 0; w < (nSlots_ + 63) / 64; ++w) {
+    for (uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+      setInvalid(w * 64 + __builtin_ctzll(bits));
     }
   }
 }
 
+// Saturates at maxCount on increments, but a decrement always applies, saturated or not: an
+// entry whose LBAs are all overwritten falls back to 0 and can be chosen by LRC again. The price
+// is that an entry once referenced more than maxCount times reaches 0 while some LBAs still
+// reference it, and may be evicted before its count says so.
+void FPBucket::addReferenceCount(uint32_t slotId, int delta) {
+  uint32_t maxCount = (1u << nBitsPerValue_) - 1, count = getValue(slotId);
+  if ((delta > 0 && count == maxCount) || (delta < 0 && count == 0)) return;
+  setValue(slotId, count + delta);
+}
+
 void FPBucket::getFingerprints(std::set<uint64_t> &fpSet) {
   for (uint32_t i = 0; i < nSlots_; ++i) {
     if (isValid(i)) {
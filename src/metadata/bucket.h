@@ -8,91 +8,220 @@
  *      to the caller.
  *   3. In the current implementation, buckets **do not hold memory**.
  *      The ownership of the memory of all slots belongs to Index, which instantiate
- *      a bucket manipulator with the corresponding memory.
+ *      a bucket manipulator with the corresponding memory. A bucket is a small
+ *      value living on the caller's stack, and its cache policy executor is shared.
+ *   4. Slots are either bit-packed (compact layout) or split into a byte-aligned
+ *      key array and value array (aligned layout), see Index::initStorage.
+ *   5. With cache-line-aligned buckets, a bucket is one 64-byte-aligned record
+ *      | BucketHeader | valid bits | slots | padding |, so a probe never touches
+ *      a line shared with another bucket or a separate valid-bit array.
  */
 #ifndef __BUCKET_H__
 #define __BUCKET_H__
 
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <set>
 
 #include "bitmap.h"
+#include "signature_scan.h"
 namespace cache {
+#define CACHE_LINE_SIZE 64u
+
+// Head of a cache-line-aligned bucket record
+struct BucketHeader {
+  std::atomic<uint32_t> version_;  // seqlock version of the bucket (optimistic lookups)
+  uint16_t nValidSlots_;           // occupancy
+  std::atomic<uint8_t> lock_;      // bucket spinlock (BucketLock)
+  uint8_t reserved_;
+};
+
 // Bucket is an abstraction of multiple key-value pairs (mapping)
 class FPIndex;
 class CachePolicy;
 class CachePolicyExecutor;
 class Bucket {
  public:
-  Bucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nSlots, uint8_t *data, uint8_t *valid,
-         CachePolicy *cachePolicy, uint32_t slotId);
+  // nBytesPerKey/nBytesPerValue are 0 for the compact (bit-packed) layout. For the aligned layout,
+  // data points to nSlots keys of nBytesPerKey bytes, followed by nSlots values of nBytesPerValue bytes.
+  // header is nullptr unless buckets are stored as cache-line-aligned records.
+  // match is the compact-layout probe chosen by the index for its geometry (nullptr: the generic kernel).
+  Bucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nBytesPerKey, uint32_t nBytesPerValue,
+         uint32_t nSlots, uint8_t *data, uint8_t *valid, CachePolicy *cachePolicy, uint32_t slotId,
+         BucketHeader *header = nullptr, SignatureScanner::MatchFunc match = nullptr);
   virtual ~Bucket();
 
+  // Offset of the value array inside an aligned-layout bucket (naturally aligned for nBytesPerValue)
+  static inline uint32_t getValueArrayOffset(uint32_t nBytesPerKey, uint32_t nBytesPerValue, uint32_t nSlots) {
+    return (nSlots * nBytesPerKey + nBytesPerValue - 1) / nBytesPerValue * nBytesPerValue;
+  }
+
   inline void initKey(uint32_t index, uint32_t &b, uint32_t &e) {
     b = index * nBitsPerSlot_;
     e = b + nBitsPerKey_;
   }
   inline uint32_t getKey(uint32_t index) {
-    uint32_t b, e;
-    initKey(index, b, e);
-    return data_.getBits(b, e);
+    switch (nBytesPerKey_) {
+      case 2:
+        return ((uint16_t *)data_.data_)[index];
+      case 4:
+        return ((uint32_t *)data_.data_)[index];
+      default:
+        uint32_t b, e;
+        initKey(index, b, e);
+        return data_.getBits(b, e);
+    }
   }
   inline void setKey(uint32_t index, uint32_t v) {
-    uint32_t b, e;
-    initKey(index, b, e);
-    data_.storeBits(b, e, v);
+    switch (nBytesPerKey_) {
+      case 2:
+        ((uint16_t *)data_.data_)[index] = v;
+        break;
+      case 4:
+        ((uint32_t *)data_.data_)[index] = v;
+        break;
+      default:
+        uint32_t b, e;
+        initKey(index, b, e);
+        data_.storeBits(b, e, v);
+    }
   }
   inline void initValue(uint32_t index, uint32_t &b, uint32_t &e) {
     b = index * nBitsPerSlot_ + nBitsPerKey_;
     e = b + nBitsPerValue_;
   }
   inline uint64_t getValue(uint32_t index) {
-    // uint32_t b, e; initValue(index, b, e);
-    // return data_.getBits(b, e);
+    switch (nBytesPerValue_) {
+      case 1:
+        return values_[index];
+      case 2:
+        return ((uint16_t *)values_)[index];
+      case 4:
+        return ((uint32_t *)values_)[index];
+      case 8:
+        return ((uint64_t *)values_)[index];
+    }
     uint32_t b, e;
     initValue(index, b, e);
-    uint64_t v = 0;
-    if (e - b > 32) {
-      v = data_.getBits(b, b + 32);
-      v |= (uint64_t)data_.getBits(b + 32, e) << 32u;
-    } else {
-      v = data_.getBits(b, e);
-    }
-    return v;
+    return data_.getBits(b, e);
   }
   inline void setValue(uint32_t index, uint64_t v) {
-    // uint32_t b, e; initValue(index, b, e);
-    // data_.storeBits(b, e, v);
+    switch (nBytesPerValue_) {
+      case 1:
+        values_[index] = v;
+        return;
+      case 2:
+        ((uint16_t *)values_)[index] = v;
+        return;
+      case 4:
+        ((uint32_t *)values_)[index] = v;
+        return;
+      case 8:
+        ((uint64_t *)values_)[index] = v;
+        return;
+    }
     uint32_t b, e;
     initValue(index, b, e);
-    if (e - b > 32) {
-      data_.storeBits(b, b + 32, v & 0xffffffff);
-      data_.storeBits(b + 32, e, v >> 32u);
-    } else {
-      data_.storeBits(b, e, v);
-    }
+    data_.storeBits(b, e, v);
   }
   inline uint32_t get32bits(uint32_t index) { return data_.get32bits(index); }
   inline void set32bits(uint32_t index, uint32_t v) { data_.set32bits(index, v); }
 
   inline bool isValid(uint32_t index) { return valid_.get(index); }
-  inline void setValid(uint32_t index) { valid_.set(index); }
-  inline void setInvalid(uint32_t index) { valid_.clear(index); }
+  inline void setValid(uint32_t index) {
+    if (header_ != nullptr && !valid_.get(index)) ++header_->nValidSlots_;
+    valid_.set(index);
+  }
+  inline void setInvalid(uint32_t index) {
+    if (header_ != nullptr && valid_.get(index)) --header_->nValidSlots_;
+    valid_.clear(index);
+  }
+  // Whether the bucket is known to hold no valid slot (only tracked by bucket records)
+  inline bool isEmpty() { return header_ != nullptr && header_->nValidSlots_ == 0; }
+  // Bitmask (bit i <-> slot i) of the valid slots whose key equals signature
+  inline void matchKeys(uint32_t signature, uint64_t *mask) {
+    switch (nBytesPerKey_) {
+      case 2:
+        SignatureScanner::getInstance().matchKeys16((uint16_t *)data_.data_, valid_.data_, nSlots_, signature, mask);
+        break;
+      case 4:
+        SignatureScanner::getInstance().matchKeys32((uint32_t *)data_.data_, valid_.data_, nSlots_, signature, mask);
+        break;
+      default:
+        if (match_ != nullptr) {
+          match_(data_.data_, valid_.data_, nBitsPerSlot_, nBitsPerKey_, nSlots_, signature, mask);
+        } else {
+          SignatureScanner::getInstance().match(data_.data_, valid_.data_, nBitsPerSlot_, nBitsPerKey_, nSlots_,
+                                                signature, mask);
+        }
+    }
+  }
+
   inline uint32_t getValid32bits(uint32_t index) { return valid_.get32bits(index); }
-  inline void setValid32bits(uint32_t index, uint32_t v) { valid_.set32bits(index, v); }
+  inline void setValid32bits(uint32_t index, uint32_t v) {
+    if (header_ != nullptr)
+      header_->nValidSlots_ += __builtin_popcount(v) - __builtin_popcount(valid_.get32bits(index));
+    valid_.set32bits(index, v);
+  }
+
+  // Bitmask (bit i <-> slot i) of the free (invalid) slots, zero beyond nSlots
+  inline void getFreeMask(uint64_t *mask) {
+    uint32_t nWords = (nSlots_ + 63) / 64;
+    memset(mask, 0, nWords * sizeof(uint64_t));
+    memcpy(mask, valid_.data_, (nSlots_ + 7) / 8);
+    for (uint32_t w = 0; w < nWords; ++w) mask[w] = ~mask[w];
+    if (nSlots_ & 63u) mask[nWords - 1] &= (1ull << (nSlots_ & 63u)) - 1;
+  }
+  // Start of the first run of nSlotsToOccupy free slots, ~0 if none.
+  // Word-parallel: bit s of free & (free >> 1) & ... & (free >> (n - 1)) is set iff slots s .. s + n - 1
+  // are all free, with the bits shifted in from the next word.
+  inline uint32_t findFreeRun(uint32_t nSlotsToOccupy) {
+    uint64_t free[MAX_NUM_SLOTS_PER_BUCKET / 64 + 1];
+    uint32_t nWords = (nSlots_ + 63) / 64;
+    if (nSlotsToOccupy > 64) return findFreeRunScalar(nSlotsToOccupy);
+    getFreeMask(free);
+    free[nWords] = 0;
+    for (uint32_t w = 0; w < nWords; ++w) {
+      uint64_t run = free[w];
+      for (uint32_t k = 1; k < nSlotsToOccupy && run; ++k) {
+        run &= (free[w] >> k) | (free[w + 1] << (64 - k));
+      }
+      if (run) return w * 64 + __builtin_ctzll(run);
+    }
+    return ~0u;
+  }
+  inline uint32_t findFreeRunScalar(uint32_t nSlotsToOccupy) {
+    uint32_t nSlotsAvailable = 0;
+    for (uint32_t slotId = 0; slotId < nSlots_; ++slotId) {
+      if (!isValid(slotId)) {
+        if (++nSlotsAvailable >= nSlotsToOccupy) return slotId + 1 - nSlotsAvailable;
+      } else {
+        nSlotsAvailable = 0;
+      }
+    }
+    return ~0u;
+  }
 
   inline uint32_t getnSlots() { return nSlots_; }
+  // Per-bucket cache policy state (CachePolicy::getnBytesPerBucketForPolicy bytes after the valid bits)
+  inline uint8_t *getPolicyData() { return policyData_; }
   inline uint32_t getBucketId() { return bucketId_; }
   inline void setEvictedSignature(uint64_t signature) { evictedSignature_ = signature; }
 
   // 操作桶中槽位的数据部分的位图
   Bitmap::Manipulator data_;
   Bitmap::Manipulator valid_;
+  BucketHeader *header_;
   CachePolicyExecutor *cachePolicyExecutor_;
+  uint8_t *values_;
+  uint8_t *policyData_;
+  SignatureScanner::MatchFunc match_;
   uint32_t nBitsPerSlot_, nSlots_, nBitsPerKey_, nBitsPerValue_;
+  uint32_t nBytesPerKey_, nBytesPerValue_;
   uint32_t bucketId_;
   uint64_t evictedSignature_ = ~0ull;
 };
@@ -111,9 +240,11 @@ class Bucket {
  */
 class LBABucket : public Bucket {
  public:
-  LBABucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nSlots, uint8_t *data, uint8_t *valid,
-            CachePolicy *cachePolicy, uint32_t bucketId)
-      : Bucket(nBitsPerKey, nBitsPerValue, nSlots, data, valid, cachePolicy, bucketId) {}
+  LBABucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nBytesPerKey, uint32_t nBytesPerValue,
+            uint32_t nSlots, uint8_t *data, uint8_t *valid, CachePolicy *cachePolicy, uint32_t bucketId,
+            BucketHeader *header = nullptr, SignatureScanner::MatchFunc match = nullptr)
+      : Bucket(nBitsPerKey, nBitsPerValue, nBytesPerKey, nBytesPerValue, nSlots, data, valid, cachePolicy, bucketId,
+               header, match) {}
   /**
    * @brief Lookup the given lba signature and store the ca hash result into fp_hash
    *
@@ -135,6 +266,12 @@ class LBABucket : public Bucket {
    * @param fingerprintIndex used to evict obsolete entries that has been evicted in ca_index
    */
   uint64_t update(uint32_t lbaSignature, uint64_t fingerprintHash, std::shared_ptr<FPIndex> fingerprintIndex);
+  /**
+   * @brief Remove the entry of the lba signature, if any
+   *
+   * @return the fingerprintHash of the removed entry, ~0 if there was none
+   */
+  uint64_t remove(uint32_t lbaSignature);
 
   void getFingerprints(std::set<uint64_t> &fpSet);
 };
@@ -155,9 +292,11 @@ class LBABucket : public Bucket {
  */
 class FPBucket : public Bucket {
  public:
-  FPBucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nSlots, uint8_t *data, uint8_t *valid,
-           CachePolicy *cachePolicy, uint32_t bucketId)
-      : Bucket(nBitsPerKey, nBitsPerValue, nSlots, data, valid, cachePolicy, bucketId) {}
+  FPBucket(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nBytesPerKey, uint32_t nBytesPerValue,
+           uint32_t nSlots, uint8_t *data, uint8_t *valid, CachePolicy *cachePolicy, uint32_t bucketId,
+           BucketHeader *header = nullptr, SignatureScanner::MatchFunc match = nullptr)
+      : Bucket(nBitsPerKey, nBitsPerValue, nBytesPerKey, nBytesPerValue, nSlots, data, valid, cachePolicy, bucketId,
+               header, match) {}
 
   /**
    * @brief Lookup the given ca signature and store the space (compression level) to size
@@ -182,6 +321,12 @@ class FPBucket : public Bucket {
   void evict(uint64_t fpSignature);
 
   void getFingerprints(std::set<uint64_t> &fpSet);
+
+  // Inline reference count (Config::isInlineReferenceCountEnabled): a counter in the value bits
+  // of the first slot of an entry (getValue), zeroed when a new entry is inserted. It saturates
+  // on increments and still counts down once saturated (see bucket.cpp). Called with the bucket
+  // lock held (FPIndex).
+  void addReferenceCount(uint32_t slotId, int delta);
 };
 }  // namespace cache
 #endif
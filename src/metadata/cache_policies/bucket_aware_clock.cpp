@@ -0,0 +1,186 @@
+#include "bucket_aware_clock.h"
+
+#include <common/stats.h>
+
+#include "common/config.h"
+#include "common/hash_geometry.h"
+#include "metadata/reference_counter.h"
+namespace cache {
+
+namespace {
+const uint32_t kMaxWords = MAX_NUM_SLOTS_PER_BUCKET / 64;
+
+// The policy data of a bucket, viewed as 64-bit words (bit i of word i / 64 <-> slot i)
+struct ClockState {
+  ClockState(Bucket *bucket)
+      : nSlots_(bucket->getnSlots()),
+        nWords_((nSlots_ + 63) / 64),
+        nBytes_((nSlots_ + 7) / 8),
+        ref_(bucket->getPolicyData()),
+        core_(bucket->getPolicyData() + nBytes_),
+        hands_(bucket->getPolicyData() + 2 * nBytes_) {}
+
+  inline void load(const uint8_t *p, uint64_t *w) {
+    memset(w, 0, nWords_ * sizeof(uint64_t));
+    memcpy(w, p, nBytes_);
+  }
+  inline void store(uint8_t *p, const uint64_t *w) { memcpy(p, w, nBytes_); }
+
+  inline uint32_t getHand(uint32_t i) {
+    uint16_t hand;
+    memcpy(&hand, hands_ + i * sizeof(uint16_t), sizeof(uint16_t));
+    return hand < nSlots_ ? hand : 0;
+  }
+  inline void setHand(uint32_t i, uint32_t hand) {
+    uint16_t v = hand < nSlots_ ? hand : 0;
+    memcpy(hands_ + i * sizeof(uint16_t), &v, sizeof(uint16_t));
+  }
+
+  // First set bit at or after `from`, wrapping around; ~0 if none
+  uint32_t findFrom(const uint64_t *mask, uint32_t from) {
+    uint32_t w = from >> 6;
+    uint64_t bits = mask[w] & (~0ull << (from & 63u));
+    for (uint32_t i = 0; i <= nWords_; ++i) {
+      if (bits) return w * 64 + __builtin_ctzll(bits);
+      w = (w + 1 == nWords_) ? 0 : w + 1;
+      bits = mask[w];
+    }
+    return ~0u;
+  }
+
+  // Clear the bits of `candidates` in [b, e) from `ref`
+  void clearRange(uint64_t *ref, const uint64_t *candidates, uint32_t b, uint32_t e) {
+    for (uint32_t w = b >> 6; b < e; ++w, b = w * 64) {
+      uint32_t hi = e - w * 64 < 64 ? e - w * 64 : 64;
+      uint64_t range = (hi == 64 ? ~0ull : (1ull << hi) - 1) & (~0ull << (b & 63u));
+      ref[w] &= ~(candidates[w] & range);
+    }
+  }
+
+  // One CLOCK sweep over `candidates` from hand `i`: return the first candidate whose
+  // reference bit is clear, clearing the reference bits of the candidates passed over.
+  uint32_t sweep(const uint64_t *candidates, uint32_t i) {
+    uint64_t ref[kMaxWords], unreferenced[kMaxWords];
+    uint32_t hand = getHand(i), victim;
+    load(ref_, ref);
+    for (uint32_t w = 0; w < nWords_; ++w) unreferenced[w] = candidates[w] & ~ref[w];
+    victim = findFrom(unreferenced, hand);
+    if (victim == ~0u) {
+      // Every candidate is referenced: a full turn clears them all
+      for (uint32_t w = 0; w < nWords_; ++w) ref[w] &= ~candidates[w];
+      victim = findFrom(candidates, hand);
+    } else if (victim >= hand) {
+      clearRange(ref, candidates, hand, victim);
+    } else {
+      clearRange(ref, candidates, hand, nSlots_);
+      clearRange(ref, candidates, 0, victim);
+    }
+    store(ref_, ref);
+    if (victim != ~0u) setHand(i, victim + 1);
+    return victim;
+  }
+
+  uint32_t nSlots_, nWords_, nBytes_;
+  uint8_t *ref_, *core_, *hands_;
+};
+
+enum { kCoreHand = 0, kNonCoreHand = 1 };
+}  // namespace
+
+BucketAwareCLOCKExecutor::BucketAwareCLOCKExecutor() = default;
+
+bool BucketAwareCLOCKExecutor::isCoreSlot(Bucket *bucket, uint32_t slotId) {
+  ClockState state(bucket);
+  return bucket->isValid(slotId) && Bitmap::Manipulator(state.core_).get(slotId);
+}
+
+// O(1) in the number of slots moved: only the reference/core bits of the promoted
+// slot (and of at most one demoted core slot) change.
+void BucketAwareCLOCKExecutor::promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy) {
+  ClockState state(bucket);
+  if (slotId >= state.nSlots_) return;
+  Bitmap::Manipulator ref(state.ref_), core(state.core_);
+  ref.set(slotId);
+  if (core.get(slotId)) return;
+
+  bool recencyAware =
+      Config::getInstance().getCachePolicyForFPIndex() == CachePolicyEnum::tRecencyAwareLeastReferenceCount;
+  if (recencyAware) {
+    ReferenceCounter::getInstance().reference(bucket->getValue(slotId));
+  }
+
+  // The core segment holds as many slots as the core region of BucketAwareLRU
+  uint64_t valid[kMaxWords], coreSlots[kMaxWords];
+  uint32_t nCoreSlots = 0, nMaxCoreSlots = state.nSlots_ - HashGeometry::getInstance().getLBASlotSeperator();
+  state.load(bucket->valid_.data_, valid);
+  state.load(state.core_, coreSlots);
+  for (uint32_t w = 0; w < state.nWords_; ++w) {
+    coreSlots[w] &= valid[w];
+    nCoreSlots += __builtin_popcountll(coreSlots[w]);
+  }
+  if (nCoreSlots >= nMaxCoreSlots) {
+    uint32_t demoted = state.sweep(coreSlots, kCoreHand);
+    if (demoted != ~0u) {
+      core.clear(demoted);
+      if (recencyAware) {
+        ReferenceCounter::getInstance().dereference(bucket->getValue(demoted));
+      }
+    }
+  }
+  core.set(slotId);
+}
+
+// Only LBA Index would call this function
+// LBA signature only takes one slot.
+// So there is no need to worry about the entry taking contiguous slots.
+void BucketAwareCLOCKExecutor::clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex) {
+  for (uint32_t slotId = 0; slotId < bucket->getnSlots(); ++slotId) {
+    if (!bucket->isValid(slotId)) continue;
+
+    uint32_t size;
+    uint64_t cachedataLocation, metadataLocation;  // dummy variables
+    bool valid = false;
+    uint64_t fpHash = bucket->getValue(slotId);
+    if (fpIndex != nullptr) valid = fpIndex->lookup(fpHash, size, cachedataLocation, metadataLocation);
+    // if the slot has no mappings in ca index, it is an empty slot
+    if (!valid) {
+      bucket->setKey(slotId, 0), bucket->setValue(slotId, 0);
+      bucket->setInvalid(slotId);
+    }
+  }
+}
+
+// LBA entries take one slot: use the first empty slot, otherwise evict the
+// non-core slot chosen by the non-core clock.
+uint32_t BucketAwareCLOCKExecutor::allocate(Bucket *bucket, uint32_t nSlotsToOccupy) {
+  ClockState state(bucket);
+  uint32_t slotId = bucket->findFreeRun(1);
+  if (slotId == ~0u) {
+    uint64_t valid[kMaxWords], candidates[kMaxWords];
+    state.load(bucket->valid_.data_, valid);
+    state.load(state.core_, candidates);
+    for (uint32_t w = 0; w < state.nWords_; ++w) candidates[w] = valid[w] & ~candidates[w];
+    slotId = state.sweep(candidates, kNonCoreHand);
+    if (slotId == ~0u) {
+      // All slots are core (only with a zero-sized non-core segment)
+      slotId = state.sweep(valid, kNonCoreHand);
+      // The evicted core slot drops its reference, as a demoted one does in promote
+      if (Config::getInstance().getCachePolicyForFPIndex() == CachePolicyEnum::tRecencyAwareLeastReferenceCount &&
+          Bitmap::Manipulator(state.core_).get(slotId)) {
+        ReferenceCounter::getInstance().dereference(bucket->getValue(slotId));
+      }
+    }
+    bucket->setEvictedSignature(bucket->getValue(slotId));
+    bucket->setInvalid(slotId);
+    bucket->setKey(slotId, 0);
+    bucket->setValue(slotId, 0);
+  }
+  Bitmap::Manipulator(state.ref_).clear(slotId);
+  Bitmap::Manipulator(state.core_).clear(slotId);
+  return slotId;
+}
+
+BucketAwareCLOCK::BucketAwareCLOCK() = default;
+CachePolicyExecutor *BucketAwareCLOCK::getExecutor() { return &executor_; }
+
+}  // namespace cache
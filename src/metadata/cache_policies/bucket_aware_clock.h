@@ -0,0 +1,42 @@
+#ifndef _BUCKETAWARECLOCK_H
+#define _BUCKETAWARECLOCK_H
+
+#include "cache_policy.h"
+
+namespace cache {
+// Segmented CLOCK for the LBA index, an O(1)-promote alternative to BucketAwareLRU.
+// Each slot has a reference bit and a core bit, stored as two bitmaps in the bucket
+// policy data, followed by the clock hands of the core and non-core segments:
+//   | reference bits | core bits | core hand (16 bit) | non-core hand (16 bit) |
+// At most nSlots - getLBASlotSeperator() valid slots are core, mirroring the core
+// region of BucketAwareLRU: a promoted non-core slot enters the core segment, and
+// the core clock demotes a core slot when the segment is full. Victims are chosen
+// by the non-core clock.
+struct BucketAwareCLOCKExecutor : public CachePolicyExecutor {
+  BucketAwareCLOCKExecutor();
+
+  void promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy) override;
+
+  // Only LBA Index would call this function
+  // LBA signature only takes one slot.
+  void clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex) override;
+
+  uint32_t allocate(Bucket *bucket, uint32_t nSlotsToOccupy) override;
+
+  bool isCoreSlot(Bucket *bucket, uint32_t slotId) override;
+};
+
+class BucketAwareCLOCK : public CachePolicy {
+ public:
+  BucketAwareCLOCK();
+
+  CachePolicyExecutor *getExecutor() override;
+
+  uint32_t getnBytesPerBucketForPolicy(uint32_t nSlots) override { return (nSlots + 7) / 8 * 2 + 4; }
+
+ private:
+  BucketAwareCLOCKExecutor executor_;
+};
+}  // namespace cache
+
+#endif  // _BUCKETAWARECLOCK_H
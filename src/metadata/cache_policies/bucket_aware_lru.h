@@ -5,23 +5,26 @@
 
 namespace cache {
 struct BucketAwareLRUExecutor : public CachePolicyExecutor {
-  explicit BucketAwareLRUExecutor(Bucket *bucket);
+  BucketAwareLRUExecutor();
 
-  void promote(uint32_t slotId, uint32_t nSlotsToOccupy) override;
+  void promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy) override;
 
   // Only LBA Index would call this function
   // LBA signature only takes one slot.
   // So there is no need to care about the entry may take contiguous slots.
-  void clearObsolete(std::shared_ptr<FPIndex> fpIndex) override;
+  void clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex) override;
 
-  uint32_t allocate(uint32_t nSlotsToOccupy) override;
+  uint32_t allocate(Bucket *bucket, uint32_t nSlotsToOccupy) override;
 };
 
 class BucketAwareLRU : public CachePolicy {
  public:
   BucketAwareLRU();
 
-  CachePolicyExecutor *getExecutor(Bucket *bucket) override;
+  CachePolicyExecutor *getExecutor() override;
+
+ private:
+  BucketAwareLRUExecutor executor_;
 };
 }  // namespace cache
 
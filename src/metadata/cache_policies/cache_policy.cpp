@@ -1,7 +1,12 @@
 
 #include "cache_policy.h"
 
+#include "common/hash_geometry.h"
+
 namespace cache {
-CachePolicyExecutor::CachePolicyExecutor(Bucket *bucket) : bucket_(bucket) {}
+CachePolicyExecutor::CachePolicyExecutor() = default;
+bool CachePolicyExecutor::isCoreSlot(Bucket *bucket, uint32_t slotId) {
+  return slotId >= HashGeometry::getInstance().getLBASlotSeperator();
+}
 CachePolicy::CachePolicy() = default;
 }  // namespace cache
@@ -4,23 +4,32 @@
 #include <metadata/index.h>
 
 namespace cache {
+// Executors are stateless: the bucket to operate on is passed to every call, so a
+// single executor owned by the cache policy serves all buckets and no allocation
+// is needed per bucket access.
 struct CachePolicyExecutor {
-  explicit CachePolicyExecutor(Bucket *bucket);
+  CachePolicyExecutor();
 
-  virtual void promote(uint32_t slotId, uint32_t nSlotsToOccupy = 1) = 0;
+  virtual void promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy = 1) = 0;
 
-  virtual uint32_t allocate(uint32_t nSlotsToOccupy = 1) = 0;
+  virtual uint32_t allocate(Bucket *bucket, uint32_t nSlotsToOccupy = 1) = 0;
 
-  virtual void clearObsolete(std::shared_ptr<FPIndex> fpIndex) = 0;
+  virtual void clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex) = 0;
 
-  Bucket *bucket_;
+  // Whether the slot is a core slot, whose fingerprint is counted by the recency-aware
+  // reference counter. Recency-ordered policies keep the most recent entries at the
+  // highest slot ids, above Config::getLBASlotSeperator().
+  virtual bool isCoreSlot(Bucket *bucket, uint32_t slotId);
 };
 
 class CachePolicy {
  public:
   CachePolicy();
 
-  virtual CachePolicyExecutor *getExecutor(Bucket *bucket) = 0;
+  virtual CachePolicyExecutor *getExecutor() = 0;
+
+  // Bytes of per-bucket policy state stored right after the valid bits of each bucket
+  virtual uint32_t getnBytesPerBucketForPolicy(uint32_t nSlots) { return 0; }
 };
 }  // namespace cache
 
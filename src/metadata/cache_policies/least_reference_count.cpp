@@ -1,5 +1,6 @@
 #include "least_reference_count.h"
 
+#include <common/hash_geometry.h>
 #include <common/stats.h>
 #include <metadata/reference_counter.h>
 
@@ -7,92 +8,95 @@
 
 // 代码的主要逻辑是找到一个空闲槽位，如果没有足够的空闲槽位，则驱逐引用计数最少的条目。
 namespace cache {
-LeastReferenceCountExecutor::LeastReferenceCountExecutor(Bucket *bucket) : CachePolicyExecutor(bucket) {}
-
-void LeastReferenceCountExecutor::promote(uint32_t slotId, uint32_t nSlotsToOccupy) {}
-
-void LeastReferenceCountExecutor::clearObsolete(std::shared_ptr<FPIndex> fpIndex) {}
+LeastReferenceCountExecutor::LeastReferenceCountExecutor() = default;
+
+void LeastReferenceCountExecutor::promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy) {}
+
+void LeastReferenceCountExecutor::clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex) {}
+
+// Entries are evicted in increasing reference count order until a run of nSlotsToOccupy free
+// slots appears. Instead of sorting all entries and rescanning the bucket after each eviction,
+// the entries are kept in a min-heap (only the evicted ones are popped), and only the free run
+// around the freed slots is measured: no run was long enough before, so a new one must contain them.
+// With inline reference counts the counts are read from the bucket itself (no global counter query).
+uint32_t LeastReferenceCountExecutor::allocate(Bucket *bucket, uint32_t nSlotsToOccupy) {
+  struct Entry {
+    uint32_t refCount, slotId, nSlotsOccupied;
+    // Heap order: least reference count first, ties broken by slot id
+    bool operator<(const Entry &other) const {
+      return refCount != other.refCount ? refCount > other.refCount : slotId > other.slotId;
+    }
+  };
+  // On the stack to keep allocate() allocation-free
+  Entry entries[MAX_NUM_SLOTS_PER_BUCKET];
+  uint32_t nEntries = 0, nSlots = bucket->getnSlots();
+  bool inlineReferenceCount = Config::getInstance().isInlineReferenceCountEnabled();
 
-uint32_t LeastReferenceCountExecutor::allocate(uint32_t nSlotsToOccupy) {
-  std::vector<std::pair<uint32_t, std::pair<uint32_t, uint32_t>>> slotsToReferenceCounts;
-  uint32_t slotId = 0, nSlotsAvailable = 0, nSlots = bucket_->getnSlots();
+  uint32_t slotId = bucket->findFreeRun(nSlotsToOccupy);
+  if (slotId != ~0u) return slotId;
 
-  // 占update 1/4时间
   BEGIN_TIMER();
   for (slotId = 0; slotId < nSlots;) {
-    if (!bucket_->isValid(slotId)) {
+    if (!bucket->isValid(slotId)) {
       ++slotId;
       continue;
     }
 
     uint32_t nSlotsOccupied = 0;
     uint32_t slotId_ = slotId;
-    uint64_t key = bucket_->getKey(slotId);
-    uint64_t bucketId = bucket_->bucketId_;
-    uint64_t fpHash = (bucketId << Config::getInstance().getnBitsPerFpSignature()) | key;
-    uint32_t refCount = ReferenceCounter::getInstance().query(fpHash);
-    while (slotId < nSlots && bucket_->isValid(slotId) && key == bucket_->getKey(slotId)) {
+    uint64_t key = bucket->getKey(slotId);
+    uint32_t refCount;
+    if (inlineReferenceCount) {
+      refCount = bucket->getValue(slotId);
+    } else {
+      uint64_t bucketId = bucket->bucketId_;
+      uint64_t fpHash = (bucketId << HashGeometry::getInstance().getnBitsPerFpSignature()) | key;
+      refCount = ReferenceCounter::getInstance().query(fpHash);
+    }
+    while (slotId < nSlots && bucket->isValid(slotId) && key == bucket->getKey(slotId)) {
       ++slotId;
       nSlotsOccupied += 1;
     }
 
-    slotsToReferenceCounts.emplace_back(slotId_, std::make_pair(refCount, nSlotsOccupied));
+    entries[nEntries++] = {refCount, slotId_, nSlotsOccupied};
   }
   END_TIMER(update_index1);
 
   BEGIN_TIMER();
-  std::sort(slotsToReferenceCounts.begin(), slotsToReferenceCounts.end(), [](auto &left, auto &right) {
-    uint32_t refCount1 = left.second.first, refCount2 = right.second.first;
-    uint32_t nOccupied1 = left.second.second, nOccupied2 = right.second.second;
-    return refCount1 < refCount2;
-  });
+  std::make_heap(entries, entries + nEntries);
   END_TIMER(update_index2);
 
-  // 占update 3/4时间
+  uint32_t begin = 0, end = 0;
   BEGIN_TIMER();
-  while (true) {
-    // check whether there is a contiguous space
-    // try to evict those zero referenced fingerprint first
-    slotId = 0;
-    nSlotsAvailable = 0;
-    for (; slotId < nSlots; ++slotId) {
-      if (nSlotsAvailable >= nSlotsToOccupy) break;
-      // find an empty slot
-      if (!bucket_->isValid(slotId)) {
-        ++nSlotsAvailable;
-      } else {
-        nSlotsAvailable = 0;
-      }
-    }
-
-    if (nSlotsAvailable >= nSlotsToOccupy) break;
+  while (nEntries > 0) {
     // Evict the least RF entry
-    slotId = slotsToReferenceCounts[0].first;
-    uint64_t key = bucket_->getKey(slotId);
-    while (slotId < nSlots && bucket_->isValid(slotId) && key == bucket_->getKey(slotId)) {
-      bucket_->setInvalid(slotId);
-      ++slotId;
+    std::pop_heap(entries, entries + nEntries);
+    const Entry &victim = entries[--nEntries];
+    for (slotId = victim.slotId; slotId < victim.slotId + victim.nSlotsOccupied; ++slotId) {
+      bucket->setInvalid(slotId);
     }
 
     // if (Config::getInstance().getCacheMode() == tWriteBack) {
     //   DirtyList::getInstance().addEvictedChunk(
     //       /* Compute ssd location of the evicted data */
     //       /* Actually, full Fingerprint and address is sufficient. */
-    //       FPIndex::computeCachedataLocation(bucket_->getBucketId(),
-    //                                         slotsToReferenceCounts[0].first),
-    //       (slotId - slotsToReferenceCounts[0].first) *
-    //           Config::getInstance().getSubchunkSize());
+    //       FPIndex::computeCachedataLocation(bucket->getBucketId(), victim.slotId),
+    //       victim.nSlotsOccupied * Config::getInstance().getSubchunkSize());
     // }
-    slotsToReferenceCounts.erase(slotsToReferenceCounts.begin());
+
+    // Free run containing the victim
+    for (begin = victim.slotId; begin > 0 && !bucket->isValid(begin - 1); --begin) {
+    }
+    for (end = victim.slotId + victim.nSlotsOccupied; end < nSlots && !bucket->isValid(end); ++end) {
+    }
+    if (end - begin >= nSlotsToOccupy) break;
   }
   END_TIMER(update_index3);
 
-  return slotId - nSlotsAvailable;
+  return begin;
 }
 
 LeastReferenceCount::LeastReferenceCount() = default;
 
-CachePolicyExecutor *LeastReferenceCount::getExecutor(Bucket *bucket) {
-  return new LeastReferenceCountExecutor(bucket);
-}
+CachePolicyExecutor *LeastReferenceCount::getExecutor() { return &executor_; }
 }  // namespace cache
@@ -4,21 +4,24 @@
 
 namespace cache {
 struct LeastReferenceCountExecutor : public CachePolicyExecutor {
-  explicit LeastReferenceCountExecutor(Bucket *bucket);
+  LeastReferenceCountExecutor();
 
-  void promote(uint32_t slotId, uint32_t nSlotsToOccupy) override;
+  void promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy) override;
   // Only LBA Index would call this function
   // LBA signature only takes one slot.
   // So there is no need to care about the entry may take contiguous slots.
-  void clearObsolete(std::shared_ptr<FPIndex> fpIndex) override;
-  uint32_t allocate(uint32_t nSlotsToOccupy) override;
+  void clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex) override;
+  uint32_t allocate(Bucket *bucket, uint32_t nSlotsToOccupy) override;
 };
 
 class LeastReferenceCount : public CachePolicy {
  public:
   LeastReferenceCount();
 
-  CachePolicyExecutor *getExecutor(Bucket *bucket) override;
+  CachePolicyExecutor *getExecutor() override;
+
+ private:
+  LeastReferenceCountExecutor executor_;
 };
 }  // namespace cache
 
@@ -1,50 +1,49 @@
 #include "lru.h"
 
+#include <algorithm>
+
 namespace cache {
 
-LRUExecutor::LRUExecutor(Bucket *bucket, std::list<uint32_t> *list)
-    : CachePolicyExecutor(bucket) {
-  list_ = list;
-}
+LRUExecutor::LRUExecutor(std::list<uint32_t> *lists) : lists_(lists) {}
 
-void LRUExecutor::promote(uint32_t slotId, uint32_t nSlotsToOccupy) {
-  list_->remove(slotId);
-  list_->push_front(slotId);
+void LRUExecutor::promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy) {
+  std::list<uint32_t> &list = lists_[bucket->getBucketId()];
+  // A slot id appears at most once in the list; relink its node instead of reallocating it
+  auto it = std::find(list.begin(), list.end(), slotId);
+  if (it != list.end()) {
+    list.splice(list.begin(), list, it);
+  } else {
+    list.push_front(slotId);
+  }
 }
 
-void LRUExecutor::clearObsolete(std::shared_ptr<FPIndex> fpIndex) {}
-
-uint32_t LRUExecutor::allocate(uint32_t nSlotsToOccupy) {
-  uint32_t slotId = 0, nSlotsAvailable = 0, nSlots = bucket_->getnSlots();
-  for (; slotId < nSlots; ++slotId) {
-    if (nSlotsAvailable == nSlotsToOccupy) break;
-    // find an empty slot
-    if (!bucket_->isValid(slotId)) {
-      ++nSlotsAvailable;
-    } else {
-      nSlotsAvailable = 0;
-    }
-  }
+void LRUExecutor::clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex) {}
+
+uint32_t LRUExecutor::allocate(Bucket *bucket, uint32_t nSlotsToOccupy) {
+  std::list<uint32_t> &list = lists_[bucket->getBucketId()];
+  uint32_t slotId = bucket->findFreeRun(nSlotsToOccupy), nSlotsAvailable = 0, nSlots = bucket->getnSlots();
+  if (slotId != ~0u) return slotId;
 
-  if (nSlotsAvailable < nSlotsToOccupy) {
-    slotId = list_->back();
-    uint32_t key = bucket_->getKey(slotId);
-    while (nSlotsAvailable < nSlotsToOccupy && slotId < nSlots) {
-      if (bucket_->isValid(slotId) && key == bucket_->getKey(slotId)) {
-        nSlotsAvailable += 1;
-      }
-      ++slotId;
+  // No free run: the free slots at the end of the bucket count towards the evicted ones
+  while (nSlotsAvailable < nSlots && !bucket->isValid(nSlots - 1 - nSlotsAvailable)) {
+    ++nSlotsAvailable;
+  }
+  slotId = list.back();
+  uint32_t key = bucket->getKey(slotId);
+  while (nSlotsAvailable < nSlotsToOccupy && slotId < nSlots) {
+    if (bucket->isValid(slotId) && key == bucket->getKey(slotId)) {
+      nSlotsAvailable += 1;
     }
+    ++slotId;
   }
 
   return slotId - nSlotsToOccupy;
 }
 
-CachePolicyExecutor *LRU::getExecutor(Bucket *bucket) {
-  return new LRUExecutor(bucket, &lists_[bucket->getBucketId()]);
-}
+CachePolicyExecutor *LRU::getExecutor() { return executor_.get(); }
 
 LRU::LRU(uint32_t nBuckets) {
   lists_ = std::make_unique<std::list<uint32_t>[]>(nBuckets);
+  executor_ = std::make_unique<LRUExecutor>(lists_.get());
 }
 }  // namespace cache
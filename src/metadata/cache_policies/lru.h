@@ -10,22 +10,26 @@ namespace cache {
 
 class LRUExecutor : public CachePolicyExecutor {
  public:
-  explicit LRUExecutor(Bucket *bucket, std::list<uint32_t> *list);
+  explicit LRUExecutor(std::list<uint32_t> *lists);
 
-  std::list<uint32_t> *list_;
+  // One list per bucket, indexed by bucket id
+  std::list<uint32_t> *lists_;
 
-  uint32_t allocate(uint32_t nSlotsToOccupy);
-  void clearObsolete(std::shared_ptr<FPIndex> fpIndex);
+  uint32_t allocate(Bucket *bucket, uint32_t nSlotsToOccupy);
+  void clearObsolete(Bucket *bucket, std::shared_ptr<FPIndex> fpIndex);
 
-  void promote(uint32_t slotId, uint32_t nSlotsToOccupy);
+  void promote(Bucket *bucket, uint32_t slotId, uint32_t nSlotsToOccupy);
 };
 
 // LRU policy that uses a list to maintain
 class LRU : public CachePolicy {
  public:
   LRU(uint32_t nBuckets);
-  CachePolicyExecutor *getExecutor(Bucket *bucket) override;
+  CachePolicyExecutor *getExecutor() override;
   std::unique_ptr<std::list<uint32_t>[]> lists_;
+
+ private:
+  std::unique_ptr<LRUExecutor> executor_;
 };
 }  // namespace cache
 
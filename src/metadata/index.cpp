@@ -1,11 +1,17 @@
 #include "index.h"
 
+#include <immintrin.h>
+
+#include <cassert>
+#include <mutex>
 #include <utility>
 
+#include "cache_policies/bucket_aware_clock.h"
 #include "cache_policies/bucket_aware_lru.h"
 #include "cache_policies/least_reference_count.h"
 #include "cache_policies/lru.h"
 #include "common/config.h"
+#include "common/hash_geometry.h"
 #include "common/stats.h"
 #include "reference_counter.h"
 
@@ -15,40 +21,151 @@ namespace cache {
 Index::Index() = default;
 
 LBAIndex::~LBAIndex() = default;
-FPIndex::~FPIndex() = default;
+FPIndex::~FPIndex() {
+  if (Config::getInstance().isInlineReferenceCountEnabled()) ReferenceCounter::getInstance().setInlineCounter(nullptr);
+}
 
 void Index::setCachePolicy(std::unique_ptr<CachePolicy> cachePolicy) { cachePolicy_ = std::move(cachePolicy); }
 
+// 索引数据区的尾部填充同时满足 SignatureScanner 与 Bitmap 的越界读取
+static_assert(SIGNATURE_SCAN_TAIL_PADDING >= BITMAP_TAIL_PADDING, "index tail padding too small for Bitmap");
+
+void Index::initStorage(const char *name) {
+  assert(nSlotsPerBucket_ <= MAX_NUM_SLOTS_PER_BUCKET);
+  assert(nBitsPerKey_ <= BITMAP_MAX_FIELD_BITS && nBitsPerValue_ <= BITMAP_MAX_FIELD_BITS);
+  nBitsPerSlot_ = nBitsPerKey_ + nBitsPerValue_;
+
+  // Compact: 每个桶的 key/value 按位紧密排列
+  uint32_t nBytesPerCompactBucket = (nBitsPerSlot_ * nSlotsPerBucket_ + 7) / 8;
+  // Aligned: key 数组 (uint16_t/uint32_t) + value 数组 (uint8_t ~ uint64_t)，桶大小按 8 字节对齐
+  uint32_t nBytesPerKey = nBitsPerKey_ <= 16 ? 2 : 4;
+  uint32_t nBytesPerValue = nBitsPerValue_ <= 8 ? 1 : nBitsPerValue_ <= 16 ? 2 : nBitsPerValue_ <= 32 ? 4 : 8;
+  uint32_t nBytesPerAlignedBucket =
+      (Bucket::getValueArrayOffset(nBytesPerKey, nBytesPerValue, nSlotsPerBucket_) +
+       nBytesPerValue * nSlotsPerBucket_ + 7) / 8 * 8;
+
+  if (Config::getInstance().getIndexLayout() == tAlignedLayout) {
+    nBytesPerKey_ = nBytesPerKey;
+    nBytesPerValue_ = nBytesPerValue;
+    nBytesPerBucket_ = nBytesPerAlignedBucket;
+  } else {
+    nBytesPerKey_ = nBytesPerValue_ = 0;
+    nBytesPerBucket_ = nBytesPerCompactBucket;
+  }
+  // 用于有效位标记（以及紧随其后的缓存策略状态）的每个桶所需的字节数
+  nBytesPerBucketForValid_ = (1 * nSlotsPerBucket_ + 7) / 8;
+  if (cachePolicy_ != nullptr) {
+    nBytesPerBucketForValid_ += cachePolicy_->getnBytesPerBucketForPolicy(nSlotsPerBucket_);
+  }
+
+  // Record: | BucketHeader | 有效位 | 槽位 (8 字节对齐) | 填充至 64 字节 |
+  uint32_t nBytesBeforeSlots = (sizeof(BucketHeader) + nBytesPerBucketForValid_ + 7) / 8 * 8;
+  uint32_t nBytesPerRecord =
+      (nBytesBeforeSlots + nBytesPerBucket_ + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+  if (Config::getInstance().isCacheLineAlignedBucketsEnabled()) {
+    // 多分配一个缓存行用于对齐起始地址（尾部留出 SignatureScanner / Bitmap 越界读取的空间）
+    data_ = std::make_unique<uint8_t[]>(1ull * nBytesPerRecord * nBuckets_ + CACHE_LINE_SIZE +
+                                        SIGNATURE_SCAN_TAIL_PADDING);
+    headerBase_ = (uint8_t *)(((uintptr_t)data_.get() + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+    validBase_ = headerBase_ + sizeof(BucketHeader);
+    dataBase_ = headerBase_ + nBytesBeforeSlots;
+    dataStride_ = validStride_ = nBytesPerRecord;
+  } else {
+    // 分配用于存储索引的内存（尾部留出 SignatureScanner / Bitmap 越界读取的空间）
+    data_ = std::make_unique<uint8_t[]>(1ull * nBytesPerBucket_ * nBuckets_ + SIGNATURE_SCAN_TAIL_PADDING);
+    // 分配用于存储有效位标记的内存（尾部留出 Bitmap 越界读取的空间）
+    valid_ = std::make_unique<uint8_t[]>(1ull * nBytesPerBucketForValid_ * nBuckets_ + BITMAP_TAIL_PADDING);
+    headerBase_ = nullptr;
+    dataBase_ = data_.get();
+    validBase_ = valid_.get();
+    dataStride_ = nBytesPerBucket_;
+    validStride_ = nBytesPerBucketForValid_;
+  }
+  // 如果配置启用了多线程，则每个桶使用一个单字节自旋锁，用于桶级别的锁，确保多线程环境下的索引一致性：
+  // 桶记录布局下嵌入 BucketHeader::lock_，否则分配一个紧凑的锁数组（代替 std::mutex 数组）
+  if (Config::getInstance().isMultiThreadingEnabled()) {
+    if (headerBase_ == nullptr) {
+      locks_ = std::make_unique<std::atomic<uint8_t>[]>(nBuckets_);
+      for (uint32_t i = 0; i < nBuckets_; ++i) locks_[i].store(0, std::memory_order_relaxed);
+    }
+    std::cout << name << " index bucket locks: " << (headerBase_ == nullptr ? 1.0 * nBuckets_ / 1024 / 1024 : 0.0)
+              << " MiB (std::mutex array: " << 1.0 * sizeof(std::mutex) * nBuckets_ / 1024 / 1024 << " MiB)"
+              << std::endl;
+  }
+  // 乐观查找所用的桶版本号：桶记录布局下使用 BucketHeader::version_，否则单独分配
+  optimisticLookup_ = Config::getInstance().isOptimisticLookupEnabled();
+  if (optimisticLookup_ && headerBase_ == nullptr) {
+    versions_ = std::make_unique<std::atomic<uint32_t>[]>(nBuckets_);
+    for (uint32_t i = 0; i < nBuckets_; ++i) versions_[i].store(0, std::memory_order_relaxed);
+  }
+
+  double validMiB = 1.0 * nBytesPerBucketForValid_ * nBuckets_ / 1024 / 1024;
+  std::cout << name << " index memory: Compact " << 1.0 * nBytesPerCompactBucket * nBuckets_ / 1024 / 1024 + validMiB
+            << " MiB, Aligned " << 1.0 * nBytesPerAlignedBucket * nBuckets_ / 1024 / 1024 + validMiB
+            << " MiB (using " << (nBytesPerKey_ ? "Aligned" : "Compact") << ")" << std::endl;
+  if (nBytesPerKey_ == 0) {
+    SignatureScanner &scanner = SignatureScanner::getInstance();
+    match_ = scanner.getMatchFunc(nBitsPerKey_, nBitsPerValue_, nSlotsPerBucket_);
+    bool fixed = match_ != scanner.getMatchFunc();
+    std::cout << name << " index signature kernel: " << (fixed ? scanner.getFixedKernelName() : scanner.getKernelName())
+              << (fixed ? ", specialized for " : ", generic for ") << nBitsPerKey_ << "/" << nBitsPerValue_ << "/"
+              << nSlotsPerBucket_ << std::endl;
+  }
+  if (headerBase_ != nullptr) {
+    std::cout << name << " index bucket records: " << nBytesPerRecord << " B per bucket, "
+              << 1.0 * nBytesPerRecord * nBuckets_ / 1024 / 1024 << " MiB" << std::endl;
+  }
+}
+
+uint32_t Index::beginRead(uint32_t bucketId) {
+  uint32_t version;
+  while ((version = getBucketVersion(bucketId)->load(std::memory_order_acquire)) & 1u) _mm_pause();
+  return version;
+}
+
+bool Index::endRead(uint32_t bucketId, uint32_t version) {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return getBucketVersion(bucketId)->load(std::memory_order_relaxed) == version;
+}
+
+void Index::beginWrite(uint32_t bucketId) {
+  if (!optimisticLookup_) return;
+  std::atomic<uint32_t> *version = getBucketVersion(bucketId);
+  version->store(version->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Index::endWrite(uint32_t bucketId) {
+  if (!optimisticLookup_) return;
+  std::atomic<uint32_t> *version = getBucketVersion(bucketId);
+  version->store(version->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
 LBAIndex::LBAIndex(std::shared_ptr<FPIndex> fpIndex) : fpIndex_(std::move(fpIndex)) {
+  const HashGeometry &geometry = HashGeometry::getInstance();
   // 每个 LBA 签名的位数
-  nBitsPerKey_ = Config::getInstance().getnBitsPerLbaSignature();
+  nBitsPerKey_ = geometry.getnBitsPerLbaSignature();
   // 每个指纹签名加上 FP 桶 ID 的总位数
-  nBitsPerValue_ = Config::getInstance().getnBitsPerFpSignature() + Config::getInstance().getnBitsPerFpBucketId();
+  nBitsPerValue_ = geometry.getnBitsPerFpSignature() + geometry.getnBitsPerFpBucketId();
   // 每个桶中的槽位数
-  nSlotsPerBucket_ = Config::getInstance().getnLBASlotsPerBucket();
+  nSlotsPerBucket_ = geometry.getnLBASlotsPerBucket();
   // 总桶数
-  nBuckets_ = Config::getInstance().getnLbaBuckets();
-
-  // 每个桶所需的字节数
-  nBytesPerBucket_ = ((nBitsPerKey_ + nBitsPerValue_) * nSlotsPerBucket_ + 7) / 8;
-  // 用于有效位标记的每个桶所需的字节数
-  nBytesPerBucketForValid_ = (1 * nSlotsPerBucket_ + 7) / 8;
-  // 分配用于存储 LBA 索引的内存
-  data_ = std::make_unique<uint8_t[]>(nBytesPerBucket_ * nBuckets_ + 1);
-  // 分配用于存储有效位标记的内存
-  valid_ = std::make_unique<uint8_t[]>(nBytesPerBucketForValid_ * nBuckets_ + 1);
-  // 如果配置启用了多线程，则为每个桶分配一个 std::mutex 数组，用于桶级别的锁，确保多线程环境下的索引一致性
-  if (Config::getInstance().isMultiThreadingEnabled()) {
-    mutexes_ = std::make_unique<std::mutex[]>(nBuckets_);
-  }
+  nBuckets_ = geometry.getnLbaBuckets();
 
   // 检查配置是否启用了紧凑的缓存策略
   if (Config::getInstance().isCompactCachePolicyEnabled()) {
-    setCachePolicy(std::move(std::make_unique<BucketAwareLRU>()));
+    if (Config::getInstance().getLBACachePolicy() == tBucketAwareCLOCK) {
+      setCachePolicy(std::move(std::make_unique<BucketAwareCLOCK>()));
+    } else {
+      setCachePolicy(std::move(std::make_unique<BucketAwareLRU>()));
+    }
   } else {
     // setting the cache policy for fp index as LRU means that we disable the "ACDC" cache policy
     setCachePolicy(std::move(std::make_unique<LRU>(nBuckets_)));
   }
+  // 缓存策略的每桶状态与有效位存放在一起，因此在设置缓存策略之后再分配内存
+  initStorage("LBA");
 }
 
 // 根据给定的 LBA 哈希值查找对应的指纹哈希值
@@ -59,14 +176,26 @@ bool LBAIndex::lookup(uint64_t lbaHash, uint64_t &fpHash) {
   // 使用位掩码提取 lbaHash 中的低 nBitsPerKey_ 位，作为签名
   uint32_t signature = lbaHash & ((1u << nBitsPerKey_) - 1);
   // 调用 getLBABucket 函数获取对应的 bucket，然后调用 "bucket.cc" 的 lookup 函数查找指纹哈希值
-  return getLBABucket(bucketId)->lookup(signature, fpHash) != ~((uint32_t)0);
+  if (!optimisticLookup_) return getLBABucket(bucketId).lookup(signature, fpHash) != ~((uint32_t)0);
+
+  // 乐观查找：不加锁读取桶，若期间有写者修改了该桶则重试
+  uint32_t version, slotId;
+  uint64_t value = 0;
+  do {
+    version = beginRead(bucketId);
+    slotId = getLBABucket(bucketId).lookup(signature, value);
+  } while (!endRead(bucketId, version));
+  if (slotId != ~((uint32_t)0)) fpHash = value;
+  return slotId != ~((uint32_t)0);
 }
 
 // 提升指定 LBA 哈希值对应条目的优先级（通常用于缓存替换策略中的更新）
 void LBAIndex::promote(uint64_t lbaHash) {
   uint32_t bucketId = lbaHash >> nBitsPerKey_;
   uint32_t signature = lbaHash & ((1u << nBitsPerKey_) - 1);
-  getLBABucket(bucketId)->promote(signature);
+  beginWrite(bucketId);
+  getLBABucket(bucketId).promote(signature);
+  endWrite(bucketId);
 }
 
 // If the request modify an existing LBA, return the previous fingerprint
@@ -74,53 +203,58 @@ void LBAIndex::promote(uint64_t lbaHash) {
 uint64_t LBAIndex::update(uint64_t lbaHash, uint64_t fpHash) {
   uint32_t bucketId = lbaHash >> nBitsPerKey_;
   uint32_t signature = lbaHash & ((1u << nBitsPerKey_) - 1);
-  uint64_t evictedFPHash = getLBABucket(bucketId)->update(signature, fpHash, fpIndex_);
+  beginWrite(bucketId);
+  uint64_t evictedFPHash = getLBABucket(bucketId).update(signature, fpHash, fpIndex_);
+  endWrite(bucketId);
 
   return evictedFPHash;
 }
 
 FPIndex::FPIndex() {
-  nBitsPerKey_ = Config::getInstance().getnBitsPerFpSignature();
+  nBitsPerKey_ = HashGeometry::getInstance().getnBitsPerFpSignature();
   nBitsPerValue_ = 4;
-  nSlotsPerBucket_ = Config::getInstance().getnFPSlotsPerBucket();
-  nBuckets_ = Config::getInstance().getnFpBuckets();
-
-  nBytesPerBucket_ = ((nBitsPerKey_ + nBitsPerValue_) * nSlotsPerBucket_ + 7) / 8;
-  nBytesPerBucketForValid_ = (1 * nSlotsPerBucket_ + 7) / 8;
-  data_ = std::make_unique<uint8_t[]>(nBytesPerBucket_ * nBuckets_ + 1);
-  valid_ = std::make_unique<uint8_t[]>(nBytesPerBucketForValid_ * nBuckets_ + 1);
-  if (Config::getInstance().isMultiThreadingEnabled()) {
-    mutexes_ = std::make_unique<std::mutex[]>(nBuckets_);
-  }
+  nSlotsPerBucket_ = HashGeometry::getInstance().getnFPSlotsPerBucket();
+  nBuckets_ = HashGeometry::getInstance().getnFpBuckets();
 
   if (Config::getInstance().isCompactCachePolicyEnabled()) {
     cachePolicy_ = std::move(std::make_unique<LeastReferenceCount>());
   } else {
     cachePolicy_ = std::move(std::make_unique<LRU>(nBuckets_));
   }
+  initStorage("FP");
+  // 引用计数存放在槽位的 value bits 中，不再需要全局的 sketch / map
+  if (Config::getInstance().isInlineReferenceCountEnabled()) ReferenceCounter::getInstance().setInlineCounter(this);
 }
 
 uint64_t FPIndex::computeCachedataLocation(uint32_t bucketId, uint32_t slotId) {
-  return (bucketId * Config::getInstance().getnFPSlotsPerBucket() + slotId) * 1ull *
-             Config::getInstance().getSubchunkSize() +
-         1ull * Config::getInstance().getnFpBuckets() * Config::getInstance().getnFPSlotsPerBucket() *
-             Config::getInstance().getMetadataSize();
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  return (bucketId * geometry.getnFPSlotsPerBucket() + slotId) * 1ull * geometry.getSubchunkSize() +
+         geometry.getMetadataRegionSize();
 }
 
 uint64_t FPIndex::computeMetadataLocation(uint32_t bucketId, uint32_t slotId) {
-  return (bucketId * Config::getInstance().getnFPSlotsPerBucket() + slotId) * 1ull *
-         Config::getInstance().getMetadataSize();
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  return (bucketId * geometry.getnFPSlotsPerBucket() + slotId) * 1ull * geometry.getMetadataSize();
 }
 
 uint64_t FPIndex::cachedataLocationToMetadataLocation(uint64_t cachedataLocation) {
-  return (cachedataLocation - 1ull * Config::getInstance().getnFPSlotsPerBucket() *
-                                  Config::getInstance().getMetadataSize() * Config::getInstance().getnFpBuckets()) /
-         Config::getInstance().getSubchunkSize() * Config::getInstance().getMetadataSize();
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  return (cachedataLocation - geometry.getMetadataRegionSize()) / geometry.getSubchunkSize() *
+         geometry.getMetadataSize();
 }
 
 bool FPIndex::lookup(uint64_t fpHash, uint32_t &nSubchunks, uint64_t &cachedataLocation, uint64_t &metadataLocation) {
   uint32_t bucketId = fpHash >> nBitsPerKey_, signature = fpHash & ((1u << nBitsPerKey_) - 1), nSlotsOccupied = 0;
-  uint32_t index = getFPBucket(bucketId)->lookup(signature, nSlotsOccupied);
+  uint32_t index;
+  if (optimisticLookup_) {
+    uint32_t version;
+    do {
+      version = beginRead(bucketId);
+      index = getFPBucket(bucketId).lookup(signature, nSlotsOccupied);
+    } while (!endRead(bucketId, version));
+  } else {
+    index = getFPBucket(bucketId).lookup(signature, nSlotsOccupied);
+  }
   if (index == ~0u) return false;
 
   nSubchunks = nSlotsOccupied;
@@ -132,7 +266,9 @@ bool FPIndex::lookup(uint64_t fpHash, uint32_t &nSubchunks, uint64_t &cachedataL
 
 void FPIndex::promote(uint64_t fpHash) {
   uint32_t bucketId = fpHash >> nBitsPerKey_, signature = fpHash & ((1u << nBitsPerKey_) - 1);
-  getFPBucket(bucketId)->promote(signature);
+  beginWrite(bucketId);
+  getFPBucket(bucketId).promote(signature);
+  endWrite(bucketId);
 }
 
 void FPIndex::update(uint64_t fpHash, uint32_t nSubchunks, uint64_t &cachedataLocation, uint64_t &metadataLocation) {
@@ -144,7 +280,9 @@ void FPIndex::update(uint64_t fpHash, uint32_t nSubchunks, uint64_t &cachedataLo
   // FP-index, metadata region and data region. Theses three bucket slot one one
   // map according to PAPER Figure 3.
   BEGIN_TIMER();
-  slotId = getFPBucket(bucketId)->update(signature, nSlotsToOccupy);
+  beginWrite(bucketId);
+  slotId = getFPBucket(bucketId).update(signature, nSlotsToOccupy);
+  endWrite(bucketId);
   END_TIMER(FPBucket_update);
 
   BEGIN_TIMER();
@@ -156,36 +294,95 @@ void FPIndex::update(uint64_t fpHash, uint32_t nSubchunks, uint64_t &cachedataLo
   END_TIMER(computeMetadataLocation);
 }
 
-std::unique_ptr<std::lock_guard<std::mutex>> LBAIndex::lock(uint64_t lbaHash) {
+uint64_t LBAIndex::remove(uint64_t lbaHash) {
+  uint32_t bucketId = lbaHash >> nBitsPerKey_;
+  uint32_t signature = lbaHash & ((1u << nBitsPerKey_) - 1);
+  beginWrite(bucketId);
+  uint64_t removedFPHash = getLBABucket(bucketId).remove(signature);
+  endWrite(bucketId);
+
+  return removedFPHash;
+}
+
+BucketLock LBAIndex::lock(uint64_t lbaHash) {
   uint32_t bucketId = lbaHash >> nBitsPerKey_;
   if (Config::getInstance().isMultiThreadingEnabled()) {
-    return std::move(std::make_unique<std::lock_guard<std::mutex>>(mutexes_[bucketId]));
+    return BucketLock(getBucketLock(bucketId));
   } else {
-    return nullptr;
+    return BucketLock();
   }
 }
 
 void LBAIndex::getFingerprints(std::set<uint64_t> &fpSet) {
   for (uint32_t i = 0; i < nBuckets_; ++i) {
-    getLBABucket(i)->getFingerprints(fpSet);
+    getLBABucket(i).getFingerprints(fpSet);
   }
 }
 void FPIndex::getFingerprints(std::set<uint64_t> &fpSet) {
   for (uint32_t i = 0; i < nBuckets_; ++i) {
-    getFPBucket(i)->getFingerprints(fpSet);
+    getFPBucket(i).getFingerprints(fpSet);
   }
 }
 
-std::unique_ptr<std::lock_guard<std::mutex>> FPIndex::lock(uint64_t fpHash) {
+BucketLock FPIndex::lock(uint64_t fpHash) {
   uint32_t bucketId = fpHash >> nBitsPerKey_;
   if (Config::getInstance().isMultiThreadingEnabled()) {
-    return std::move(std::make_unique<std::lock_guard<std::mutex>>(mutexes_[bucketId]));
+    return BucketLock(getBucketLock(bucketId));
   } else {
-    return nullptr;
+    return BucketLock();
   }
 }
 
 void FPIndex::reference(uint64_t fpHash) { ReferenceCounter::getInstance().reference(fpHash); }
 void FPIndex::dereference(uint64_t fpHash) { ReferenceCounter::getInstance().dereference(fpHash); }
 
+uint32_t FPIndex::queryReferenceCount(uint64_t fpHash) {
+  uint32_t bucketId = fpHash >> nBitsPerKey_, signature = fpHash & ((1u << nBitsPerKey_) - 1), nSlotsOccupied = 0;
+  FPBucket bucket = getFPBucket(bucketId);
+  uint32_t slotId = bucket.lookup(signature, nSlotsOccupied);
+  return slotId == ~0u ? 0 : bucket.getValue(slotId);
+}
+
+thread_local uint32_t FPIndex::heldBucketId_ = ~0u;
+thread_local FPIndex::DeferredReferenceCounts FPIndex::deferredReferenceCounts_;
+
+void FPIndex::addReferenceCount(uint64_t fpHash, int delta) {
+  uint32_t bucketId = fpHash >> nBitsPerKey_;
+  if (!Config::getInstance().isMultiThreadingEnabled() || bucketId == heldBucketId_) {
+    addReferenceCountLocked(fpHash, delta);
+    return;
+  }
+  BucketLock lock = heldBucketId_ == ~0u ? BucketLock(getBucketLock(bucketId))
+                                         : BucketLock::tryAcquire(getBucketLock(bucketId));
+  if (lock.isLocked()) {
+    addReferenceCountLocked(fpHash, delta);
+  } else {
+    deferredReferenceCounts_.index_ = this;
+    deferredReferenceCounts_.counts_.emplace_back(fpHash, delta);
+  }
+}
+
+void FPIndex::applyDeferredReferenceCounts() { deferredReferenceCounts_.apply(); }
+
+FPIndex::DeferredReferenceCounts::~DeferredReferenceCounts() { apply(); }
+
+void FPIndex::DeferredReferenceCounts::apply() {
+  for (const auto &deferred : counts_) {
+    BucketLock lock(index_->getBucketLock(deferred.first >> index_->nBitsPerKey_));
+    index_->addReferenceCountLocked(deferred.first, deferred.second);
+  }
+  counts_.clear();
+}
+
+// The value bits change in a write section: optimistic readers of the bucket retry
+void FPIndex::addReferenceCountLocked(uint64_t fpHash, int delta) {
+  uint32_t bucketId = fpHash >> nBitsPerKey_, signature = fpHash & ((1u << nBitsPerKey_) - 1), nSlotsOccupied = 0;
+  FPBucket bucket = getFPBucket(bucketId);
+  uint32_t slotId = bucket.lookup(signature, nSlotsOccupied);
+  if (slotId == ~0u) return;
+  beginWrite(bucketId);
+  bucket.addReferenceCount(slotId, delta);
+  endWrite(bucketId);
+}
+
 }  // namespace cache
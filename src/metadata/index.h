@@ -3,27 +3,32 @@
  *   This file contains declarations of our designed LBAIndex and FPIndex.
  *
  *   1. Each Index instance manages the memory of bucket slots mappings, bucket
- * valid bits, and mutexes, and corresponding cache policy functions.
+ * valid bits, and bucket locks, and corresponding cache policy functions.
  *   2. Bucket access is in the form of functions with pointers to slots, valid
- * bits, and mutex. Index implements a getBucketManipulator function that wraps
+ * bits, and lock. Index implements a getBucketManipulator function that wraps
  * and returns a bucket manipulator.
  *   3. Index exposes lookup, promote, and update for caller to query/update the
- * index structure, it also expose mutex lock and unlock for concurrency
+ * index structure, it also expose bucket lock and unlock for concurrency
  * control.
+ *   4. With Config::isOptimisticLookupEnabled(), each bucket also has a seqlock
+ * version: promote/update (which run under the bucket lock) make it odd while
+ * they modify the bucket, and lookup runs without the lock, retrying when the
+ * version was odd or changed during the probe.
  */
 #ifndef __INDEX_H__
 #define __INDEX_H__
 
+#include <atomic>
 #include <cstring>
 #include <iostream>
 #include <list>
 #include <map>
 #include <memory>
-#include <mutex>
 #include <vector>
 
 #include "bucket.h"
 #include "cache_policies/cache_policy.h"
+#include "common/common.h"
 #include "common/config.h"
 // #include "metadata/cachededup/common.h"
 namespace cache {
@@ -35,12 +40,49 @@ class Index {
   void setCachePolicy(std::unique_ptr<CachePolicy> cachePolicy);
 
  protected:
+  // Lay out buckets according to Config::getIndexLayout(), allocate slots, valid bits and locks,
+  // and report the memory cost of each layout.
+  // With Config::isCacheLineAlignedBucketsEnabled(), each bucket is stored as one 64-byte-aligned
+  // record | BucketHeader | valid bits | slots | padding | instead of two separate arrays.
+  void initStorage(const char *name);
+
+  inline uint8_t *getBucketData(uint32_t bucketId) { return dataBase_ + 1ull * dataStride_ * bucketId; }
+  inline uint8_t *getBucketValid(uint32_t bucketId) { return validBase_ + 1ull * validStride_ * bucketId; }
+  inline BucketHeader *getBucketHeader(uint32_t bucketId) {
+    return headerBase_ == nullptr ? nullptr : (BucketHeader *)(headerBase_ + 1ull * dataStride_ * bucketId);
+  }
+  // Spinlock of a bucket: the header byte of a bucket record, or an entry of locks_
+  inline std::atomic<uint8_t> *getBucketLock(uint32_t bucketId) {
+    return headerBase_ == nullptr ? &locks_[bucketId] : &getBucketHeader(bucketId)->lock_;
+  }
+  // Seqlock version of a bucket: the header word of a bucket record, or an entry of versions_
+  inline std::atomic<uint32_t> *getBucketVersion(uint32_t bucketId) {
+    return headerBase_ == nullptr ? &versions_[bucketId] : &getBucketHeader(bucketId)->version_;
+  }
+
+  // Optimistic read section: beginRead waits for an even version and returns it,
+  // endRead tells whether the bucket stayed unmodified since beginRead.
+  uint32_t beginRead(uint32_t bucketId);
+  bool endRead(uint32_t bucketId, uint32_t version);
+  // Write section, entered with the bucket lock held; no-ops unless optimistic lookups are enabled
+  void beginWrite(uint32_t bucketId);
+  void endWrite(uint32_t bucketId);
+
   uint32_t nBitsPerSlot_{}, nSlotsPerBucket_{}, nBitsPerKey_{}, nBitsPerValue_{}, nBytesPerBucket_{}, nBuckets_{},
       nBytesPerBucketForValid_{};
+  // 0 for the compact layout
+  uint32_t nBytesPerKey_{}, nBytesPerValue_{};
+  // Compact-layout signature probe, specialized for the index geometry when it is instantiated
+  SignatureScanner::MatchFunc match_{};
+  // Address of bucket 0 and distance between consecutive buckets (slots / valid bits / header)
+  uint8_t *dataBase_{}, *validBase_{}, *headerBase_{};
+  uint32_t dataStride_{}, validStride_{};
   std::unique_ptr<uint8_t[]> data_;
   std::unique_ptr<uint8_t[]> valid_;
   std::unique_ptr<CachePolicy> cachePolicy_;
-  std::unique_ptr<std::mutex[]> mutexes_;
+  std::unique_ptr<std::atomic<uint8_t>[]> locks_;
+  std::unique_ptr<std::atomic<uint32_t>[]> versions_;
+  bool optimisticLookup_ = false;
 };
 
 class FPIndex;
@@ -51,12 +93,14 @@ class LBAIndex : Index {
   bool lookup(uint64_t lbaHash, uint64_t &fpHash);
   void promote(uint64_t lbaHash);
   uint64_t update(uint64_t lbaHash, uint64_t fpHash);
-  std::unique_ptr<std::lock_guard<std::mutex>> lock(uint64_t lbaHash);
+  // Remove the entry of lbaHash; return its fingerprint hash, ~0 if there was none
+  uint64_t remove(uint64_t lbaHash);
+  BucketLock lock(uint64_t lbaHash);
 
-  std::unique_ptr<LBABucket> getLBABucket(uint32_t bucketId) {
-    return std::move(std::make_unique<LBABucket>(
-        nBitsPerKey_, nBitsPerValue_, nSlotsPerBucket_, data_.get() + nBytesPerBucket_ * bucketId,
-        valid_.get() + nBytesPerBucketForValid_ * bucketId, cachePolicy_.get(), bucketId));
+  LBABucket getLBABucket(uint32_t bucketId) {
+    return LBABucket(nBitsPerKey_, nBitsPerValue_, nBytesPerKey_, nBytesPerValue_, nSlotsPerBucket_,
+                     getBucketData(bucketId), getBucketValid(bucketId), cachePolicy_.get(), bucketId,
+                     getBucketHeader(bucketId), match_);
   }
 
   void getFingerprints(std::set<uint64_t> &fpSet);
@@ -73,14 +117,14 @@ class FPIndex : Index {
   bool lookup(uint64_t fpHash, uint32_t &nSubchunks, uint64_t &cachedataLocation, uint64_t &metadataLocation);
   void promote(uint64_t fpHash);
   void update(uint64_t fpHash, uint32_t nSubchunks, uint64_t &cachedataLocation, uint64_t &metadataLocation);
-  std::unique_ptr<std::lock_guard<std::mutex>> lock(uint64_t fpHash);
+  BucketLock lock(uint64_t fpHash);
 
   void getFingerprints(std::set<uint64_t> &fpSet);
 
-  std::unique_ptr<FPBucket> getFPBucket(uint32_t bucketId) {
-    return std::move(std::make_unique<FPBucket>(
-        nBitsPerKey_, nBitsPerValue_, nSlotsPerBucket_, data_.get() + nBytesPerBucket_ * bucketId,
-        valid_.get() + nBytesPerBucketForValid_ * bucketId, cachePolicy_.get(), bucketId));
+  FPBucket getFPBucket(uint32_t bucketId) {
+    return FPBucket(nBitsPerKey_, nBitsPerValue_, nBytesPerKey_, nBytesPerValue_, nSlotsPerBucket_,
+                    getBucketData(bucketId), getBucketValid(bucketId), cachePolicy_.get(), bucketId,
+                    getBucketHeader(bucketId), match_);
   }
   static uint64_t computeCachedataLocation(uint32_t bucketId, uint32_t slotId);
   static uint64_t computeMetadataLocation(uint32_t bucketId, uint32_t slotId);
@@ -88,6 +132,33 @@ class FPIndex : Index {
 
   void reference(uint64_t fpHash);
   void dereference(uint64_t fpHash);
+  // Inline reference count of the entry of fpHash (Config::isInlineReferenceCountEnabled),
+  // 0 / ignored when fpHash is not indexed
+  uint32_t queryReferenceCount(uint64_t fpHash);
+  // Inline counts change under the lock of their FP bucket. The thread holding the lock of the
+  // bucket of fpHash declares it with holdBucket: counts of that bucket change directly, those
+  // of another bucket only if its lock is free at once, as waiting for it while holding one
+  // could deadlock. They are deferred otherwise, until applyDeferredReferenceCounts is called
+  // with no FP bucket lock held, or at the latest when the thread exits.
+  void addReferenceCount(uint64_t fpHash, int delta);
+  void holdBucket(uint64_t fpHash) { heldBucketId_ = fpHash >> nBitsPerKey_; }
+  void releaseBucket() { heldBucketId_ = ~0u; }
+  void applyDeferredReferenceCounts();
+
+ private:
+  // The counts deferred by a thread, applied when it exits (worker threads of a replay)
+  struct DeferredReferenceCounts {
+    ~DeferredReferenceCounts();
+    void apply();
+
+    FPIndex *index_ = nullptr;
+    std::vector<std::pair<uint64_t, int>> counts_;
+  };
+
+  void addReferenceCountLocked(uint64_t fpHash, int delta);
+
+  static thread_local uint32_t heldBucketId_;
+  static thread_local DeferredReferenceCounts deferredReferenceCounts_;
 };
 }  // namespace cache
 #endif
@@ -2,6 +2,11 @@
 
 #include <cstring>
 
+#include "chunking/fingerprint_provider.h"
+#include "common/stats.h"
+#include "deduplication/subchunk_deduplication.h"
+#include "lz4.h"
+
 namespace cache {
 MetaVerification::MetaVerification() {}
 
@@ -29,8 +34,11 @@ VerificationResult MetaVerification::verify(Chunk &chunk) {
   // the content is the same by memcmp
   bool validFingerprint = false;
   if (chunk.hasFingerprint_ &&
-      memcmp(metadata.fingerprint_, chunk.fingerprint_, Config::getInstance().getFingerprintLength()) == 0)
+      memcmp(metadata.getFingerprint(), chunk.fingerprint_, Config::getInstance().getFingerprintLength()) == 0)
     validFingerprint = true;
+  if (validFingerprint && FingerprintProvider::getInstance().needsVerification()) {
+    validFingerprint = compareData(chunk);
+  }
 
   if (validLBA && validFingerprint)
     return BOTH_LBA_AND_FP_VALID;
@@ -42,6 +50,36 @@ VerificationResult MetaVerification::verify(Chunk &chunk) {
     return BOTH_LBA_AND_FP_NOT_VALID;
 }
 
+// The cached copy of the chunk (at chunk.cachedataLocation_, nSubchunks_ subchunks from the FP
+// index) is read, decompressed and compared with the data of the chunk.
+// A composite chunk (subchunk deduplication) is not stored in one piece: its subchunks are read
+// from where the subchunk index locates them and compared one by one.
+// Trace replay data is synthesized from the trace fingerprint: only the read is accounted.
+bool MetaVerification::compareData(Chunk &chunk) {
+  uint32_t chunkSize = Config::getInstance().getChunkSize();
+  if (chunk.metadata_.nSubchunkRefs_ != 0) {
+    bool same = SubchunkDeduplicationModule::getInstance().compare(chunk);
+    Stats::getInstance().add_fp_verification_stat(same);
+    return same;
+  }
+  alignas(512) uint8_t cached[chunkSize];
+  alignas(512) uint8_t decompressed[chunkSize];
+  IOModule::getInstance().read(CACHE_DEVICE, chunk.cachedataLocation_, cached,
+                               chunk.nSubchunks_ * Config::getInstance().getSubchunkSize());
+  bool same = true;
+  if (!Config::getInstance().isTraceReplayEnabled() && !Config::getInstance().isFakeIOEnabled()) {
+    const uint8_t *data = cached;
+    if (chunk.metadata_.compressedLen_ != 0 && chunk.metadata_.compressedLen_ < chunk.len_) {
+      data = decompressed;
+      same = LZ4_decompress_safe((const char *)cached, (char *)decompressed, chunk.metadata_.compressedLen_,
+                                 chunkSize) == (int)chunk.len_;
+    }
+    same = same && memcmp(data, chunk.buf_, chunk.len_) == 0;
+  }
+  Stats::getInstance().add_fp_verification_stat(same);
+  return same;
+}
+
 void MetaVerification::update(Chunk &chunk) {
   uint64_t &lba = chunk.addr_;
   auto &ca = chunk.fingerprint_;
@@ -51,13 +89,13 @@ void MetaVerification::update(Chunk &chunk) {
   if (chunk.dedupResult_ == DUP_CONTENT) {
     // The chunk is duplicate
     // We update the chunk metadata
-    if (metadata.numLBAs_ == MAX_NUM_LBAS_PER_CACHED_CHUNK) {
+    if (metadata.numLBAs_ == metadata.getMaxNumLBAs()) {
       // if (Config::getInstance().getCacheMode() == tWriteBack) {
       //   DirtyList::getInstance().flushOneLba(metadata.LBAs_[metadata.nextEvict_],
       //       chunk.cachedataLocation_, metadata);
       // }
       metadata.LBAs_[metadata.nextEvict_++] = chunk.addr_;
-      if (metadata.nextEvict_ == MAX_NUM_LBAS_PER_CACHED_CHUNK) {
+      if (metadata.nextEvict_ == metadata.getMaxNumLBAs()) {
         metadata.nextEvict_ = 0;
       }
     } else {
@@ -69,11 +107,13 @@ void MetaVerification::update(Chunk &chunk) {
     // The data is not duplicate
     // We need to create a new chunk metadata
     memset(&metadata, 0, sizeof(metadata));
-    memcpy(metadata.fingerprint_, chunk.fingerprint_, Config::getInstance().getFingerprintLength());
+    memcpy(metadata.getFingerprint(), chunk.fingerprint_, Config::getInstance().getFingerprintLength());
     metadata.LBAs_[0] = chunk.addr_;
     metadata.numLBAs_ = 1;
     metadata.nextEvict_ = 0;
     metadata.compressedLen_ = chunk.compressedLen_;
+    metadata.nSubchunkRefs_ = chunk.nSubchunkRefs_;
+    memcpy(metadata.getSubchunkHashes(), chunk.subchunkHashes_, sizeof(uint64_t) * chunk.nSubchunkRefs_);
     IOModule::getInstance().write(CACHE_DEVICE, metadataLocation, &chunk.metadata_, 512);
   }
 }
@@ -14,6 +14,11 @@ class MetaVerification {
   VerificationResult verify(Chunk &chunk);
   void clean(Chunk &chunk);
   void update(Chunk &chunk);
+
+ private:
+  // Non-cryptographic fingerprints (FingerprintProvider::needsVerification): a fingerprint match
+  // is a duplicate only if the cached data is the same
+  bool compareData(Chunk &chunk);
 };
 }  // namespace cache
 #endif
@@ -4,7 +4,9 @@
 
 #include "common/config.h"
 #include "common/env.h"
+#include "common/hash_geometry.h"
 #include "common/stats.h"
+#include "deduplication/subchunk_deduplication.h"
 #include "utils/utils.h"
 
 namespace cache {
@@ -24,6 +26,7 @@ MetadataModule::MetadataModule() {
 MetadataModule::~MetadataModule() { dumpStats(); }
 
 void MetadataModule::dumpStats() {
+  fpIndex_->applyDeferredReferenceCounts();
   std::set<uint64_t> fpSetLbaIndex;
   std::set<uint64_t> fpSetFpIndex;
   lbaIndex_->getFingerprints(fpSetLbaIndex);
@@ -39,16 +42,18 @@ void MetadataModule::dumpStats() {
 
 void MetadataModule::dedup(Chunk &chunk) {
   uint64_t fpHash = ~0ull;
+  // 未持有 FP 桶锁时补上之前推迟的内联引用计数更新
+  if (!chunk.fpBucketLock_.isLocked()) fpIndex_->applyDeferredReferenceCounts();
   // 如果为空，表示尚未获取锁，需要获取对应 lbaHash_ 的桶锁
-  if (chunk.lbaBucketLock_ == nullptr) {
-    chunk.lbaBucketLock_ = std::move(lbaIndex_->lock(chunk.lbaHash_));
+  if (!chunk.lbaBucketLock_.isLocked()) {
+    chunk.lbaBucketLock_ = lbaIndex_->lock(chunk.lbaHash_);
   }
   // 1. lbaIndex_->lookup
   // 2. getLBABucket(bucketId)->lookup
   chunk.hitLBAIndex_ = lbaIndex_->lookup(chunk.lbaHash_, fpHash) && (fpHash == chunk.fingerprintHash_);
 
-  if (chunk.fpBucketLock_ == nullptr) {
-    chunk.fpBucketLock_ = std::move(fpIndex_->lock(chunk.fingerprintHash_));
+  if (!chunk.fpBucketLock_.isLocked()) {
+    chunk.fpBucketLock_ = fpIndex_->lock(chunk.fingerprintHash_);
   }
   chunk.hitFPIndex_ =
       fpIndex_->lookup(chunk.fingerprintHash_, chunk.nSubchunks_, chunk.cachedataLocation_, chunk.metadataLocation_);
@@ -70,11 +75,20 @@ void MetadataModule::dedup(Chunk &chunk) {
 
 // 判断数据块是否可以直接从缓存 SSD 中获取: lbaIndex_ 命中, 且 fpIndex_ 命中, 才能去缓存 SSD 中获取完整的 FP 来验证
 void MetadataModule::lookup(Chunk &chunk) {
-  // Obtain LBA bucket lock
-  chunk.lbaBucketLock_ = std::move(lbaIndex_->lock(chunk.lbaHash_));
+  bool optimistic = Config::getInstance().isOptimisticLookupEnabled();
+  if (!chunk.fpBucketLock_.isLocked()) fpIndex_->applyDeferredReferenceCounts();
+  // Obtain LBA bucket lock (optimistic lookups run without bucket locks, see revalidate), unless the
+  // caller holds it already (read-modify-write of a partially written chunk)
+  if (!optimistic && !chunk.lbaBucketLock_.isLocked()) chunk.lbaBucketLock_ = lbaIndex_->lock(chunk.lbaHash_);
   chunk.hitLBAIndex_ = lbaIndex_->lookup(chunk.lbaHash_, chunk.fingerprintHash_);
+  // 模式块：LBA 索引中的值即为内容，无需查找 FP 索引与元数据
+  if (chunk.hitLBAIndex_ && HashGeometry::getInstance().isPatternFpHash(chunk.fingerprintHash_)) {
+    chunk.patternChunk_ = true;
+    chunk.lookupResult_ = HIT;
+    return;
+  }
   if (chunk.hitLBAIndex_) {
-    chunk.fpBucketLock_ = std::move(fpIndex_->lock(chunk.fingerprintHash_));
+    if (!optimistic) chunk.fpBucketLock_ = fpIndex_->lock(chunk.fingerprintHash_);
     chunk.hitFPIndex_ =
         fpIndex_->lookup(chunk.fingerprintHash_, chunk.nSubchunks_, chunk.cachedataLocation_, chunk.metadataLocation_);
     if (chunk.hitFPIndex_) {
@@ -87,14 +101,50 @@ void MetadataModule::lookup(Chunk &chunk) {
     chunk.lookupResult_ = HIT;
   } else {
     chunk.fpBucketLock_.reset();
-    assert(chunk.fpBucketLock_.get() == nullptr);
+    assert(!chunk.fpBucketLock_.isLocked());
     chunk.lookupResult_ = NOT_HIT;
   }
 }
 
+// 乐观查找命中后，数据是在未持有桶锁的情况下读取的，期间缓存项可能已被替换。
+// 按 LBA -> FP 的顺序加锁并重新查找：LBA 仍映射到同一指纹且指纹仍位于同一位置则命中有效，
+// 锁一直持有到 update 完成；否则按未命中处理（保留 LBA 锁，与加锁查找未命中时一致）。
+// 组合块的子块不在该指纹的桶中，还需确认各子块槽位的代数未变。
+bool MetadataModule::revalidate(Chunk &chunk) {
+  // A pattern chunk hit read no data: the LBA index value is its content
+  if (!Config::getInstance().isOptimisticLookupEnabled() || chunk.lookupResult_ != HIT || chunk.patternChunk_) {
+    return true;
+  }
+  uint64_t fpHash = ~0ull, cachedataLocation = ~0ull, metadataLocation = ~0ull;
+  uint32_t nSubchunks = 0;
+  if (!chunk.lbaBucketLock_.isLocked()) chunk.lbaBucketLock_ = lbaIndex_->lock(chunk.lbaHash_);
+  chunk.fpBucketLock_ = fpIndex_->lock(chunk.fingerprintHash_);
+  if (lbaIndex_->lookup(chunk.lbaHash_, fpHash) && fpHash == chunk.fingerprintHash_ &&
+      fpIndex_->lookup(chunk.fingerprintHash_, nSubchunks, cachedataLocation, metadataLocation) &&
+      cachedataLocation == chunk.cachedataLocation_ &&
+      (chunk.nSubchunkRefs_ == 0 || SubchunkDeduplicationModule::getInstance().validate(chunk))) {
+    return true;
+  }
+  chunk.fpBucketLock_.reset();
+  chunk.hitLBAIndex_ = chunk.hitFPIndex_ = false;
+  chunk.verficationResult_ = VERIFICATION_UNKNOWN;
+  chunk.lookupResult_ = NOT_HIT;
+  return false;
+}
+
 void MetadataModule::update(Chunk &chunk) {
+  if (chunk.patternChunk_) {
+    updatePattern(chunk);
+    return;
+  }
   uint64_t removedFingerprintHash = ~0ull;
 
+  // 乐观查找命中（或未经 dedup）的块此时尚未持有桶锁：按 LBA -> FP 的顺序补上写锁
+  if (!chunk.lbaBucketLock_.isLocked()) chunk.lbaBucketLock_ = lbaIndex_->lock(chunk.lbaHash_);
+  if (!chunk.fpBucketLock_.isLocked()) chunk.fpBucketLock_ = fpIndex_->lock(chunk.fingerprintHash_);
+  // Inline reference counts of this FP bucket are now changed under its lock
+  fpIndex_->holdBucket(chunk.fingerprintHash_);
+
   BEGIN_TIMER();
   if (chunk.lookupResult_ == HIT) {
     fpIndex_->promote(chunk.fingerprintHash_);
@@ -102,17 +152,20 @@ void MetadataModule::update(Chunk &chunk) {
   } else {
     // Note that for a cache-candidate chunk, hitLBAIndex indicates both hit in the LBA index and fpHash match
     // deduplication focus on the fingerprint part
+    // With inline reference counts, the count lives in the FP entry: reference it once the entry exists
+    bool referenceAfterUpdate = Config::getInstance().isInlineReferenceCountEnabled();
     if (chunk.hitLBAIndex_) {
       lbaIndex_->promote(chunk.lbaHash_);
     } else {
       removedFingerprintHash = lbaIndex_->update(chunk.lbaHash_, chunk.fingerprintHash_);
-      fpIndex_->reference(chunk.fingerprintHash_);
+      if (!referenceAfterUpdate) fpIndex_->reference(chunk.fingerprintHash_);
     }
     if (chunk.dedupResult_ == DUP_CONTENT) {
       fpIndex_->promote(chunk.fingerprintHash_);
     } else {
       fpIndex_->update(chunk.fingerprintHash_, chunk.nSubchunks_, chunk.cachedataLocation_, chunk.metadataLocation_);
     }
+    if (!chunk.hitLBAIndex_ && referenceAfterUpdate) fpIndex_->reference(chunk.fingerprintHash_);
   }
   END_TIMER(update_index);
 
@@ -133,6 +186,34 @@ void MetadataModule::update(Chunk &chunk) {
   //                                            (chunk.nSubchunks_) * Config::getInstance().getSubchunkSize());
   // }
 
+  if (removedFingerprintHash != ~0ull && removedFingerprintHash != chunk.fingerprintHash_) {
+    fpIndex_->dereference(removedFingerprintHash);
+  }
+  fpIndex_->releaseBucket();
+}
+
+void MetadataModule::invalidate(uint64_t addr) {
+  uint64_t lbaHash = Chunk::computeLBAHash(addr), removedFingerprintHash;
+  {
+    BucketLock lbaBucketLock = lbaIndex_->lock(lbaHash);
+    removedFingerprintHash = lbaIndex_->remove(lbaHash);
+  }
+  if (removedFingerprintHash != ~0ull) fpIndex_->dereference(removedFingerprintHash);
+}
+
+// A pattern chunk only takes an LBA index slot: no FP bucket to lock, no metadata to write
+void MetadataModule::updatePattern(Chunk &chunk) {
+  uint64_t removedFingerprintHash = ~0ull;
+  if (!chunk.lbaBucketLock_.isLocked()) chunk.lbaBucketLock_ = lbaIndex_->lock(chunk.lbaHash_);
+
+  BEGIN_TIMER();
+  if (chunk.lookupResult_ == HIT) {
+    lbaIndex_->promote(chunk.lbaHash_);
+  } else {
+    removedFingerprintHash = lbaIndex_->update(chunk.lbaHash_, chunk.fingerprintHash_);
+  }
+  END_TIMER(update_index);
+
   if (removedFingerprintHash != ~0ull && removedFingerprintHash != chunk.fingerprintHash_) {
     fpIndex_->dereference(removedFingerprintHash);
   }
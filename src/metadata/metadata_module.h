@@ -14,7 +14,13 @@ class MetadataModule {
   ~MetadataModule();
   void dedup(Chunk &chunk);
   void lookup(Chunk &chunk);
+  // Confirm an optimistic lookup hit under the bucket locks after the data is read;
+  // turns the chunk into a miss and returns false if the entry changed meanwhile.
+  bool revalidate(Chunk &chunk);
+  // A pattern chunk (Chunk::patternChunk_) is recorded in the LBA index only
   void update(Chunk &chunk);
+  // Drop the LBA index entry of the chunk at addr (a content-defined chunk that no longer exists)
+  void invalidate(uint64_t addr);
   void dumpStats();
 
   std::shared_ptr<LBAIndex> lbaIndex_;
@@ -23,6 +29,7 @@ class MetadataModule {
 
  private:
   MetadataModule();
+  void updatePattern(Chunk &chunk);
 };
 
 }  // namespace cache
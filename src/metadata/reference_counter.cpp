@@ -1,104 +1,238 @@
 
 #include "reference_counter.h"
 
+#include <algorithm>
 #include <cassert>
 #include <csignal>
 #include <cstring>
 #include <iostream>
+#include <new>
 
-#include "bitmap.h"
 #include "common/config.h"
+#include "common/hash_geometry.h"
+#include "index.h"
 #include "utils/xxhash.h"
 
 namespace cache {
-bool MapReferenceCounter::clear() { counters_.clear(); }
+MapReferenceCounter::MapReferenceCounter() : nEntries_(0) {
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  uint64_t nSlots = 1ull * geometry.getnFpBuckets() * geometry.getnFPSlotsPerBucket();
+  uint64_t capacity = 1024;
+  while (capacity < nSlots / 4 * 5) capacity <<= 1;
+  allocate(capacity);
+}
 
-uint32_t MapReferenceCounter::query(uint64_t key) {
-  if (counters_.find(key) == counters_.end()) {
-    return 0;
-  } else {
-    return counters_[key];
+void MapReferenceCounter::allocate(uint64_t capacity) {
+  entries_ = std::make_unique<Entry[]>(capacity);
+  mask_ = capacity - 1;
+  shift_ = 64 - __builtin_ctzll(capacity);
+}
+
+uint64_t MapReferenceCounter::find(uint64_t key) {
+  for (uint64_t i = home(key), dist = 0;; i = (i + 1) & mask_, ++dist) {
+    const Entry &entry = entries_[i];
+    if (entry.count == 0 || entry.dist < dist) return ~0ull;
+    if (entry.key == key) return i;
+  }
+}
+
+void MapReferenceCounter::insert(uint64_t key, uint32_t count) {
+  Entry entry = {key, count, 0};
+  for (uint64_t i = home(key);; i = (i + 1) & mask_, ++entry.dist) {
+    if (entries_[i].count == 0) {
+      entries_[i] = entry;
+      return;
+    }
+    // Robin Hood: the entry further from its home keeps the slot
+    if (entries_[i].dist < entry.dist) std::swap(entries_[i], entry);
+  }
+}
+
+void MapReferenceCounter::grow() {
+  std::unique_ptr<Entry[]> entries = std::move(entries_);
+  uint64_t capacity = mask_ + 1;
+  allocate(capacity * 2);
+  for (uint64_t i = 0; i < capacity; ++i) {
+    if (entries[i].count != 0) insert(entries[i].key, entries[i].count);
   }
 }
 
+bool MapReferenceCounter::clear() {
+  std::fill(entries_.get(), entries_.get() + mask_ + 1, Entry());
+  nEntries_ = 0;
+  return true;
+}
+
+uint32_t MapReferenceCounter::query(uint64_t key) {
+  uint64_t i = find(key);
+  return i == ~0ull ? 0 : entries_[i].count;
+}
+
 bool MapReferenceCounter::reference(uint64_t key) {
-  if (counters_.find(key) == counters_.end()) {
-    counters_[key] = 0;
+  uint64_t i = find(key);
+  if (i != ~0ull) {
+    entries_[i].count += 1;
+    return true;
   }
-  counters_[key] += 1;
+  if (++nEntries_ > (mask_ + 1) / 8 * 7) grow();
+  insert(key, 1);
+  return true;
 }
 
 bool MapReferenceCounter::dereference(uint64_t key) {
-  assert(counters_.find(key) != counters_.end());
-  counters_[key] -= 1;
-  if (counters_[key] == 0) {
-    counters_.erase(key);
+  uint64_t i = find(key);
+  if (i == ~0ull) return false;
+  if (--entries_[i].count != 0) return true;
+
+  // Backward shift deletion: move the following entries of the cluster one slot closer to home
+  for (uint64_t next = (i + 1) & mask_; entries_[next].count != 0 && entries_[next].dist != 0;
+       i = next, next = (next + 1) & mask_) {
+    entries_[i] = entries_[next];
+    entries_[i].dist -= 1;
   }
+  entries_[i] = Entry();
+  --nEntries_;
+  return true;
+}
+
+namespace {
+// Word of a sketch: 12 4-bit counters in bits [0, 48), 6 pair flags (bit 48 + pos / 2)
+// and 3 quad flags (bit 54 + pos / 4). A counter saturating at 15 is merged with its neighbour
+// into one 8-bit counter (pair flag), and a saturated 8-bit counter with the neighbouring pair
+// into one 16-bit counter (quad flag), which sticks at 65535. A merged counter holds the sum
+// of the counters it replaces.
+const uint32_t kPairFlags = 48, kQuadFlags = 54;
+
+// Width in bits of the counter holding position pos
+inline uint32_t getWidth(uint64_t w, uint32_t pos) {
+  if ((w >> (kQuadFlags + pos / 4)) & 1u) return 16;
+  if ((w >> (kPairFlags + pos / 2)) & 1u) return 8;
+  return 4;
+}
+
+// Sum of the counters stored in bits [shift, shift + width)
+inline uint32_t sumCounters(uint64_t w, uint32_t shift, uint32_t width) {
+  if (width == 4 || ((w >> (kPairFlags + shift / 8)) & 1u)) return (w >> shift) & ((1u << width) - 1);
+  return ((w >> shift) & 15u) + ((w >> (shift + 4)) & 15u);
+}
+
+inline uint32_t getCounter(uint64_t w, uint32_t pos) {
+  uint32_t width = getWidth(w, pos);
+  return (w >> (pos * 4 & ~(width - 1))) & ((1u << width) - 1);
+}
+
+inline uint64_t incrementCounter(uint64_t w, uint32_t pos) {
+  uint32_t width = getWidth(w, pos), shift = pos * 4 & ~(width - 1), maxValue = (1u << width) - 1;
+  uint64_t v = (w >> shift) & maxValue;
+  if (v < maxValue) return w + (1ull << shift);
+  if (width == 16) return w;
+  // 计数饱和：与相邻的同宽计数合并为一个两倍宽的计数（两者之和）
+  uint64_t merged = v + sumCounters(w, shift ^ width, width) + 1;
+  uint32_t mergedShift = shift & ~(2 * width - 1);
+  uint64_t flag = width == 4 ? 1ull << (kPairFlags + pos / 2) : 1ull << (kQuadFlags + pos / 4);
+  return (w & ~(((1ull << (2 * width)) - 1) << mergedShift)) | (merged << mergedShift) | flag;
 }
 
+inline uint64_t decrementCounter(uint64_t w, uint32_t pos) {
+  uint32_t width = getWidth(w, pos), shift = pos * 4 & ~(width - 1);
+  uint32_t v = (w >> shift) & ((1u << width) - 1);
+  // 饱和的 16 位计数不再递减
+  if (v == 0 || v == 0xffffu) return w;
+  return w - (1ull << shift);
+}
+}  // namespace
+
 SketchReferenceCounter::SketchReferenceCounter() {
   height_ = 4;
-  width_ = Config::getInstance().getnLbaBuckets() * Config::getInstance().getnLBASlotsPerBucket();
-  sketch_ = new uint8_t[4 * 4 * width_ / 8];
-  memset(sketch_, 0, 4 * 4 * width_ / 8);
+  width_ = HashGeometry::getInstance().getnLbaBuckets() * HashGeometry::getInstance().getnLBASlotsPerBucket();
+  uint32_t nWords = (height_ * width_ + 11) / 12;
+  sketch_ = std::make_unique<std::atomic<uint64_t>[]>(nWords);
+  for (uint32_t i = 0; i < nWords; ++i) sketch_[i].store(0, std::memory_order_relaxed);
 }
 
 void SketchReferenceCounter::clear() {}
 
 uint32_t SketchReferenceCounter::query(uint64_t key) {
   uint32_t minVal = ~0u;
-  uint32_t hashVal = 0;
-  for (int i = 0; i < height_; ++i) {
-    hashVal = XXH32(&key, 8, i * 1003 + 7);
-    uint32_t bucketId = i * width_ + hashVal % width_;
-    uint32_t overflowValue = 0;
-    uint32_t countValue = Bitmap::Manipulator(sketch_).getBits(bucketId * 4, bucketId * 4 + 4);
-    if (mp_.find(bucketId) != mp_.end()) {
-      overflowValue = mp_[bucketId];
-    }
-    minVal = (countValue + overflowValue < minVal) ? countValue + overflowValue : minVal;
+  for (uint32_t i = 0; i < height_; ++i) {
+    uint32_t hashVal = XXH32(&key, 8, i * 1003 + 7);
+    uint32_t cellId = i * width_ + hashVal % width_;
+    uint32_t countValue = getCounter(sketch_[cellId / 12].load(std::memory_order_relaxed), cellId % 12);
+    minVal = countValue < minVal ? countValue : minVal;
   }
   return minVal;
 }
 
+// 计数饱和时与相邻计数的合并，和递减一样，都是对同一个字的一次 CAS
 void SketchReferenceCounter::reference(uint64_t key) {
-  uint32_t minVal = ~0u;
-  uint32_t hashVal = 0;
-  uint32_t width = width_;
-  for (int i = 0; i < height_; ++i) {
-    hashVal = XXH32(&key, 8, i * 1003 + 7);
-    uint32_t bucketId = i * width_ + hashVal % width_;
-    uint32_t countValue = Bitmap::Manipulator(sketch_).getBits(bucketId * 4, bucketId * 4 + 4);
-    // 由于 countValue 是从 sketch_ 数组的 4 位中获取的，因此它的最大值是 2^4 - 1 = 15。
-    if (countValue == 15) {
-      if (mp_.find(bucketId) == mp_.end()) {
-        mp_[bucketId] = 1;
-      } else {
-        mp_[bucketId] += 1;
-      }
-    } else {
-      Bitmap::Manipulator(sketch_).storeBits(bucketId * 4, bucketId * 4 + 4, countValue + 1);
+  for (uint32_t i = 0; i < height_; ++i) {
+    uint32_t hashVal = XXH32(&key, 8, i * 1003 + 7);
+    uint32_t cellId = i * width_ + hashVal % width_;
+    std::atomic<uint64_t>& word = sketch_[cellId / 12];
+    uint64_t w = word.load(std::memory_order_relaxed);
+    while (!word.compare_exchange_weak(w, incrementCounter(w, cellId % 12), std::memory_order_relaxed)) {
     }
   }
 }
 
 void SketchReferenceCounter::dereference(uint64_t key) {
-  uint32_t minVal = ~0u;
-  uint32_t hashVal = 0;
-  uint32_t width = width_;
-  uint32_t a = mp_.size();
-  for (int i = 0; i < height_; ++i) {
-    hashVal = XXH32(&key, 8, i * 1003 + 7);
-    uint32_t bucketId = i * width_ + hashVal % width_;
-    if (mp_.find(bucketId) != mp_.end()) {
-      mp_[bucketId] -= 1;
-      if (mp_[bucketId] == 0) {
-        mp_.erase(bucketId);
-      }
-    } else {
-      uint32_t countValue = Bitmap::Manipulator(sketch_).getBits(bucketId * 4, bucketId * 4 + 4);
-      Bitmap::Manipulator(sketch_).storeBits(bucketId * 4, bucketId * 4 + 4, countValue - 1);
+  for (uint32_t i = 0; i < height_; ++i) {
+    uint32_t hashVal = XXH32(&key, 8, i * 1003 + 7);
+    uint32_t cellId = i * width_ + hashVal % width_;
+    std::atomic<uint64_t>& word = sketch_[cellId / 12];
+    uint64_t w = word.load(std::memory_order_relaxed);
+    while (!word.compare_exchange_weak(w, decrementCounter(w, cellId % 12), std::memory_order_relaxed)) {
     }
   }
 }
+BlockedSketchReferenceCounter::BlockedSketchReferenceCounter() {
+  // 与按行布局的 sketch 使用相同的内存：4 行 x width 个 4 位计数
+  const HashGeometry &geometry = HashGeometry::getInstance();
+  uint64_t width = 1ull * geometry.getnLbaBuckets() * geometry.getnLBASlotsPerBucket();
+  nBlocks_ = (4 * width * 4 / 8 + 63) / 64;
+  if (nBlocks_ == 0) nBlocks_ = 1;
+  storage_ = std::make_unique<uint8_t[]>(64ull * nBlocks_ + 64);
+  blocks_ = (std::atomic<uint64_t>*)(((uintptr_t)storage_.get() + 63) & ~(uintptr_t)63);
+  for (uint64_t i = 0; i < 8ull * nBlocks_; ++i) new (&blocks_[i]) std::atomic<uint64_t>(0);
+}
+
+uint32_t BlockedSketchReferenceCounter::query(uint64_t key) {
+  uint64_t hash = XXH64(&key, 8, 7);
+  std::atomic<uint64_t>* block = getBlock(hash);
+  uint32_t minVal = ~0u, word, pos;
+  for (uint32_t row = 0; row < 4; ++row) {
+    locate(hash, row, word, pos);
+    uint32_t countValue = getCounter(block[word].load(std::memory_order_relaxed), pos);
+    minVal = countValue < minVal ? countValue : minVal;
+  }
+  return minVal;
+}
+
+void BlockedSketchReferenceCounter::reference(uint64_t key) {
+  uint64_t hash = XXH64(&key, 8, 7);
+  std::atomic<uint64_t>* block = getBlock(hash);
+  uint32_t word, pos;
+  for (uint32_t row = 0; row < 4; ++row) {
+    locate(hash, row, word, pos);
+    uint64_t w = block[word].load(std::memory_order_relaxed);
+    while (!block[word].compare_exchange_weak(w, incrementCounter(w, pos), std::memory_order_relaxed)) {
+    }
+  }
+}
+
+void BlockedSketchReferenceCounter::dereference(uint64_t key) {
+  uint64_t hash = XXH64(&key, 8, 7);
+  std::atomic<uint64_t>* block = getBlock(hash);
+  uint32_t word, pos;
+  for (uint32_t row = 0; row < 4; ++row) {
+    locate(hash, row, word, pos);
+    uint64_t w = block[word].load(std::memory_order_relaxed);
+    while (!block[word].compare_exchange_weak(w, decrementCounter(w, pos), std::memory_order_relaxed)) {
+    }
+  }
+}
+
+uint32_t ReferenceCounter::queryInline(uint64_t key) { return inlineCounter_->queryReferenceCount(key); }
+
+void ReferenceCounter::addInline(uint64_t key, int delta) { inlineCounter_->addReferenceCount(key, delta); }
 }  // namespace cache
@@ -2,20 +2,46 @@
 #define _REFERENCECOUNTER_H
 
 #include <common/config.h>
+#include <common/hash_geometry.h>
 
+#include <atomic>
 #include <cstring>
 #include <map>
+#include <memory>
 #include <mutex>
 
 namespace cache {
 
+// Exact reference counters (sketchBasedReferenceCounter = 0): open addressing with Robin Hood
+// probing on the fingerprint hash. Entries of a cluster are ordered by distance from their home
+// slot, so a probe stops at the first entry closer to home than the key would be. An entry whose
+// count drops to 0 is deleted by shifting the rest of its cluster back one slot (no tombstones).
+// Sized for 5/4 of the FP index slots, doubled past a load factor of 7/8.
+// Not thread-safe: ReferenceCounter serializes it with rfMutex_.
 class MapReferenceCounter {
-  std::map<uint64_t, uint32_t> counters_;
+  struct Entry {
+    uint64_t key;
+    uint32_t count;  // 0 for an empty entry
+    uint32_t dist;   // distance from the home slot
+  };
+  std::unique_ptr<Entry[]> entries_;
+  uint64_t mask_, nEntries_;
+  uint32_t shift_;
+
+  MapReferenceCounter();
+  inline uint64_t home(uint64_t key) { return (key * 0x9E3779B97F4A7C15ull) >> shift_; }
+  void allocate(uint64_t capacity);
+  // Slot of the key, ~0 if it has no count
+  uint64_t find(uint64_t key);
+  // Insert a key that is not in the table
+  void insert(uint64_t key, uint32_t count);
+  void grow();
 
  public:
   bool clear();
   uint32_t query(uint64_t key);
   bool reference(uint64_t key);
+  // Returns false if the key has no count
   bool dereference(uint64_t key);
 
   static MapReferenceCounter& getInstance() {
@@ -24,10 +50,12 @@ class MapReferenceCounter {
   }
 };
 
+// Count-min sketch of 4-bit counters, 12 per 64-bit word with their escalation flags
+// (see BlockedSketchReferenceCounter), updated with compare-and-swap. A saturated counter
+// is merged with its neighbour within the word, so no update spans two locations.
 class SketchReferenceCounter {
-  uint8_t* sketch_;
+  std::unique_ptr<std::atomic<uint64_t>[]> sketch_;
   uint32_t width_, height_;
-  std::map<uint32_t, uint16_t> mp_;
 
   SketchReferenceCounter();
 
@@ -42,6 +70,41 @@ class SketchReferenceCounter {
   }
 };
 
+// Blocked count-min sketch: one XXH64 hash per key selects a 64-byte block (8 words)
+// and one counter in each of its four rows of two words, so an operation touches a
+// single cache line. A word holds 12 4-bit counters and their escalation flags, as
+// in SketchReferenceCounter: a counter saturating at 15 is merged with its
+// neighbour into one 8-bit counter holding the sum of both (an over-estimate for
+// either key, as with a hash collision), and a saturated 8-bit counter with the
+// neighbouring pair into a 16-bit one, which sticks at 65535. Words are updated with
+// compare-and-swap.
+class BlockedSketchReferenceCounter {
+  std::unique_ptr<uint8_t[]> storage_;
+  std::atomic<uint64_t>* blocks_;  // nBlocks_ * 8 words, 64-byte aligned
+  uint32_t nBlocks_;
+
+  BlockedSketchReferenceCounter();
+  // Word (relative to the block) and counter position of row `row` of a key
+  static inline void locate(uint64_t hash, uint32_t row, uint32_t& word, uint32_t& pos) {
+    uint32_t bits = (hash >> (8 * row)) & 0xffu;
+    word = 2 * row + (bits & 1u);
+    pos = ((bits >> 1) * 12) >> 7;
+  }
+  inline std::atomic<uint64_t>* getBlock(uint64_t hash) {
+    return blocks_ + 8 * (((hash >> 32) * nBlocks_) >> 32);
+  }
+
+ public:
+  uint32_t query(uint64_t key);
+  void reference(uint64_t key);
+  void dereference(uint64_t key);
+  static BlockedSketchReferenceCounter& getInstance() {
+    static BlockedSketchReferenceCounter instance;
+    return instance;
+  }
+};
+
+class FPIndex;
 class ReferenceCounter {
  public:
   ReferenceCounter() {}
@@ -49,33 +112,67 @@ class ReferenceCounter {
     static ReferenceCounter instance;
     return instance;
   }
+  // With Config::isInlineReferenceCountEnabled(), the FP index registers itself and the counts
+  // are kept in its slots (FPIndex::addReferenceCount); the sketch / map is never allocated.
+  void setInlineCounter(FPIndex* fpIndex) { inlineCounter_ = fpIndex; }
+
+  // The sketch is lock-free; rfMutex_ only serializes the map-based counter
   uint32_t query(uint64_t key) {
-    std::lock_guard<std::mutex> lock(rfMutex_);
+    if (inlineCounter_ != nullptr) return queryInline(key);
     if (Config::getInstance().isSketchRFEnabled()) {
+      if (Config::getInstance().getSketchLayout() == tBlockedSketch) {
+        return BlockedSketchReferenceCounter::getInstance().query(key);
+      }
       return SketchReferenceCounter::getInstance().query(key);
     } else {
+      std::lock_guard<std::mutex> lock(rfMutex_);
       return MapReferenceCounter::getInstance().query(key);
     }
   }
 
+  // LBA index values of pattern chunks have no FP index entry to count
   void reference(uint64_t key) {
-    std::lock_guard<std::mutex> lock(rfMutex_);
+    if (HashGeometry::getInstance().isPatternFpHash(key)) return;
+    if (inlineCounter_ != nullptr) {
+      addInline(key, 1);
+      return;
+    }
     if (Config::getInstance().isSketchRFEnabled()) {
+      if (Config::getInstance().getSketchLayout() == tBlockedSketch) {
+        BlockedSketchReferenceCounter::getInstance().reference(key);
+        return;
+      }
       SketchReferenceCounter::getInstance().reference(key);
     } else {
+      std::lock_guard<std::mutex> lock(rfMutex_);
       MapReferenceCounter::getInstance().reference(key);
     }
   }
 
   void dereference(uint64_t key) {
-    std::lock_guard<std::mutex> lock(rfMutex_);
+    if (HashGeometry::getInstance().isPatternFpHash(key)) return;
+    if (inlineCounter_ != nullptr) {
+      addInline(key, -1);
+      return;
+    }
     if (Config::getInstance().isSketchRFEnabled()) {
+      if (Config::getInstance().getSketchLayout() == tBlockedSketch) {
+        BlockedSketchReferenceCounter::getInstance().dereference(key);
+        return;
+      }
       SketchReferenceCounter::getInstance().dereference(key);
     } else {
+      std::lock_guard<std::mutex> lock(rfMutex_);
       MapReferenceCounter::getInstance().dereference(key);
     }
   }
   std::mutex rfMutex_;
+
+ private:
+  uint32_t queryInline(uint64_t key);
+  void addInline(uint64_t key, int delta);
+
+  FPIndex* inlineCounter_ = nullptr;
 };
 }  // namespace cache
 #endif  // AUSTERECACHE_REFERENCECOUNTER_H
@@ -0,0 +1,431 @@
+#include "signature_scan.h"
+
+#include <immintrin.h>
+
+#include <cstring>
+
+namespace cache {
+namespace {
+inline uint64_t loadBits(const uint8_t *data, uint32_t bitOffset) {
+  uint64_t v;
+  memcpy(&v, data + (bitOffset >> 3u), sizeof(v));
+  return v >> (bitOffset & 7u);
+}
+
+// AND the match mask with the valid bits of the bucket. The valid region of a bucket is
+// only (nSlots + 7) / 8 bytes, so the last word is loaded byte-exactly.
+inline void applyValid(const uint8_t *valid, uint32_t nSlots, uint64_t *mask) {
+  uint32_t nBytes = (nSlots + 7) / 8;
+  for (uint32_t w = 0; w < (nSlots + 63) / 64; ++w) {
+    uint64_t v = 0;
+    memcpy(&v, valid + w * 8, nBytes - w * 8 < 8 ? nBytes - w * 8 : 8);
+    mask[w] &= v;
+  }
+}
+
+inline void matchTail(const uint8_t *data, uint32_t nBitsPerSlot, uint64_t keyMask, uint32_t slotId, uint32_t nSlots,
+                      uint32_t signature, uint64_t *mask) {
+  for (; slotId < nSlots; ++slotId) {
+    if ((loadBits(data, slotId * nBitsPerSlot) & keyMask) == signature) {
+      mask[slotId >> 6] |= 1ull << (slotId & 63u);
+    }
+  }
+}
+
+// Deployed bucket geometries with specialized kernels: (signature bits, value bits, slots per bucket).
+// FP buckets hold a 4-bit value. LBA buckets hold an FP hash, i.e. the FP signature plus the FP
+// bucket id, whose width is 32 - clz(nFpBuckets) and thus follows the cache size: every width of
+// 1 ~ 24 bits is instantiated, which covers caches of up to 16 TiB (16-bit signatures, 128 slots)
+// and 8 TiB (12-bit signatures, 64 slots). Other geometries use the generic kernel.
+// Only kernels that beat the generic one are kept (bucket_lookup): the AVX2 kernels of 16-bit /
+// 128-slot LBA buckets are within noise of it (0.92 ~ 1.27x), so those geometries only get an
+// AVX-512 VBMI kernel (X_VBMI).
+#define SIGNATURE_SCAN_FIXED_GEOMETRIES(X, X_VBMI)     \
+  X(16, 4, 128) /* FP, 16-bit signature, 128 slots */  \
+  X(12, 4, 64)  /* FP, 12-bit signature, 64 slots */   \
+  SIGNATURE_SCAN_LBA_GEOMETRIES(X_VBMI, 16, 128)       \
+  SIGNATURE_SCAN_LBA_GEOMETRIES(X, 12, 64)
+
+// LBA geometries of k-bit signatures (LBA and FP) and n slots, for FP bucket ids of 1 ~ 24 bits
+#define SIGNATURE_SCAN_LBA_GEOMETRIES(X, k, n)                    \
+  X(k, k + 1, n) X(k, k + 2, n) X(k, k + 3, n) X(k, k + 4, n)     \
+  X(k, k + 5, n) X(k, k + 6, n) X(k, k + 7, n) X(k, k + 8, n)     \
+  X(k, k + 9, n) X(k, k + 10, n) X(k, k + 11, n) X(k, k + 12, n)  \
+  X(k, k + 13, n) X(k, k + 14, n) X(k, k + 15, n) X(k, k + 16, n) \
+  X(k, k + 17, n) X(k, k + 18, n) X(k, k + 19, n) X(k, k + 20, n) \
+  X(k, k + 21, n) X(k, k + 22, n) X(k, k + 23, n) X(k, k + 24, n)
+
+template <uint32_t kBitsPerKey, uint32_t kBitsPerValue, uint32_t kSlots>
+struct FixedGeometry {
+  static const uint32_t kBitsPerSlot = kBitsPerKey + kBitsPerValue;
+  static const uint32_t kWords = (kSlots + 63) / 64;
+  static const uint64_t kKeyMask = (1ull << kBitsPerKey) - 1;
+  // The vector kernels handle 8 slots, i.e. kBitsPerSlot bytes, per step
+  static_assert(kSlots % 8 == 0 && kSlots <= MAX_NUM_SLOTS_PER_BUCKET, "unsupported number of slots");
+  static_assert(kBitsPerKey <= 24 && kBitsPerSlot <= 56, "unsupported slot geometry");
+};
+
+// Unpacking of 8 slots (kBitsPerSlot bytes) into the lanes of two 128-bit halves (pshufb works
+// within halves): 32-bit lanes if the key of the 4th slot of a half ends within its 16 bytes,
+// otherwise 64-bit lanes over four halves. Half h is loaded from byte base[h] of the 8 slots.
+template <uint32_t kBitsPerSlot>
+struct AVX2Unpack {
+  static const bool kWide = ((7 + 3 * kBitsPerSlot) >> 3) + 4 > 16;
+  static const uint32_t kLaneBytes = kWide ? 8 : 4, kSlotsPerHalf = 16 / kLaneBytes, kHalves = 8 / kSlotsPerHalf;
+
+  constexpr AVX2Unpack() : base(), shuffle(), shift32(), shift64() {
+    for (uint32_t h = 0; h < kHalves; ++h) {
+      base[h] = h * kSlotsPerHalf * kBitsPerSlot / 8;
+      for (uint32_t j = 0; j < kSlotsPerHalf; ++j) {
+        uint32_t bit = (h * kSlotsPerHalf + j) * kBitsPerSlot - base[h] * 8;
+        for (uint32_t t = 0; t < kLaneBytes; ++t) shuffle[h][j * kLaneBytes + t] = (bit >> 3) + t;
+        shift32[h * kSlotsPerHalf + j] = shift64[h * kSlotsPerHalf + j] = bit & 7;
+      }
+    }
+  }
+  uint32_t base[4];
+  uint8_t shuffle[4][16];
+  uint32_t shift32[8];
+  uint64_t shift64[8];
+};
+
+// Unpacking of 16 slots (or 8 if 16 do not fit) from a 64-byte masked load into 32-bit lanes
+template <uint32_t kBitsPerSlot>
+struct AVX512Unpack {
+  static const uint32_t kSlotsPerStep = ((15 * kBitsPerSlot) >> 3) + 4 <= 64 ? 16 : 8;
+  static const uint32_t kBytesPerLoad = (((kSlotsPerStep - 1) * kBitsPerSlot) >> 3) + 4;
+
+  constexpr AVX512Unpack() : permute(), shift() {
+    for (uint32_t j = 0; j < kSlotsPerStep; ++j) {
+      for (uint32_t t = 0; t < 4; ++t) permute[j * 4 + t] = ((j * kBitsPerSlot) >> 3) + t;
+      shift[j] = (j * kBitsPerSlot) & 7;
+    }
+  }
+  uint8_t permute[64];
+  uint32_t shift[16];
+};
+
+// Two unaligned 16-byte loads into the halves of a 256-bit register
+__attribute__((target("avx2"))) inline __m256i loadHalves(const uint8_t *p, uint32_t lo, uint32_t hi) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + lo))),
+                                 _mm_loadu_si128((const __m128i *)(p + hi)), 1);
+}
+
+template <uint32_t kBitsPerKey, uint32_t kBitsPerValue, uint32_t kSlots>
+__attribute__((target("avx2"))) void matchFixedAVX2(const uint8_t *data, const uint8_t *valid, uint32_t, uint32_t,
+                                                    uint32_t, uint32_t signature, uint64_t *mask) {
+  typedef FixedGeometry<kBitsPerKey, kBitsPerValue, kSlots> G;
+  typedef AVX2Unpack<G::kBitsPerSlot> U;
+  static constexpr U kUnpack{};
+  // Each half loads 16 bytes: the last one may read past the bucket, into the tail padding
+  static_assert((kSlots / 8 - 1) * G::kBitsPerSlot + U().base[U::kHalves - 1] + 16 <=
+                    (kSlots * G::kBitsPerSlot + 7) / 8 + SIGNATURE_SCAN_TAIL_PADDING,
+                "AVX2 unpacking reads past the tail padding");
+  const __m256i shuffle0 = _mm256_loadu_si256((const __m256i *)kUnpack.shuffle[0]);
+  const __m256i shuffle1 = _mm256_loadu_si256((const __m256i *)kUnpack.shuffle[2]);
+
+  for (uint32_t w = 0; w < G::kWords; ++w) {
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < 64 && w * 64 + i < kSlots; i += 8) {
+      const uint8_t *p = data + (w * 64 + i) / 8 * G::kBitsPerSlot;
+      uint64_t eq;
+      if (U::kWide) {
+        const __m256i key = _mm256_set1_epi64x(G::kKeyMask), sig = _mm256_set1_epi64x(signature);
+        __m256i lo = _mm256_shuffle_epi8(loadHalves(p, kUnpack.base[0], kUnpack.base[1]), shuffle0);
+        __m256i hi = _mm256_shuffle_epi8(loadHalves(p, kUnpack.base[2], kUnpack.base[3]), shuffle1);
+        lo = _mm256_and_si256(_mm256_srlv_epi64(lo, _mm256_loadu_si256((const __m256i *)kUnpack.shift64)), key);
+        hi = _mm256_and_si256(_mm256_srlv_epi64(hi, _mm256_loadu_si256((const __m256i *)(kUnpack.shift64 + 4))), key);
+        eq = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(lo, sig))) |
+             _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(hi, sig))) << 4;
+      } else {
+        const __m256i key = _mm256_set1_epi32(G::kKeyMask), sig = _mm256_set1_epi32(signature);
+        __m256i words = _mm256_shuffle_epi8(loadHalves(p, kUnpack.base[0], kUnpack.base[1]), shuffle0);
+        words = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_loadu_si256((const __m256i *)kUnpack.shift32)), key);
+        eq = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(words, sig)));
+      }
+      bits |= eq << i;
+    }
+    mask[w] = bits;
+  }
+  applyValid(valid, kSlots, mask);
+}
+
+// Masked loads never touch the bytes past the slots of a step
+template <uint32_t kBitsPerKey, uint32_t kBitsPerValue, uint32_t kSlots>
+__attribute__((target("avx512f,avx512bw,avx512vbmi"))) void matchFixedAVX512(const uint8_t *data,
+                                                                             const uint8_t *valid, uint32_t,
+                                                                             uint32_t, uint32_t, uint32_t signature,
+                                                                             uint64_t *mask) {
+  typedef FixedGeometry<kBitsPerKey, kBitsPerValue, kSlots> G;
+  typedef AVX512Unpack<G::kBitsPerSlot> U;
+  static constexpr U kUnpack{};
+  const __mmask64 load = U::kBytesPerLoad == 64 ? ~0ull : (1ull << U::kBytesPerLoad) - 1;
+  const __mmask16 lanes = (__mmask16)((1u << U::kSlotsPerStep) - 1);
+  const __mmask64 laneBytes = U::kSlotsPerStep == 16 ? ~0ull : (1ull << (4 * U::kSlotsPerStep)) - 1;
+  const __m512i permute = _mm512_loadu_si512(kUnpack.permute);
+  const __m512i shift = _mm512_loadu_si512(kUnpack.shift);
+  const __m512i key = _mm512_set1_epi32(G::kKeyMask), sig = _mm512_set1_epi32(signature);
+
+  for (uint32_t w = 0; w < G::kWords; ++w) {
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < 64 && w * 64 + i < kSlots; i += U::kSlotsPerStep) {
+      const uint8_t *p = data + (w * 64 + i) / 8 * G::kBitsPerSlot;
+      __m512i words = _mm512_maskz_permutexvar_epi8(laneBytes, permute, _mm512_maskz_loadu_epi8(load, p));
+      words = _mm512_and_si512(_mm512_srlv_epi32(words, shift), key);
+      bits |= (uint64_t)_mm512_mask_cmpeq_epi32_mask(lanes, words, sig) << i;
+    }
+    mask[w] = bits;
+  }
+  applyValid(valid, kSlots, mask);
+}
+
+template <typename T>
+inline void matchKeysTail(const T *keys, uint32_t slotId, uint32_t nSlots, uint32_t signature, uint64_t *mask) {
+  for (; slotId < nSlots; ++slotId) {
+    if (keys[slotId] == signature) {
+      mask[slotId >> 6] |= 1ull << (slotId & 63u);
+    }
+  }
+}
+}  // namespace
+
+SignatureScanner::SignatureScanner() {
+  if (isAVX512Supported()) {
+    match_ = matchAVX512, matchKeys16_ = matchKeys16AVX512, matchKeys32_ = matchKeys32AVX512;
+    kernelName_ = "AVX-512";
+  } else if (isAVX2Supported()) {
+    match_ = matchAVX2, matchKeys16_ = matchKeys16AVX2, matchKeys32_ = matchKeys32AVX2;
+    kernelName_ = "AVX2";
+  } else if (isSSE42Supported()) {
+    match_ = matchSSE42, matchKeys16_ = matchKeys16SSE42, matchKeys32_ = matchKeys32SSE42;
+    kernelName_ = "SSE4.2";
+  } else {
+    match_ = matchScalar, matchKeys16_ = matchKeys16Scalar, matchKeys32_ = matchKeys32Scalar;
+    kernelName_ = "scalar";
+  }
+  if (isAVX512VBMISupported()) {
+    fixedKernel_ = &FixedMatch::avx512, fixedKernelName_ = "AVX-512 VBMI";
+  } else if (isAVX2Supported()) {
+    fixedKernel_ = &FixedMatch::avx2, fixedKernelName_ = "AVX2";
+  } else {
+    // Unrolled scalar code is slower than the generic kernel: every geometry uses the latter
+    fixedKernel_ = nullptr, fixedKernelName_ = nullptr;
+  }
+}
+
+#define SIGNATURE_SCAN_FIXED_MATCH(k, v, n) {k, v, n, matchFixedAVX2<k, v, n>, matchFixedAVX512<k, v, n>},
+#define SIGNATURE_SCAN_FIXED_MATCH_VBMI(k, v, n) {k, v, n, nullptr, matchFixedAVX512<k, v, n>},
+const SignatureScanner::FixedMatch SignatureScanner::kFixedMatches[] = {
+    SIGNATURE_SCAN_FIXED_GEOMETRIES(SIGNATURE_SCAN_FIXED_MATCH, SIGNATURE_SCAN_FIXED_MATCH_VBMI)};
+#undef SIGNATURE_SCAN_FIXED_MATCH
+#undef SIGNATURE_SCAN_FIXED_MATCH_VBMI
+const uint32_t SignatureScanner::kNumFixedMatches = sizeof(kFixedMatches) / sizeof(kFixedMatches[0]);
+
+const SignatureScanner::FixedMatch *SignatureScanner::findFixedMatch(uint32_t nBitsPerKey, uint32_t nBitsPerValue,
+                                                                     uint32_t nSlots) {
+  for (uint32_t i = 0; i < kNumFixedMatches; ++i) {
+    const FixedMatch &fixed = kFixedMatches[i];
+    if (fixed.nBitsPerKey == nBitsPerKey && fixed.nBitsPerValue == nBitsPerValue && fixed.nSlots == nSlots) {
+      return &fixed;
+    }
+  }
+  return nullptr;
+}
+
+bool SignatureScanner::isSSE42Supported() { return __builtin_cpu_supports("sse4.2"); }
+bool SignatureScanner::isAVX2Supported() { return __builtin_cpu_supports("avx2"); }
+// The 16-bit AVX-512 compare needs AVX512BW on top of AVX512F
+bool SignatureScanner::isAVX512Supported() {
+  return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+bool SignatureScanner::isAVX512VBMISupported() { return isAVX512Supported() && __builtin_cpu_supports("avx512vbmi"); }
+
+void SignatureScanner::matchScalar(const uint8_t *data, const uint8_t *valid, uint32_t nBitsPerSlot,
+                                   uint32_t nBitsPerKey, uint32_t nSlots, uint32_t signature, uint64_t *mask) {
+  uint64_t keyMask = (1ull << nBitsPerKey) - 1;
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  matchTail(data, nBitsPerSlot, keyMask, 0, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+// No gather on SSE4.2: signatures are unpacked with scalar loads, then compared 4 at a time.
+__attribute__((target("sse4.2"))) void SignatureScanner::matchSSE42(const uint8_t *data, const uint8_t *valid,
+                                                                    uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                                                                    uint32_t nSlots, uint32_t signature,
+                                                                    uint64_t *mask) {
+  uint64_t keyMask = (1ull << nBitsPerKey) - 1;
+  __m128i sig = _mm_set1_epi32(signature);
+  __m128i key = _mm_set1_epi32(keyMask);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 4 <= nSlots; slotId += 4) {
+    uint32_t b = slotId * nBitsPerSlot;
+    __m128i keys = _mm_setr_epi32(loadBits(data, b), loadBits(data, b + nBitsPerSlot),
+                                  loadBits(data, b + 2 * nBitsPerSlot), loadBits(data, b + 3 * nBitsPerSlot));
+    __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(keys, key), sig);
+    mask[slotId >> 6] |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << (slotId & 63u);
+  }
+  matchTail(data, nBitsPerSlot, keyMask, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("avx2"))) void SignatureScanner::matchAVX2(const uint8_t *data, const uint8_t *valid,
+                                                                 uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                                                                 uint32_t nSlots, uint32_t signature, uint64_t *mask) {
+  uint64_t keyMask = (1ull << nBitsPerKey) - 1;
+  __m256i sig = _mm256_set1_epi64x(signature);
+  __m256i key = _mm256_set1_epi64x(keyMask);
+  __m256i seven = _mm256_set1_epi64x(7);
+  __m256i step = _mm256_set1_epi64x(4ull * nBitsPerSlot);
+  __m256i bitOffsets = _mm256_set_epi64x(3ull * nBitsPerSlot, 2ull * nBitsPerSlot, nBitsPerSlot, 0);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 4 <= nSlots; slotId += 4) {
+    __m256i words = _mm256_i64gather_epi64((const long long *)data, _mm256_srli_epi64(bitOffsets, 3), 1);
+    words = _mm256_and_si256(_mm256_srlv_epi64(words, _mm256_and_si256(bitOffsets, seven)), key);
+    uint64_t bits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(words, sig)));
+    mask[slotId >> 6] |= bits << (slotId & 63u);
+    bitOffsets = _mm256_add_epi64(bitOffsets, step);
+  }
+  matchTail(data, nBitsPerSlot, keyMask, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("avx512f"))) void SignatureScanner::matchAVX512(const uint8_t *data, const uint8_t *valid,
+                                                                      uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                                                                      uint32_t nSlots, uint32_t signature,
+                                                                      uint64_t *mask) {
+  uint64_t keyMask = (1ull << nBitsPerKey) - 1;
+  __m512i sig = _mm512_set1_epi64(signature);
+  __m512i key = _mm512_set1_epi64(keyMask);
+  __m512i seven = _mm512_set1_epi64(7);
+  __m512i step = _mm512_set1_epi64(8ull * nBitsPerSlot);
+  uint64_t w = nBitsPerSlot;
+  __m512i bitOffsets = _mm512_set_epi64(7 * w, 6 * w, 5 * w, 4 * w, 3 * w, 2 * w, w, 0);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 8 <= nSlots; slotId += 8) {
+    __m512i words = _mm512_i64gather_epi64(_mm512_srli_epi64(bitOffsets, 3), data, 1);
+    words = _mm512_and_si512(_mm512_srlv_epi64(words, _mm512_and_si512(bitOffsets, seven)), key);
+    uint64_t bits = _mm512_cmpeq_epi64_mask(words, sig);
+    mask[slotId >> 6] |= bits << (slotId & 63u);
+    bitOffsets = _mm512_add_epi64(bitOffsets, step);
+  }
+  matchTail(data, nBitsPerSlot, keyMask, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+void SignatureScanner::matchKeys16Scalar(const uint16_t *keys, const uint8_t *valid, uint32_t nSlots,
+                                         uint32_t signature, uint64_t *mask) {
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  matchKeysTail(keys, 0, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("sse4.2"))) void SignatureScanner::matchKeys16SSE42(const uint16_t *keys, const uint8_t *valid,
+                                                                          uint32_t nSlots, uint32_t signature,
+                                                                          uint64_t *mask) {
+  __m128i sig = _mm_set1_epi16(signature);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 16 <= nSlots; slotId += 16) {
+    __m128i eq0 = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(keys + slotId)), sig);
+    __m128i eq1 = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(keys + slotId + 8)), sig);
+    uint64_t bits = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(eq0, eq1));
+    mask[slotId >> 6] |= bits << (slotId & 63u);
+  }
+  matchKeysTail(keys, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("avx2"))) void SignatureScanner::matchKeys16AVX2(const uint16_t *keys, const uint8_t *valid,
+                                                                       uint32_t nSlots, uint32_t signature,
+                                                                       uint64_t *mask) {
+  __m256i sig = _mm256_set1_epi16(signature);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 32 <= nSlots; slotId += 32) {
+    __m256i eq0 = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(keys + slotId)), sig);
+    __m256i eq1 = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(keys + slotId + 16)), sig);
+    // packs works within 128-bit lanes, restore the slot order before taking the byte mask
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(eq0, eq1), 0xd8);
+    uint64_t bits = (uint32_t)_mm256_movemask_epi8(packed);
+    mask[slotId >> 6] |= bits << (slotId & 63u);
+  }
+  matchKeysTail(keys, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void SignatureScanner::matchKeys16AVX512(const uint16_t *keys,
+                                                                                     const uint8_t *valid,
+                                                                                     uint32_t nSlots,
+                                                                                     uint32_t signature,
+                                                                                     uint64_t *mask) {
+  __m512i sig = _mm512_set1_epi16(signature);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 32 <= nSlots; slotId += 32) {
+    uint64_t bits = _mm512_cmpeq_epi16_mask(_mm512_loadu_si512(keys + slotId), sig);
+    mask[slotId >> 6] |= bits << (slotId & 63u);
+  }
+  matchKeysTail(keys, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+void SignatureScanner::matchKeys32Scalar(const uint32_t *keys, const uint8_t *valid, uint32_t nSlots,
+                                         uint32_t signature, uint64_t *mask) {
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  matchKeysTail(keys, 0, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("sse4.2"))) void SignatureScanner::matchKeys32SSE42(const uint32_t *keys, const uint8_t *valid,
+                                                                          uint32_t nSlots, uint32_t signature,
+                                                                          uint64_t *mask) {
+  __m128i sig = _mm_set1_epi32(signature);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 4 <= nSlots; slotId += 4) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(keys + slotId)), sig);
+    mask[slotId >> 6] |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << (slotId & 63u);
+  }
+  matchKeysTail(keys, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("avx2"))) void SignatureScanner::matchKeys32AVX2(const uint32_t *keys, const uint8_t *valid,
+                                                                       uint32_t nSlots, uint32_t signature,
+                                                                       uint64_t *mask) {
+  __m256i sig = _mm256_set1_epi32(signature);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 8 <= nSlots; slotId += 8) {
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(keys + slotId)), sig);
+    mask[slotId >> 6] |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) << (slotId & 63u);
+  }
+  matchKeysTail(keys, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+
+__attribute__((target("avx512f"))) void SignatureScanner::matchKeys32AVX512(const uint32_t *keys, const uint8_t *valid,
+                                                                            uint32_t nSlots, uint32_t signature,
+                                                                            uint64_t *mask) {
+  __m512i sig = _mm512_set1_epi32(signature);
+  uint32_t slotId = 0;
+
+  memset(mask, 0, (nSlots + 63) / 64 * sizeof(uint64_t));
+  for (; slotId + 16 <= nSlots; slotId += 16) {
+    uint64_t bits = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(keys + slotId), sig);
+    mask[slotId >> 6] |= bits << (slotId & 63u);
+  }
+  matchKeysTail(keys, slotId, nSlots, signature, mask);
+  applyValid(valid, nSlots, mask);
+}
+}  // namespace cache
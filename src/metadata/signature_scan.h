@@ -0,0 +1,145 @@
+/* File: metadata/signature_scan.h
+ * Description:
+ *   This file contains the vectorized signature probe used by LBABucket and FPBucket.
+ *
+ *   1. A bucket is a bit-packed array of nSlots slots, each of nBitsPerSlot bits,
+ *      whose low nBitsPerKey bits hold the signature (key) of the slot.
+ *   2. SignatureScanner::match compares a broadcast signature against all slots of
+ *      a bucket at once and produces a bitmask of matching slots ANDed with the
+ *      bucket valid bits (bit i of mask[i / 64] <-> slot i).
+ *   3. For the aligned index layout, signatures are contiguous uint16_t/uint32_t
+ *      arrays, and matchKeys16/matchKeys32 compare them with plain vector loads.
+ *   4. The kernels (AVX-512, AVX2, SSE4.2 or scalar) are chosen once at startup
+ *      according to the running CPU, so the binary stays portable.
+ *   5. For the bucket geometries we deploy, kernels specialized at compile time on
+ *      (signature bits, value bits, slots per bucket) unpack the slots with constant
+ *      byte shuffles instead of gathers; each index picks its kernel at startup with
+ *      getMatchFunc, the generic kernel serving every other geometry.
+ *
+ *   Kernels issue 8-byte loads at the byte of each slot, so the slot memory must be
+ *   followed by SIGNATURE_SCAN_TAIL_PADDING readable bytes.
+ */
+#ifndef __SIGNATURE_SCAN_H__
+#define __SIGNATURE_SCAN_H__
+
+#include <cstdint>
+
+#define SIGNATURE_SCAN_TAIL_PADDING 8u
+#define MAX_NUM_SLOTS_PER_BUCKET 512u
+
+namespace cache {
+class SignatureScanner {
+ public:
+  typedef void (*MatchFunc)(const uint8_t *data, const uint8_t *valid, uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                            uint32_t nSlots, uint32_t signature, uint64_t *mask);
+  typedef void (*MatchKeys16Func)(const uint16_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                                  uint64_t *mask);
+  typedef void (*MatchKeys32Func)(const uint32_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                                  uint64_t *mask);
+
+  static SignatureScanner &getInstance() {
+    static SignatureScanner instance;
+    return instance;
+  }
+
+  inline void match(const uint8_t *data, const uint8_t *valid, uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                    uint32_t nSlots, uint32_t signature, uint64_t *mask) {
+    match_(data, valid, nBitsPerSlot, nBitsPerKey, nSlots, signature, mask);
+  }
+  inline void matchKeys16(const uint16_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                          uint64_t *mask) {
+    matchKeys16_(keys, valid, nSlots, signature, mask);
+  }
+  inline void matchKeys32(const uint32_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                          uint64_t *mask) {
+    matchKeys32_(keys, valid, nSlots, signature, mask);
+  }
+  const char *getKernelName() { return kernelName_; }
+
+  // A match kernel specialized for one bucket geometry, per instruction set, nullptr where it
+  // would not beat the generic kernel. Specialized kernels ignore the nBitsPerSlot / nBitsPerKey
+  // / nSlots arguments.
+  struct FixedMatch {
+    uint32_t nBitsPerKey, nBitsPerValue, nSlots;
+    MatchFunc avx2, avx512;
+  };
+  static const FixedMatch kFixedMatches[];
+  static const uint32_t kNumFixedMatches;
+  // The specialized kernels of a geometry, nullptr if it is not instantiated
+  static const FixedMatch *findFixedMatch(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nSlots);
+
+  // The generic kernel for the running CPU
+  MatchFunc getMatchFunc() { return match_; }
+  // The kernel for buckets of the given geometry: the specialized one for the running CPU
+  // if the geometry has one, the generic one otherwise
+  MatchFunc getMatchFunc(uint32_t nBitsPerKey, uint32_t nBitsPerValue, uint32_t nSlots) {
+    const FixedMatch *fixed = fixedKernel_ != nullptr ? findFixedMatch(nBitsPerKey, nBitsPerValue, nSlots) : nullptr;
+    return fixed != nullptr && fixed->*fixedKernel_ != nullptr ? fixed->*fixedKernel_ : match_;
+  }
+  const char *getFixedKernelName() { return fixedKernelName_; }
+
+  // All kernels are exposed so that the micro benchmark can compare them.
+  static void matchScalar(const uint8_t *data, const uint8_t *valid, uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                          uint32_t nSlots, uint32_t signature, uint64_t *mask);
+  static void matchSSE42(const uint8_t *data, const uint8_t *valid, uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                         uint32_t nSlots, uint32_t signature, uint64_t *mask);
+  static void matchAVX2(const uint8_t *data, const uint8_t *valid, uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                        uint32_t nSlots, uint32_t signature, uint64_t *mask);
+  static void matchAVX512(const uint8_t *data, const uint8_t *valid, uint32_t nBitsPerSlot, uint32_t nBitsPerKey,
+                          uint32_t nSlots, uint32_t signature, uint64_t *mask);
+
+  static void matchKeys16Scalar(const uint16_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                                uint64_t *mask);
+  static void matchKeys16SSE42(const uint16_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                               uint64_t *mask);
+  static void matchKeys16AVX2(const uint16_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                              uint64_t *mask);
+  static void matchKeys16AVX512(const uint16_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                                uint64_t *mask);
+  static void matchKeys32Scalar(const uint32_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                                uint64_t *mask);
+  static void matchKeys32SSE42(const uint32_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                               uint64_t *mask);
+  static void matchKeys32AVX2(const uint32_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                              uint64_t *mask);
+  static void matchKeys32AVX512(const uint32_t *keys, const uint8_t *valid, uint32_t nSlots, uint32_t signature,
+                                uint64_t *mask);
+
+  static bool isSSE42Supported();
+  static bool isAVX2Supported();
+  static bool isAVX512Supported();
+  // The specialized AVX-512 kernels permute bytes across the whole register
+  static bool isAVX512VBMISupported();
+
+  // Index of the first set bit in mask, ~0 if none
+  static inline uint32_t findFirst(const uint64_t *mask, uint32_t nSlots) {
+    for (uint32_t w = 0; w < (nSlots + 63) / 64; ++w) {
+      if (mask[w]) return w * 64 + __builtin_ctzll(mask[w]);
+    }
+    return ~((uint32_t)0);
+  }
+
+  // Number of contiguous set bits in mask starting from bit `from`
+  static inline uint32_t countRun(const uint64_t *mask, uint32_t from, uint32_t nSlots) {
+    uint32_t n = 0;
+    while (from < nSlots) {
+      uint32_t shift = from & 63u;
+      uint64_t zeros = ~(mask[from >> 6] >> shift);
+      uint32_t run = zeros ? __builtin_ctzll(zeros) : 64;
+      n += run, from += run;
+      if (shift + run < 64) break;
+    }
+    return n;
+  }
+
+ private:
+  SignatureScanner();
+
+  MatchFunc match_;
+  MatchKeys16Func matchKeys16_;
+  MatchKeys32Func matchKeys32_;
+  MatchFunc FixedMatch::*fixedKernel_;
+  const char *kernelName_, *fixedKernelName_;
+};
+}  // namespace cache
+#endif
@@ -0,0 +1,57 @@
+#ifndef __PERF_COUNTER_H__
+#define __PERF_COUNTER_H__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace cache {
+// A hardware event counter (perf_event_open) covering the calling thread and
+// every thread it spawns after start(), e.g. the replay thread pool.
+// isAvailable() is false when the kernel/VM does not expose the event.
+class PerfCounter {
+ public:
+  explicit PerfCounter(uint32_t type = PERF_TYPE_HARDWARE, uint64_t config = PERF_COUNT_HW_CACHE_MISSES) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    error_ = fd_ < 0 ? errno : 0;
+  }
+  ~PerfCounter() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool isAvailable() { return fd_ >= 0; }
+  // errno of perf_event_open when the counter is unavailable
+  int getError() { return error_; }
+  void start() {
+    if (fd_ < 0) return;
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  void stop() {
+    if (fd_ >= 0) ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+  }
+  uint64_t read() {
+    uint64_t count = 0;
+    if (fd_ < 0 || ::read(fd_, &count, sizeof(count)) != sizeof(count)) return 0;
+    return count;
+  }
+
+ private:
+  int fd_;
+  int error_;
+};
+}  // namespace cache
+#endif